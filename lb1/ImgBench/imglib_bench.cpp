@@ -0,0 +1,428 @@
+#include <bmp_image.h>
+#include <gray_image.h>
+#include <img_lib.h>
+#include <jpeg_image.h>
+#include <png_image.h>
+#include <ppm_image.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+// Подсчёт выделений памяти: глобальные operator new/delete заменены
+// на обёртки над malloc, которые считают число и объём выделений.
+// Собственные буферы libjpeg выделяются через malloc и не учитываются
+namespace {
+
+atomic<uint64_t> g_alloc_count{0};
+atomic<uint64_t> g_alloc_bytes{0};
+
+void* CountedAlloc(size_t size) {
+    g_alloc_count.fetch_add(1, memory_order_relaxed);
+    g_alloc_bytes.fetch_add(size, memory_order_relaxed);
+    if (void* p = malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw bad_alloc();
+}
+
+void* CountedAlignedAlloc(size_t size, align_val_t alignment) {
+    g_alloc_count.fetch_add(1, memory_order_relaxed);
+    g_alloc_bytes.fetch_add(size, memory_order_relaxed);
+    const size_t align = max(static_cast<size_t>(alignment), sizeof(void*));
+    void* p = nullptr;
+#if defined(_WIN32)
+    p = _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+    if (posix_memalign(&p, align, size == 0 ? 1 : size) != 0) {
+        p = nullptr;
+    }
+#endif
+    if (!p) {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+void AlignedFree(void* p) noexcept {
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+    return CountedAlloc(size);
+}
+void* operator new[](size_t size) {
+    return CountedAlloc(size);
+}
+void* operator new(size_t size, align_val_t alignment) {
+    return CountedAlignedAlloc(size, alignment);
+}
+void* operator new[](size_t size, align_val_t alignment) {
+    return CountedAlignedAlloc(size, alignment);
+}
+void operator delete(void* p) noexcept {
+    free(p);
+}
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+void operator delete(void* p, align_val_t) noexcept {
+    AlignedFree(p);
+}
+void operator delete[](void* p, align_val_t) noexcept {
+    AlignedFree(p);
+}
+void operator delete(void* p, size_t, align_val_t) noexcept {
+    AlignedFree(p);
+}
+void operator delete[](void* p, size_t, align_val_t) noexcept {
+    AlignedFree(p);
+}
+
+namespace {
+
+struct Frame {
+    string_view name;
+    int width;
+    int height;
+};
+
+const Frame FRAMES[] = {
+    {"VGA"sv, 640, 480},
+    {"FullHD"sv, 1920, 1080},
+    {"4K"sv, 3840, 2160},
+};
+
+// Кодек под замером. Серые форматы получают одноканальное изображение
+struct Codec {
+    string_view name;
+    string_view extension;
+    // байт на пиксель в несжатом виде - основа расчёта MB/s
+    int pixel_size;
+    function<bool(const img_lib::Path&, const img_lib::Image&, const img_lib::GrayImage&)> save;
+    function<bool(const img_lib::Path&)> load;
+};
+
+vector<Codec> GetCodecs() {
+    using img_lib::GrayImage;
+    using img_lib::Image;
+    using img_lib::Path;
+    return {
+        {"jpeg"sv, ".jpg"sv, 3,
+         [](const Path& file, const Image& image, const GrayImage&) {
+             return img_lib::SaveJPEG(file, image);
+         },
+         [](const Path& file) {
+             return bool(img_lib::LoadJPEG(file));
+         }},
+        // распаковка без перевода в RGB: плоскости YCbCr и только яркость
+        {"jpgycc"sv, ".jpg"sv, 3,
+         [](const Path& file, const Image& image, const GrayImage&) {
+             return img_lib::SaveJPEG(file, image);
+         },
+         [](const Path& file) {
+             return bool(img_lib::LoadJPEGYCbCr(file));
+         }},
+        {"jpggray"sv, ".jpg"sv, 1,
+         [](const Path& file, const Image& image, const GrayImage&) {
+             return img_lib::SaveJPEG(file, image);
+         },
+         [](const Path& file) {
+             return bool(img_lib::LoadJPEGGray(file));
+         }},
+        {"ppm"sv, ".ppm"sv, 3,
+         [](const Path& file, const Image& image, const GrayImage&) {
+             return img_lib::SavePPM(file, image);
+         },
+         [](const Path& file) {
+             return bool(img_lib::LoadPPM(file));
+         }},
+        {"pgm"sv, ".pgm"sv, 1,
+         [](const Path& file, const Image&, const GrayImage& gray) {
+             return img_lib::SavePGM(file, gray);
+         },
+         [](const Path& file) {
+             return bool(img_lib::LoadPGM(file));
+         }},
+        {"bmp"sv, ".bmp"sv, 3,
+         [](const Path& file, const Image& image, const GrayImage&) {
+             return img_lib::SaveBMP(file, image);
+         },
+         [](const Path& file) {
+             return bool(img_lib::LoadBMP(file));
+         }},
+        {"bmp32"sv, ".bmp"sv, 4,
+         [](const Path& file, const Image& image, const GrayImage&) {
+             return img_lib::SaveBMP(file, image, img_lib::BMPPixelFormat::BGRA32);
+         },
+         [](const Path& file) {
+             return bool(img_lib::LoadBMP(file));
+         }},
+        {"png"sv, ".png"sv, 3,
+         [](const Path& file, const Image& image, const GrayImage&) {
+             return img_lib::SavePNG(file, image);
+         },
+         [](const Path& file) {
+             return bool(img_lib::LoadPNG(file));
+         }},
+        {"pngfast"sv, ".png"sv, 3,
+         [](const Path& file, const Image& image, const GrayImage&) {
+             img_lib::PNGSaveOptions options;
+             options.fast = true;
+             return img_lib::SavePNG(file, image, options);
+         },
+         [](const Path& file) {
+             return bool(img_lib::LoadPNG(file));
+         }},
+    };
+}
+
+// Пиковый объём резидентной памяти процесса в КиБ. На Linux пик можно
+// сбросить перед операцией и получить максимум именно за неё;
+// на прочих системах возвращается пик за всё время работы
+void ResetPeakRSS() {
+#if defined(__linux__)
+    ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+#endif
+}
+
+long GetPeakRSSKb() {
+#if defined(__linux__)
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return atol(line.c_str() + 6);
+        }
+    }
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#else
+    return 0;
+#endif
+}
+
+// Замер одной операции: лучшее время из нескольких повторов, а затем
+// отдельный прогон, в котором считаются выделения памяти и пик RSS
+struct Measurement {
+    double best_ms = -1;
+    uint64_t allocs = 0;
+    uint64_t alloc_bytes = 0;
+    long peak_rss_kb = 0;
+};
+
+Measurement Measure(const function<bool()>& operation, int repeats) {
+    Measurement result;
+    double best = numeric_limits<double>::max();
+    for (int r = 0; r < repeats; ++r) {
+        const auto start = chrono::steady_clock::now();
+        if (!operation()) {
+            return result;
+        }
+        best = min(best, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    }
+
+    ResetPeakRSS();
+    const uint64_t count_before = g_alloc_count.load();
+    const uint64_t bytes_before = g_alloc_bytes.load();
+    if (!operation()) {
+        return result;
+    }
+    result.allocs = g_alloc_count.load() - count_before;
+    result.alloc_bytes = g_alloc_bytes.load() - bytes_before;
+    result.peak_rss_kb = GetPeakRSSKb();
+    result.best_ms = best;
+    return result;
+}
+
+// Плавный градиент с шумом: не вырожден ни для JPEG, ни для RLE
+img_lib::Image MakeSynthetic(int w, int h) {
+    img_lib::Image image(w, h);
+    mt19937 rng(11);
+    uniform_int_distribution<int> noise(-24, 24);
+    const auto to_byte = [](int v) {
+        return std::byte(static_cast<uint8_t>(clamp(v, 0, 255)));
+    };
+    for (int y = 0; y < h; ++y) {
+        img_lib::Color* line = image.GetLine(y);
+        for (int x = 0; x < w; ++x) {
+            const int base = static_cast<int>(128 + 90 * sin(x * 0.007) * cos(y * 0.011));
+            line[x] = {to_byte(base + noise(rng)), to_byte(x * 255 / w + noise(rng)),
+                       to_byte(y * 255 / h + noise(rng)), std::byte{255}};
+        }
+    }
+    return image;
+}
+
+struct Result {
+    string_view codec;
+    const Frame* frame;
+    uintmax_t file_bytes;
+    double raw_megabytes;
+    Measurement save;
+    Measurement load;
+};
+
+double GetMBPerSecond(double megabytes, const Measurement& m) {
+    return m.best_ms > 0 ? megabytes / (m.best_ms / 1000) : 0;
+}
+
+void WriteMeasurementJSON(ostream& out, string_view name, double megabytes, const Measurement& m) {
+    out << "\"" << name << "\": {\"ms\": " << m.best_ms << ", \"mb_per_s\": " << GetMBPerSecond(megabytes, m)
+        << ", \"allocs\": " << m.allocs << ", \"alloc_bytes\": " << m.alloc_bytes
+        << ", \"peak_rss_kb\": " << m.peak_rss_kb << "}";
+}
+
+void WriteJSON(ostream& out, const vector<Result>& results, int repeats) {
+    out << fixed << setprecision(3);
+    out << "{\n  \"benchmark\": \"imglib_bench\",\n  \"repeats\": " << repeats << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        out << "    {\"codec\": \"" << r.codec << "\", \"frame\": \"" << r.frame->name
+            << "\", \"width\": " << r.frame->width << ", \"height\": " << r.frame->height
+            << ", \"file_bytes\": " << r.file_bytes << ",\n     ";
+        WriteMeasurementJSON(out, "save"sv, r.raw_megabytes, r.save);
+        out << ",\n     ";
+        WriteMeasurementJSON(out, "load"sv, r.raw_megabytes, r.load);
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+void PrintUsage(const char* program) {
+    cerr << "Usage: "sv << program << " [--json <file>] [--repeats <n>] [--dir <dir>]"sv << endl;
+}
+
+}  // namespace
+
+// Использование: imglib_bench [--json <файл>] [--repeats <n>] [--dir <каталог>]
+// Замеряет загрузку и сохранение каждого формата на синтетических
+// изображениях нескольких размеров. MB/s считается по несжатым пикселям
+// (байт на пиксель формата), а не по размеру файла. С --json результаты
+// дополнительно пишутся в файл ("-" - в стандартный вывод вместо таблицы)
+int main(int argc, const char** argv) {
+    img_lib::Path dir = filesystem::temp_directory_path();
+    string json_path;
+    int repeats = 3;
+
+    for (int i = 1; i < argc; ++i) {
+        const string_view arg = argv[i];
+        if (arg == "--json"sv && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (arg == "--repeats"sv && i + 1 < argc) {
+            repeats = atoi(argv[++i]);
+        } else if (arg == "--dir"sv && i + 1 < argc) {
+            dir = argv[++i];
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (repeats <= 0) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    const bool table = json_path != "-"sv;
+    const vector<Codec> codecs = GetCodecs();
+    vector<Result> results;
+
+    if (table) {
+        cout << fixed << setprecision(2);
+        cout << left << setw(8) << "codec"sv << setw(8) << "frame"sv << setw(12) << "file KB"sv
+             << setw(10) << "save ms"sv << setw(10) << "MB/s"sv << setw(8) << "allocs"sv
+             << setw(10) << "load ms"sv << setw(10) << "MB/s"sv << setw(8) << "allocs"sv
+             << "peak RSS KB"sv << endl;
+    }
+
+    for (const Frame& frame : FRAMES) {
+        const img_lib::Image image = MakeSynthetic(frame.width, frame.height);
+        const img_lib::GrayImage gray = img_lib::ImageToGray(image);
+
+        for (const Codec& codec : codecs) {
+            const img_lib::Path path = dir / ("imglib_bench_"s + string(codec.name) + string(codec.extension));
+            Result result{codec.name, &frame, 0,
+                          static_cast<double>(codec.pixel_size) * frame.width * frame.height / 1e6, {}, {}};
+
+            result.save = Measure([&] {
+                return codec.save(path, image, gray);
+            }, repeats);
+            result.load = Measure([&] {
+                return codec.load(path);
+            }, repeats);
+
+            error_code ec;
+            result.file_bytes = filesystem::file_size(path, ec);
+            filesystem::remove(path, ec);
+            if (result.save.best_ms < 0 || result.load.best_ms < 0) {
+                cerr << "Benchmark of "sv << codec.name << " failed in "sv << dir << endl;
+                return 1;
+            }
+
+            if (table) {
+                cout << left << setw(8) << codec.name << setw(8) << frame.name
+                     << setw(12) << result.file_bytes / 1024
+                     << setw(10) << result.save.best_ms << setw(10) << GetMBPerSecond(result.raw_megabytes, result.save)
+                     << setw(8) << result.save.allocs
+                     << setw(10) << result.load.best_ms << setw(10) << GetMBPerSecond(result.raw_megabytes, result.load)
+                     << setw(8) << result.load.allocs
+                     << max(result.save.peak_rss_kb, result.load.peak_rss_kb) << endl;
+            }
+            results.push_back(result);
+        }
+    }
+
+    if (json_path == "-"sv) {
+        WriteJSON(cout, results, repeats);
+    } else if (!json_path.empty()) {
+        ofstream out(json_path);
+        WriteJSON(out, results, repeats);
+        if (!out) {
+            cerr << "Cannot write "sv << json_path << endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
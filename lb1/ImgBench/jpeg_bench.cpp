@@ -0,0 +1,240 @@
+#include <bmp_image.h>
+#include <img_lib.h>
+#include <jpeg_image.h>
+#include <ppm_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct CorpusImage {
+    string name;
+    img_lib::Image image;
+};
+
+struct Setting {
+    string_view name;
+    img_lib::JPEGSaveOptions options;
+};
+
+const int REPEATS = 3;
+const int CORPUS_WIDTH = 1920;
+const int CORPUS_HEIGHT = 1080;
+
+img_lib::JPEGSaveOptions MakeOptions(int quality, img_lib::JPEGSubsampling subsampling,
+                                     bool optimize = false, bool progressive = false,
+                                     img_lib::JPEGDCTMethod dct = img_lib::JPEGDCTMethod::ISLOW) {
+    img_lib::JPEGSaveOptions options;
+    options.quality = quality;
+    options.subsampling = subsampling;
+    options.optimize_coding = optimize;
+    options.progressive = progressive;
+    options.dct_method = dct;
+    return options;
+}
+
+vector<Setting> GetSettings() {
+    using img_lib::JPEGDCTMethod;
+    using img_lib::JPEGSubsampling;
+    return {
+        {"q50-420"sv, MakeOptions(50, JPEGSubsampling::S420)},
+        {"q75-420"sv, MakeOptions(75, JPEGSubsampling::S420)},
+        {"q75-420-ifast"sv, MakeOptions(75, JPEGSubsampling::S420, false, false, JPEGDCTMethod::IFAST)},
+        {"q75-420-float"sv, MakeOptions(75, JPEGSubsampling::S420, false, false, JPEGDCTMethod::FLOAT)},
+        {"q75-420-opt"sv, MakeOptions(75, JPEGSubsampling::S420, true)},
+        {"q75-420-prog"sv, MakeOptions(75, JPEGSubsampling::S420, false, true)},
+        {"q75-422"sv, MakeOptions(75, JPEGSubsampling::S422)},
+        {"q90-420"sv, MakeOptions(90, JPEGSubsampling::S420)},
+        {"q90-444"sv, MakeOptions(90, JPEGSubsampling::S444)},
+        {"q95-444-opt-prog"sv, MakeOptions(95, JPEGSubsampling::S444, true, true)},
+    };
+}
+
+img_lib::Color MakeColor(int r, int g, int b) {
+    auto clamp_byte = [](int v) {
+        return std::byte(static_cast<uint8_t>(clamp(v, 0, 255)));
+    };
+    return {clamp_byte(r), clamp_byte(g), clamp_byte(b), std::byte{255}};
+}
+
+// Фиксированный синтетический набор: плавный градиент, геометрические
+// фигуры с резкими границами и шум - от лучшего случая для JPEG к худшему
+vector<CorpusImage> MakeSyntheticCorpus() {
+    const int w = CORPUS_WIDTH;
+    const int h = CORPUS_HEIGHT;
+    vector<CorpusImage> corpus;
+
+    img_lib::Image gradient(w, h, img_lib::Color::Black());
+    for (int y = 0; y < h; ++y) {
+        img_lib::Color* line = gradient.GetLine(y);
+        for (int x = 0; x < w; ++x) {
+            line[x] = MakeColor(x * 255 / w, y * 255 / h, (x + y) * 255 / (w + h));
+        }
+    }
+    corpus.push_back({"gradient", move(gradient)});
+
+    img_lib::Image shapes(w, h, img_lib::Color::Black());
+    for (int y = 0; y < h; ++y) {
+        img_lib::Color* line = shapes.GetLine(y);
+        for (int x = 0; x < w; ++x) {
+            const bool checker = ((x / 64) + (y / 64)) % 2 == 0;
+            const int dx = x - w / 2;
+            const int dy = y - h / 2;
+            const bool circle = dx * dx + dy * dy < (h / 3) * (h / 3);
+            line[x] = circle ? MakeColor(220, 40, 40) : checker ? MakeColor(30, 30, 160) : MakeColor(240, 240, 200);
+        }
+    }
+    corpus.push_back({"shapes", move(shapes)});
+
+    img_lib::Image noise(w, h, img_lib::Color::Black());
+    mt19937 rng(7);
+    uniform_int_distribution<int> dist(-40, 40);
+    for (int y = 0; y < h; ++y) {
+        img_lib::Color* line = noise.GetLine(y);
+        for (int x = 0; x < w; ++x) {
+            const int base = static_cast<int>(128 + 100 * sin(x * 0.01) * cos(y * 0.013));
+            line[x] = MakeColor(base + dist(rng), base + dist(rng), base + dist(rng));
+        }
+    }
+    corpus.push_back({"noise", move(noise)});
+
+    return corpus;
+}
+
+img_lib::Image LoadByExtension(const img_lib::Path& path) {
+    const string ext = path.extension().string();
+    if (ext == ".jpg"sv || ext == ".jpeg"sv) {
+        return img_lib::LoadJPEG(path);
+    }
+    if (ext == ".ppm"sv) {
+        return img_lib::LoadPPM(path);
+    }
+    if (ext == ".bmp"sv) {
+        return img_lib::LoadBMP(path);
+    }
+    return {};
+}
+
+// Сравнивает LoadJPEGRegion с соответствующей областью полной распаковки.
+// Края областей проходят и по границам MCU, и между ними: на границе
+// LibJPEG могла бы интерполировать цветоразностные каналы как у края изображения
+bool CheckRegions(const vector<CorpusImage>& corpus, const vector<Setting>& settings) {
+    size_t checked = 0;
+    for (const Setting& setting : settings) {
+        for (const CorpusImage& item : corpus) {
+            img_lib::Bytes encoded;
+            if (!img_lib::SaveJPEG(encoded, item.image, setting.options)) {
+                cerr << "Encoding failed"sv << endl;
+                return false;
+            }
+            const img_lib::ByteSpan data{encoded.data(), encoded.size()};
+
+            for (const int scale : {1, 2}) {
+                img_lib::JPEGLoadOptions options;
+                options.scale_denom = scale;
+                const img_lib::Image full = img_lib::LoadJPEG(data, options);
+                const int width = full.GetWidth();
+                const int height = full.GetHeight();
+
+                for (const int x : {0, 1, 3, 15, 16, 17, 31, 32, width - 33, width - 17}) {
+                    for (const int w : {1, 15, 16, 17, 32, 33}) {
+                        for (const int y : {0, 7, 16, height - 33}) {
+                            const int h = 17;
+                            if (x < 0 || y < 0 || x + w > width || y + h > height) {
+                                continue;
+                            }
+                            const img_lib::Image region = img_lib::LoadJPEGRegion(data, x, y, w, h, options);
+                            bool same = region.GetWidth() == w && region.GetHeight() == h;
+                            for (int row = 0; same && row < h; ++row) {
+                                same = memcmp(region.GetLine(row), full.GetLine(y + row) + x,
+                                              w * sizeof(img_lib::Color)) == 0;
+                            }
+                            if (!same) {
+                                cerr << "Region MISMATCH: "sv << setting.name << ' ' << item.name << " 1/"sv << scale
+                                     << " x="sv << x << " y="sv << y << " w="sv << w << " h="sv << h << endl;
+                                return false;
+                            }
+                            ++checked;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    cout << "Region check: "sv << checked << " regions match the full decode"sv << endl;
+    return true;
+}
+
+}  // namespace
+
+// Использование: jpeg_bench [image...]
+// Без аргументов используется синтетический набор изображений
+int main(int argc, const char** argv) {
+    vector<CorpusImage> corpus;
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) {
+            img_lib::Image image = LoadByExtension(argv[i]);
+            if (!image) {
+                cerr << "Cannot load "sv << argv[i] << endl;
+                return 1;
+            }
+            corpus.push_back({img_lib::Path(argv[i]).filename().string(), move(image)});
+        }
+    } else {
+        corpus = MakeSyntheticCorpus();
+    }
+
+    // Сжатие идёт в память, чтобы замер не зависел от диска
+    img_lib::Bytes encoded;
+    const vector<Setting> settings = GetSettings();
+
+    cout << fixed;
+    cout << left << setw(18) << "setting"sv << setw(14) << "image"sv
+         << setw(10) << "ms"sv << setw(12) << "bytes"sv << "bpp"sv << endl;
+
+    for (const Setting& setting : settings) {
+        double total_ms = 0;
+        uintmax_t total_bytes = 0;
+        double total_pixels = 0;
+
+        for (const CorpusImage& item : corpus) {
+            double best_ms = numeric_limits<double>::max();
+            for (int r = 0; r < REPEATS; ++r) {
+                const auto start = chrono::steady_clock::now();
+                if (!img_lib::SaveJPEG(encoded, item.image, setting.options)) {
+                    cerr << "Encoding failed"sv << endl;
+                    return 1;
+                }
+                best_ms = min(best_ms, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+            }
+
+            const uintmax_t bytes = encoded.size();
+            const double pixels = static_cast<double>(item.image.GetWidth()) * item.image.GetHeight();
+            total_ms += best_ms;
+            total_bytes += bytes;
+            total_pixels += pixels;
+
+            cout << left << setw(18) << setting.name << setw(14) << item.name
+                 << setw(10) << setprecision(2) << best_ms << setw(12) << bytes
+                 << setprecision(3) << bytes * 8 / pixels << endl;
+        }
+
+        cout << left << setw(18) << setting.name << setw(14) << "TOTAL"sv
+             << setw(10) << setprecision(2) << total_ms << setw(12) << total_bytes
+             << setprecision(3) << total_bytes * 8 / total_pixels << endl;
+    }
+
+    return CheckRegions(corpus, settings) ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include <img_lib.h>
+#include <pixel_pack.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct Frame {
+    string_view name;
+    int width;
+    int height;
+};
+
+const Frame FRAMES[] = {
+    {"4K"sv, 3840, 2160},
+    {"8K"sv, 7680, 4320},
+};
+
+const int REPEATS = 7;
+
+// строки обрабатываются по одной, как это делают кодеки
+double MeasureMs(const function<void(int)>& row_op, int height) {
+    double best = numeric_limits<double>::max();
+    for (int r = 0; r < REPEATS; ++r) {
+        const auto start = chrono::steady_clock::now();
+        for (int y = 0; y < height; ++y) {
+            row_op(y);
+        }
+        const chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count());
+    }
+    return best;
+}
+
+vector<img_lib::PackKernel> GetSupportedKernels() {
+    vector<img_lib::PackKernel> result;
+    for (auto kernel : {img_lib::PackKernel::SCALAR, img_lib::PackKernel::SSSE3, img_lib::PackKernel::AVX2}) {
+        img_lib::SetPackKernel(kernel);
+        if (img_lib::GetPackKernel() == kernel) {
+            result.push_back(kernel);
+        }
+    }
+    return result;
+}
+
+}  // namespace
+
+int main() {
+    const vector<img_lib::PackKernel> kernels = GetSupportedKernels();
+
+    cout << fixed << setprecision(2);
+    cout << "frame  op          kernel   ms       GB/s    speedup"sv << endl;
+
+    for (const Frame& frame : FRAMES) {
+        const int w = frame.width;
+        const int h = frame.height;
+
+        img_lib::Image image(w, h, img_lib::Color::Black());
+        mt19937 rng(42);
+        for (int y = 0; y < h; ++y) {
+            img_lib::Color* line = image.GetLine(y);
+            for (int x = 0; x < w; ++x) {
+                const uint32_t v = rng();
+                memcpy(&line[x], &v, sizeof(v));
+            }
+        }
+
+        vector<std::byte> packed(static_cast<size_t>(w) * h * 3);
+        vector<std::byte> reference(packed.size());
+        img_lib::Image unpacked(w, h, img_lib::Color::Black());
+
+        struct Op {
+            string_view name;
+            function<void(int)> row_op;
+            bool packs;
+        };
+        const Op ops[] = {
+            {"PackRGB"sv, [&](int y) { img_lib::PackRGB(image.GetLine(y), packed.data() + size_t(y) * w * 3, w); }, true},
+            {"PackBGR"sv, [&](int y) { img_lib::PackBGR(image.GetLine(y), packed.data() + size_t(y) * w * 3, w); }, true},
+            {"UnpackRGB"sv, [&](int y) { img_lib::UnpackRGB(packed.data() + size_t(y) * w * 3, unpacked.GetLine(y), w); }, false},
+            {"UnpackBGR"sv, [&](int y) { img_lib::UnpackBGR(packed.data() + size_t(y) * w * 3, unpacked.GetLine(y), w); }, false},
+        };
+
+        for (const Op& op : ops) {
+            double scalar_ms = 0;
+            for (img_lib::PackKernel kernel : kernels) {
+                img_lib::SetPackKernel(kernel);
+                const double ms = MeasureMs(op.row_op, h);
+
+                // результат каждого ядра сверяется со скалярным
+                bool valid = true;
+                if (kernel == img_lib::PackKernel::SCALAR) {
+                    scalar_ms = ms;
+                    if (op.packs) {
+                        reference = packed;
+                    }
+                } else if (op.packs) {
+                    valid = packed == reference;
+                } else {
+                    for (int y = 0; y < h && valid; ++y) {
+                        const img_lib::Color* line = unpacked.GetLine(y);
+                        const std::byte* src = packed.data() + size_t(y) * w * 3;
+                        for (int x = 0; x < w; ++x) {
+                            const bool bgr = op.name == "UnpackBGR"sv;
+                            const std::byte r = src[x * 3 + (bgr ? 2 : 0)];
+                            const std::byte b = src[x * 3 + (bgr ? 0 : 2)];
+                            if (line[x].r != r || line[x].g != src[x * 3 + 1]
+                                || line[x].b != b || line[x].a != std::byte{255}) {
+                                valid = false;
+                                break;
+                            }
+                        }
+                    }
+                }
+
+                // учитываются и прочитанные, и записанные байты
+                const double bytes = static_cast<double>(w) * h * (4 + 3);
+                cout << left << setw(7) << frame.name << setw(12) << op.name
+                     << setw(9) << img_lib::GetPackKernelName(kernel)
+                     << setw(9) << ms << setw(8) << bytes / ms / 1e6
+                     << scalar_ms / ms << "x"sv << (valid ? ""sv : "  MISMATCH"sv) << endl;
+
+                if (!valid) {
+                    return 1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include <bmp_image.h>
+#include <img_lib.h>
+#include <ppm_image.h>
+#include <thread_pool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct Frame {
+    string_view name;
+    int width;
+    int height;
+};
+
+const Frame FRAMES[] = {
+    {"4K"sv, 3840, 2160},
+    {"8K"sv, 7680, 4320},
+    {"16K"sv, 15360, 8640},
+};
+
+const int REPEATS = 3;
+
+double MeasureMs(const function<bool()>& save) {
+    double best = numeric_limits<double>::max();
+    for (int r = 0; r < REPEATS; ++r) {
+        const auto start = chrono::steady_clock::now();
+        if (!save()) {
+            return -1;
+        }
+        const chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count());
+    }
+    return best;
+}
+
+bool SameFiles(const img_lib::Path& a, const img_lib::Path& b) {
+    ifstream fa(a, ios::binary);
+    ifstream fb(b, ios::binary);
+    return equal(istreambuf_iterator<char>(fa), istreambuf_iterator<char>(),
+                 istreambuf_iterator<char>(fb), istreambuf_iterator<char>());
+}
+
+img_lib::Image MakeNoise(int w, int h) {
+    img_lib::Image image(w, h, img_lib::Color::Black());
+    mt19937 rng(42);
+    for (int y = 0; y < h; ++y) {
+        img_lib::Color* line = image.GetLine(y);
+        for (int x = 0; x < w; ++x) {
+            const uint32_t v = rng();
+            memcpy(&line[x], &v, sizeof(v));
+        }
+    }
+    return image;
+}
+
+}  // namespace
+
+// Использование: save_bench [каталог]
+// Файлы пишутся в заданный каталог (по умолчанию временный), чтобы
+// можно было замерить нужный диск
+int main(int argc, const char** argv) {
+    const img_lib::Path dir = argc > 1 ? img_lib::Path(argv[1]) : filesystem::temp_directory_path();
+    const img_lib::Path serial_path = dir / "save_bench_serial.tmp";
+    const img_lib::Path parallel_path = dir / "save_bench_parallel.tmp";
+
+    using img_lib::BMPPixelFormat;
+    struct Codec {
+        string_view name;
+        function<bool(const img_lib::Path&, const img_lib::Image&)> serial;
+        function<bool(const img_lib::Path&, const img_lib::Image&, img_lib::ThreadPool&)> parallel;
+        // байт на пиксель в файле, для расчёта пропускной способности
+        int pixel_size;
+    };
+    const Codec codecs[] = {
+        {"BMP"sv,
+         [](const img_lib::Path& file, const img_lib::Image& image) {
+             return img_lib::SaveBMP(file, image);
+         },
+         [](const img_lib::Path& file, const img_lib::Image& image, img_lib::ThreadPool& pool) {
+             return img_lib::SaveBMPParallel(file, image, pool);
+         },
+         3},
+        {"BMP32"sv,
+         [](const img_lib::Path& file, const img_lib::Image& image) {
+             return img_lib::SaveBMP(file, image, BMPPixelFormat::BGRA32);
+         },
+         [](const img_lib::Path& file, const img_lib::Image& image, img_lib::ThreadPool& pool) {
+             return img_lib::SaveBMPParallel(file, image, pool, BMPPixelFormat::BGRA32);
+         },
+         4},
+        {"PPM"sv,
+         [](const img_lib::Path& file, const img_lib::Image& image) {
+             return img_lib::SavePPM(file, image);
+         },
+         [](const img_lib::Path& file, const img_lib::Image& image, img_lib::ThreadPool& pool) {
+             return img_lib::SavePPMParallel(file, image, pool);
+         },
+         3},
+    };
+
+    img_lib::ThreadPool& pool = img_lib::GetWriterThreadPool();
+
+    cout << fixed << setprecision(2);
+    cout << "Parallel writer uses "sv << pool.GetThreadCount() << " threads"sv << endl;
+    cout << "frame  codec  serial ms  MB/s      parallel ms  MB/s      speedup"sv << endl;
+
+    bool ok = true;
+    for (const Frame& frame : FRAMES) {
+        const img_lib::Image image = MakeNoise(frame.width, frame.height);
+        for (const Codec& codec : codecs) {
+            const double megabytes = static_cast<double>(codec.pixel_size) * frame.width * frame.height / 1e6;
+            const double serial_ms = MeasureMs([&] {
+                return codec.serial(serial_path, image);
+            });
+            const double parallel_ms = MeasureMs([&] {
+                return codec.parallel(parallel_path, image, pool);
+            });
+            if (serial_ms < 0 || parallel_ms < 0) {
+                cerr << "Saving to "sv << dir << " failed"sv << endl;
+                return 1;
+            }
+
+            const bool same = SameFiles(serial_path, parallel_path);
+            ok = ok && same;
+
+            cout << left << setw(7) << frame.name << setw(7) << codec.name
+                 << setw(11) << serial_ms << setw(10) << megabytes / serial_ms * 1000
+                 << setw(13) << parallel_ms << setw(10) << megabytes / parallel_ms * 1000
+                 << serial_ms / parallel_ms << 'x' << (same ? ""sv : "  MISMATCH"sv) << endl;
+        }
+    }
+
+    filesystem::remove(serial_path);
+    filesystem::remove(parallel_path);
+    return ok ? 0 : 1;
+}
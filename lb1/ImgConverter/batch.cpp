@@ -0,0 +1,227 @@
+#include "batch.h"
+#include "conversion_cache.h"
+#include "pipeline.h"
+
+#include <image_pool.h>
+#include <thread_pool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct FileResult {
+    img_lib::Path in_path;
+    img_lib::Path out_path;
+    ConvertStatus status = ConvertStatus::OK;
+    uintmax_t in_bytes = 0;
+    uintmax_t out_bytes = 0;
+    double ms = 0;
+};
+
+uintmax_t GetFileSize(const img_lib::Path& path) {
+    error_code ec;
+    const uintmax_t size = filesystem::file_size(path, ec);
+    return ec ? 0 : size;
+}
+
+// Собирает список входных файлов: из каталога берутся все файлы
+// известных форматов, из манифеста - непустые строки, кроме комментариев
+bool CollectInputs(const img_lib::Path& input, vector<img_lib::Path>& result, ostream& out) {
+    error_code ec;
+    if (filesystem::is_directory(input, ec)) {
+        for (const auto& entry : filesystem::directory_iterator(input, ec)) {
+            // формат определяется по сигнатуре файла, расширение не важно
+            if (entry.is_regular_file(ec) && GetFormatByContent(entry.path()) != Format::UNKNOWN) {
+                result.push_back(entry.path());
+            }
+        }
+        sort(result.begin(), result.end());
+        return !ec;
+    }
+
+    ifstream manifest(input);
+    if (!manifest) {
+        out << "Cannot open batch input "sv << input << endl;
+        return false;
+    }
+
+    string line;
+    while (getline(manifest, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line.front() == '#') {
+            continue;
+        }
+        result.emplace_back(line);
+    }
+    return true;
+}
+
+}  // namespace
+
+bool RunBatch(const BatchOptions& options, ostream& out) {
+    const string extension = "."s + options.format;
+    if (!GetFormatInterface(img_lib::Path("out"s + extension))) {
+        out << "Unknown output format "sv << options.format << endl;
+        return false;
+    }
+
+    vector<img_lib::Path> inputs;
+    if (!CollectInputs(options.input, inputs, out)) {
+        return false;
+    }
+
+    error_code ec;
+    filesystem::create_directories(options.output_dir, ec);
+    if (ec) {
+        out << "Cannot create output directory "sv << options.output_dir << endl;
+        return false;
+    }
+
+    vector<FileResult> results(inputs.size());
+    set<img_lib::Path> used_outputs;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        results[i].in_path = inputs[i];
+        results[i].out_path = options.output_dir / inputs[i].filename().replace_extension(extension);
+    }
+
+    size_t jobs = options.jobs > 0 ? options.jobs : img_lib::ThreadPool::GetDefaultThreadCount();
+    jobs = min(jobs, max<size_t>(inputs.size(), 1));
+    const auto start = chrono::steady_clock::now();
+
+    mutex out_mutex;
+    size_t failed = 0;
+
+    // Файлы с одинаковыми именами перезаписали бы друг друга - такие пропускаются
+    vector<ConvertJob> jobs_list;
+    vector<size_t> job_results;
+    for (FileResult& result : results) {
+        if (!used_outputs.insert(result.out_path).second) {
+            result.status = ConvertStatus::SAVING_FAILED;
+            out << "[FAIL] "sv << result.in_path.string() << ": duplicate output name "sv
+                << result.out_path.string() << endl;
+            ++failed;
+            continue;
+        }
+        jobs_list.push_back({result.in_path, result.out_path});
+        job_results.push_back(static_cast<size_t>(&result - results.data()));
+    }
+
+    // Каждый конвейер берёт следующий файл из общего списка
+    mutex next_mutex;
+    size_t next = 0;
+    const NextJob next_job = [&next_mutex, &next, &jobs_list](size_t& index) {
+        lock_guard lock(next_mutex);
+        if (next >= jobs_list.size()) {
+            return false;
+        }
+        index = next++;
+        return true;
+    };
+
+    const JobDone job_done = [&](size_t index, ConvertStatus status, double ms, bool from_cache) {
+        FileResult& result = results[job_results[index]];
+        result.status = status;
+        result.ms = ms;
+        result.in_bytes = GetFileSize(result.in_path);
+        if (result.status == ConvertStatus::OK) {
+            result.out_bytes = GetFileSize(result.out_path);
+        }
+
+        lock_guard lock(out_mutex);
+        if (result.status == ConvertStatus::OK) {
+            out << "[ OK ] "sv << result.in_path.string() << " -> "sv << result.out_path.string()
+                << " ("sv << fixed << setprecision(1) << result.ms << " ms"sv
+                << (from_cache ? ", cached)"sv : ")"sv) << endl;
+        } else {
+            out << "[FAIL] "sv << result.in_path.string() << ": "sv
+                << GetStatusMessage(result.status) << endl;
+            ++failed;
+        }
+    };
+
+    // Буферы изображений возвращаются в общий пул и достаются следующим файлам
+    img_lib::ImagePool image_pool;
+    PipelineOptions pipeline;
+    pipeline.image_pool = &image_pool;
+
+    // Один кэш на все конвейеры: повторы файлов в пакете тоже берутся из кэша
+    unique_ptr<ConversionCache> cache;
+    if (!options.cache_dir.empty()) {
+        cache = make_unique<ConversionCache>(options.cache_dir, CacheOptions{options.cache_bytes});
+        if (!*cache) {
+            out << "Cannot open cache directory "sv << options.cache_dir << endl;
+            return false;
+        }
+        pipeline.cache = cache.get();
+    }
+
+    // Следующие файлы читаются с диска, пока конвейеры декодируют текущие
+    unique_ptr<img_lib::PrefetchReader> prefetch;
+    if (options.prefetch_files > 0) {
+        vector<img_lib::Path> in_paths;
+        in_paths.reserve(jobs_list.size());
+        for (const ConvertJob& job : jobs_list) {
+            in_paths.push_back(job.in_path);
+        }
+        img_lib::PrefetchOptions prefetch_options;
+        prefetch_options.max_files_ahead = options.prefetch_files;
+        prefetch_options.max_bytes_in_flight = options.prefetch_bytes;
+        prefetch = make_unique<img_lib::PrefetchReader>(move(in_paths), prefetch_options);
+        pipeline.prefetch = prefetch.get();
+    }
+    {
+        img_lib::ThreadPool pool(jobs);
+        vector<future<void>> pending;
+        pending.reserve(jobs);
+
+        for (size_t i = 0; i < jobs; ++i) {
+            pending.push_back(pool.Submit([&] {
+                RunConvertPipeline(jobs_list, next_job, options.convert, job_done, pipeline);
+            }));
+        }
+
+        for (future<void>& task : pending) {
+            task.get();
+        }
+    }
+
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    size_t converted = 0;
+    uintmax_t in_bytes = 0;
+    uintmax_t out_bytes = 0;
+    for (const FileResult& result : results) {
+        if (result.status == ConvertStatus::OK) {
+            ++converted;
+            in_bytes += result.in_bytes;
+            out_bytes += result.out_bytes;
+        }
+    }
+
+    const double elapsed = max(seconds, 1e-9);
+    out << "Converted "sv << converted << " of "sv << results.size() << " files ("sv << failed
+        << " failed) in "sv << fixed << setprecision(3) << seconds << " s using "sv << jobs << " pipelines: "sv
+        << setprecision(1) << converted / elapsed << " images/s, "sv
+        << setprecision(2) << in_bytes / elapsed / 1e6 << " MB/s read, "sv
+        << out_bytes / elapsed / 1e6 << " MB/s written"sv << endl;
+    if (cache) {
+        PrintCacheStats(cache->GetStats(), out);
+    }
+
+    return failed == 0;
+}
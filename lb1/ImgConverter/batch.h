@@ -0,0 +1,35 @@
+#pragma once
+
+#include "converter.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+// Параметры пакетной конвертации
+struct BatchOptions {
+    // файл-манифест (по одному пути на строку) или каталог с изображениями
+    img_lib::Path input;
+    img_lib::Path output_dir;
+    // расширение выходного формата без точки: jpg, ppm, bmp
+    std::string format;
+    // число конвейеров конвертации, каждый из которых занимает поток
+    // декодирования и поток кодирования; 0 - по числу ядер
+    size_t jobs = 0;
+    // сколько входных файлов читается в память заранее; 0 - без упреждающего
+    // чтения, файлы читаются с диска при декодировании
+    size_t prefetch_files = 8;
+    // предел памяти под заранее прочитанные файлы
+    size_t prefetch_bytes = size_t{256} << 20;
+    // каталог кэша результатов; пустой путь - без кэша
+    img_lib::Path cache_dir;
+    // предел размера кэша
+    std::uint64_t cache_bytes = std::uint64_t{1} << 30;
+    ConvertOptions convert;
+};
+
+// Конвертирует все файлы пакета на пуле потоков, печатает в out
+// статус каждого файла и итоговую пропускную способность.
+// Возвращает true, если все файлы сконвертированы успешно
+bool RunBatch(const BatchOptions& options, std::ostream& out);
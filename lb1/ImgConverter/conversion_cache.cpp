@@ -0,0 +1,329 @@
+#include "conversion_cache.h"
+
+#include <content_hash.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <unistd.h>
+#elif defined(_WIN32)
+    #include <process.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// меняется вместе с кодерами, чтобы записи старых версий не выдавались
+constexpr string_view CACHE_VERSION = "imgconv-cache-1"sv;
+constexpr string_view TEMP_EXTENSION = ".tmp"sv;
+
+// Метка каталога кэша по соглашению CACHEDIR.TAG: по ней кэш узнаёт свой
+// каталог, а программы резервного копирования его пропускают
+constexpr string_view TAG_FILE_NAME = "CACHEDIR.TAG"sv;
+constexpr string_view TAG_SIGNATURE = "Signature: 8a477f597d28d172789f06886806bc55"sv;
+
+bool HasCacheTag(const img_lib::Path& dir) {
+    ifstream tag(dir / TAG_FILE_NAME, ios::binary);
+    string signature(TAG_SIGNATURE.size(), '\0');
+    return tag.read(signature.data(), signature.size()) && signature == TAG_SIGNATURE;
+}
+
+bool WriteCacheTag(const img_lib::Path& dir) {
+    ofstream tag(dir / TAG_FILE_NAME, ios::binary);
+    tag << TAG_SIGNATURE << "\n# This file is a cache directory tag created by imgconv.\n"sv;
+    return static_cast<bool>(tag);
+}
+
+bool IsHexField(string_view field, size_t min_size, size_t max_size) {
+    return field.size() >= min_size && field.size() <= max_size
+        && all_of(field.begin(), field.end(), [](char c) {
+               return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+           });
+}
+
+// true, если name имеет вид CacheKey::GetName(); прочие файлы каталога
+// кэш не трогает
+bool IsKeyName(string_view name) {
+    const size_t first = name.find('-');
+    const size_t second = first == string_view::npos ? first : name.find('-', first + 1);
+    if (second == string_view::npos) {
+        return false;
+    }
+    return IsHexField(name.substr(0, first), 16, 16)
+        && IsHexField(name.substr(first + 1, second - first - 1), 1, 16)
+        && IsHexField(name.substr(second + 1), 16, 16);
+}
+
+// временный файл записи: <ключ>.<процесс>-<поток>.tmp
+bool IsTempName(const img_lib::Path& path) {
+    return path.extension() == TEMP_EXTENSION && IsKeyName(path.stem().stem().string());
+}
+
+unsigned long long GetProcessId() {
+#if defined(__unix__) || defined(__APPLE__)
+    return static_cast<unsigned long long>(getpid());
+#elif defined(_WIN32)
+    return static_cast<unsigned long long>(_getpid());
+#else
+    return 0;
+#endif
+}
+
+// параметры добавляются к хешу по одному полю: байты структур
+// включали бы выравнивание с неопределённым содержимым
+template <typename T>
+void AddValue(img_lib::Hasher64& hasher, T value) {
+    const int32_t field = static_cast<int32_t>(value);
+    hasher.Update(&field, sizeof(field));
+}
+
+void AddOptions(img_lib::Hasher64& hasher, const img_lib::JPEGSaveOptions& options) {
+    AddValue(hasher, options.quality);
+    AddValue(hasher, options.subsampling);
+    AddValue(hasher, options.optimize_coding);
+    AddValue(hasher, options.progressive);
+    AddValue(hasher, options.dct_method);
+}
+
+void AddOptions(img_lib::Hasher64& hasher, const img_lib::PNGSaveOptions& options) {
+    AddValue(hasher, options.level);
+    AddValue(hasher, options.filter);
+    AddValue(hasher, options.strategy);
+    AddValue(hasher, options.format);
+    AddValue(hasher, options.fast);
+}
+
+}  // namespace
+
+string CacheKey::GetName() const {
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx-%llx-%016llx", static_cast<unsigned long long>(content_hash),
+             static_cast<unsigned long long>(content_size), static_cast<unsigned long long>(options_hash));
+    return name;
+}
+
+CacheKey MakeCacheKey(img_lib::ByteSpan input, Format output, const ConvertOptions& options) {
+    CacheKey key;
+    key.content_hash = img_lib::Hash64(input);
+    key.content_size = input.size;
+
+    img_lib::Hasher64 hasher;
+    hasher.Update(CACHE_VERSION.data(), CACHE_VERSION.size());
+    AddValue(hasher, output);
+    // параметры других кодеров на результат не влияют
+    switch (output) {
+        case Format::JPEG:
+            AddOptions(hasher, options.jpeg);
+            break;
+        case Format::PNG:
+            AddOptions(hasher, options.png);
+            break;
+        default:
+            break;
+    }
+    key.options_hash = hasher.GetHash();
+    return key;
+}
+
+ConversionCache::ConversionCache(const img_lib::Path& dir, const CacheOptions& options)
+    : dir_(dir)
+    , options_(options) {
+    error_code ec;
+    filesystem::create_directories(dir_, ec);
+    if (ec) {
+        return;
+    }
+
+    // Чужой каталог не используется: вытеснение удаляло бы файлы пользователя.
+    // Метка ставится только в пустой каталог
+    if (!HasCacheTag(dir_)) {
+        if (!filesystem::is_empty(dir_, ec) || ec || !WriteCacheTag(dir_)) {
+            return;
+        }
+    }
+
+    vector<pair<filesystem::file_time_type, Entry>> found;
+    for (const auto& item : filesystem::directory_iterator(dir_, ec)) {
+        error_code item_ec;
+        if (!item.is_regular_file(item_ec)) {
+            continue;
+        }
+        const img_lib::Path& path = item.path();
+        // Недописанный файл может принадлежать и работающему процессу;
+        // тогда его переименование не удастся и запись просто не сохранится
+        if (IsTempName(path)) {
+            filesystem::remove(path, item_ec);
+            continue;
+        }
+        if (!IsKeyName(path.stem().string())) {
+            continue;
+        }
+        const uintmax_t size = item.file_size(item_ec);
+        const auto time = item.last_write_time(item_ec);
+        if (!item_ec) {
+            found.push_back({time, Entry{path.stem().string(), path.filename().string(), size}});
+        }
+    }
+    if (ec) {
+        return;
+    }
+
+    // записи вставляются в начало очереди, поэтому идут от давних к свежим
+    sort(found.begin(), found.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first < rhs.first;
+    });
+    lock_guard lock(mutex_);
+    for (auto& [time, entry] : found) {
+        if (index_.count(entry.name) == 0) {
+            Insert(move(entry));
+        }
+    }
+    // предел мог уменьшиться с прошлого запуска
+    EvictLocked(options_.max_bytes);
+    stats_.evictions = 0;
+    ok_ = true;
+}
+
+bool ConversionCache::Fetch(const CacheKey& key, const img_lib::Path& out_path) {
+    if (!ok_) {
+        return false;
+    }
+
+    const string name = key.GetName();
+    img_lib::Path path;
+    uint64_t size = 0;
+    {
+        lock_guard lock(mutex_);
+        const auto it = index_.find(name);
+        if (it == index_.end()) {
+            ++stats_.misses;
+            return false;
+        }
+        lru_.splice(lru_.begin(), lru_, it->second);
+        path = dir_ / it->second->file_name;
+        size = it->second->size;
+    }
+
+    // Копирование идёт без блокировки. Если запись тем временем вытеснят,
+    // открытый файл под POSIX останется доступным до конца копирования
+    error_code ec;
+    filesystem::copy_file(path, out_path, filesystem::copy_options::overwrite_existing, ec);
+    if (ec) {
+        // файл записи удалили вне кэша - запись забывается
+        lock_guard lock(mutex_);
+        const auto it = index_.find(name);
+        if (it != index_.end() && !filesystem::exists(path)) {
+            size_bytes_ -= it->second->size;
+            lru_.erase(it->second);
+            index_.erase(it);
+        }
+        ++stats_.misses;
+        return false;
+    }
+    // время изменения задаёт порядок вытеснения после перезапуска
+    filesystem::last_write_time(path, filesystem::file_time_type::clock::now(), ec);
+
+    lock_guard lock(mutex_);
+    ++stats_.hits;
+    stats_.bytes_served += size;
+    return true;
+}
+
+void ConversionCache::Store(const CacheKey& key, const img_lib::Path& out_path) {
+    if (!ok_) {
+        return;
+    }
+
+    error_code ec;
+    const uintmax_t size = filesystem::file_size(out_path, ec);
+    if (ec || size > options_.max_bytes) {
+        return;
+    }
+
+    const string name = key.GetName();
+    {
+        lock_guard lock(mutex_);
+        if (index_.count(name) != 0) {
+            return;
+        }
+    }
+
+    // Запись копируется во временный файл процесса и потока и появляется
+    // в кэше переименованием, поэтому недописанную запись никто не прочитает,
+    // а процессы с общим каталогом не пишут в один временный файл
+    const string file_name = name + out_path.extension().string();
+    const img_lib::Path temp_path = dir_ / (name + '.' + to_string(GetProcessId()) + '-'
+                                            + to_string(hash<thread::id>{}(this_thread::get_id()))
+                                            + string(TEMP_EXTENSION));
+    filesystem::copy_file(out_path, temp_path, filesystem::copy_options::overwrite_existing, ec);
+    if (ec) {
+        filesystem::remove(temp_path, ec);
+        return;
+    }
+
+    lock_guard lock(mutex_);
+    // тот же результат мог сохранить другой конвейер
+    if (index_.count(name) == 0) {
+        filesystem::rename(temp_path, dir_ / file_name, ec);
+    }
+    if (ec || index_.count(name) != 0) {
+        filesystem::remove(temp_path, ec);
+        return;
+    }
+
+    Insert(Entry{name, file_name, size});
+    ++stats_.stores;
+    stats_.bytes_stored += size;
+    EvictLocked(options_.max_bytes);
+}
+
+CacheStats ConversionCache::GetStats() const {
+    lock_guard lock(mutex_);
+    CacheStats result = stats_;
+    result.entries = lru_.size();
+    result.size_bytes = size_bytes_;
+    result.max_bytes = options_.max_bytes;
+    return result;
+}
+
+void ConversionCache::Insert(Entry entry) {
+    size_bytes_ += entry.size;
+    lru_.push_front(move(entry));
+    index_[lru_.front().name] = lru_.begin();
+}
+
+void ConversionCache::EvictLocked(uint64_t max_bytes) {
+    while (size_bytes_ > max_bytes && !lru_.empty()) {
+        const Entry& oldest = lru_.back();
+        error_code ec;
+        filesystem::remove(dir_ / oldest.file_name, ec);
+        size_bytes_ -= oldest.size;
+        index_.erase(oldest.name);
+        lru_.pop_back();
+        ++stats_.evictions;
+    }
+}
+
+void PrintCacheStats(const CacheStats& stats, ostream& out) {
+    const size_t lookups = stats.hits + stats.misses;
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    out << "Cache: "sv << stats.hits << " hits, "sv << stats.misses << " misses ("sv << fixed << setprecision(1)
+        << (lookups > 0 ? 100.0 * stats.hits / lookups : 0.0) << "% hit rate), "sv
+        << stats.stores << " stored, "sv << stats.evictions << " evicted; "sv << setprecision(2)
+        << stats.bytes_served / 1e6 << " MB served, "sv << stats.bytes_stored / 1e6 << " MB stored; size "sv
+        << stats.size_bytes / 1e6 << " of "sv << stats.max_bytes / 1e6 << " MB in "sv
+        << stats.entries << " entries"sv << endl;
+    out.flags(flags);
+    out.precision(precision);
+}
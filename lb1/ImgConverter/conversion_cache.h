@@ -0,0 +1,108 @@
+#pragma once
+
+#include "converter.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Ключ записи кэша: содержимое входного файла и всё, от чего зависит результат
+struct CacheKey {
+    // XXH64 и размер входных байт
+    std::uint64_t content_hash = 0;
+    std::uint64_t content_size = 0;
+    // XXH64 выходного формата и параметров его кодера
+    std::uint64_t options_hash = 0;
+
+    // имя файла записи без расширения
+    std::string GetName() const;
+};
+
+// Ключ для данных входного файла и выходного формата с параметрами
+CacheKey MakeCacheKey(img_lib::ByteSpan input, Format output, const ConvertOptions& options);
+
+struct CacheOptions {
+    // предел суммарного размера записей; самые давние удаляются первыми
+    std::uint64_t max_bytes = std::uint64_t{1} << 30;
+};
+
+struct CacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t stores = 0;
+    size_t evictions = 0;
+    // сколько байт выдано из кэша и записано в него
+    std::uint64_t bytes_served = 0;
+    std::uint64_t bytes_stored = 0;
+    // текущее состояние
+    size_t entries = 0;
+    std::uint64_t size_bytes = 0;
+    std::uint64_t max_bytes = 0;
+};
+
+// Кэш сконвертированных файлов на диске с адресацией по содержимому.
+// Каждая запись - готовый выходной файл с именем по ключу. Каталог кэша
+// помечается файлом CACHEDIR.TAG; непустой каталог без метки не
+// используется, а файлы с именами не по ключу кэш не читает и не удаляет. Порядок
+// вытеснения (LRU) восстанавливается при открытии по времени изменения
+// файлов, а попадание обновляет это время, поэтому кэш переживает
+// перезапуск. Методы безопасны для вызова из нескольких потоков
+class ConversionCache {
+public:
+    // создаёт и помечает каталог при необходимости и читает существующие
+    // записи; недописанные временные файлы прошлых запусков удаляются
+    ConversionCache(const img_lib::Path& dir, const CacheOptions& options = {});
+
+    ConversionCache(const ConversionCache&) = delete;
+    ConversionCache& operator=(const ConversionCache&) = delete;
+
+    // false, если каталог кэша не удалось создать или прочитать
+    // либо он не пуст и не помечен как каталог кэша
+    explicit operator bool() const {
+        return ok_;
+    }
+
+    bool operator!() const {
+        return !operator bool();
+    }
+
+    // копирует запись в out_path; false - промах
+    bool Fetch(const CacheKey& key, const img_lib::Path& out_path);
+
+    // копирует сконвертированный файл в кэш и вытесняет давние записи
+    // сверх предела. файл больше предела не сохраняется
+    void Store(const CacheKey& key, const img_lib::Path& out_path);
+
+    CacheStats GetStats() const;
+
+private:
+    struct Entry {
+        std::string name;
+        // имя файла записи: имя ключа и расширение выходного файла
+        std::string file_name;
+        std::uint64_t size = 0;
+    };
+    using EntryList = std::list<Entry>;
+
+    // добавляет запись в начало очереди; вызывается под mutex_
+    void Insert(Entry entry);
+    void EvictLocked(std::uint64_t max_bytes);
+
+    const img_lib::Path dir_;
+    const CacheOptions options_;
+    bool ok_ = false;
+
+    mutable std::mutex mutex_;
+    // в начале - недавно использованные записи
+    EntryList lru_;
+    std::unordered_map<std::string, EntryList::iterator> index_;
+    std::uint64_t size_bytes_ = 0;
+    CacheStats stats_;
+};
+
+// печатает одну строку сводки: попадания, промахи, объёмы и заполненность
+void PrintCacheStats(const CacheStats& stats, std::ostream& out);
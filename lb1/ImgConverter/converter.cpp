@@ -0,0 +1,38 @@
+#include "converter.h"
+#include "pipeline.h"
+
+#include <image_pool.h>
+
+using namespace std;
+
+string_view GetStatusMessage(ConvertStatus status) {
+    switch (status) {
+        case ConvertStatus::OK:
+            return "Successfully converted"sv;
+        case ConvertStatus::UNKNOWN_INPUT_FORMAT:
+            return "Unknown format of the input file"sv;
+        case ConvertStatus::UNKNOWN_OUTPUT_FORMAT:
+            return "Unknown format of the output file"sv;
+        case ConvertStatus::LOADING_FAILED:
+            return "Loading failed"sv;
+        case ConvertStatus::SAVING_FAILED:
+            return "Saving failed"sv;
+    }
+    return "Unknown error"sv;
+}
+
+ConvertStatus ConvertImage(const img_lib::Path& in_path, const img_lib::Path& out_path,
+                           const ConvertOptions& options, ConversionCache* cache) {
+    // Даже для одного файла декодирование и кодирование идут параллельно:
+    // кодер записывает полосы строк, пока декодер читает следующие
+    ConvertStatus result = ConvertStatus::OK;
+    PipelineOptions pipeline;
+    pipeline.image_pool = img_lib::GetThreadImagePool();
+    pipeline.cache = cache;
+
+    RunConvertPipeline({{in_path, out_path}}, options, [&result](size_t, ConvertStatus status, double, bool) {
+        result = status;
+    }, pipeline);
+
+    return result;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "format_interfaces.h"
+
+#include <string_view>
+
+// Результат конвертации одного файла.
+// Значения совпадают с кодами возврата imgconv
+enum class ConvertStatus {
+    OK = 0,
+    UNKNOWN_INPUT_FORMAT = 2,
+    UNKNOWN_OUTPUT_FORMAT = 3,
+    LOADING_FAILED = 4,
+    SAVING_FAILED = 5
+};
+
+std::string_view GetStatusMessage(ConvertStatus status);
+
+// Параметры кодеров, задаваемые из командной строки
+struct ConvertOptions {
+    img_lib::JPEGSaveOptions jpeg;
+    img_lib::PNGSaveOptions png;
+};
+
+class ConversionCache;
+
+// Загружает изображение и сохраняет его в формате, определённом по расширению out_path.
+// Если задан cache, готовый результат берётся из него, а новый сохраняется в него
+ConvertStatus ConvertImage(const img_lib::Path& in_path, const img_lib::Path& out_path,
+                           const ConvertOptions& options = {}, ConversionCache* cache = nullptr);
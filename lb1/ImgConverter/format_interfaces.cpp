@@ -0,0 +1,112 @@
+#include "format_interfaces.h"
+
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+namespace {
+
+// Встроенные кодеки ImgLib. Кодеки JPEG и PNG регистрируются с параметрами
+// сжатия по умолчанию; конвертер подменяет их экземплярами с параметрами
+// из командной строки
+const CodecRegistrar jpeg_registrar(
+    Format::JPEG, img_lib::ImageFormat::JPEG, {".jpg"sv, ".jpeg"sv},
+    CodecCapability::STREAMING | CodecCapability::IN_MEMORY | CodecCapability::REGION_DECODE,
+    make_unique<FormatInterfaces::JPEGFormat>());
+
+const CodecRegistrar ppm_registrar(
+    Format::PPM, img_lib::ImageFormat::PPM, {".ppm"sv},
+    CodecCapability::STREAMING | CodecCapability::IN_MEMORY | CodecCapability::REGION_DECODE,
+    make_unique<FormatInterfaces::PPMFormat>());
+
+const CodecRegistrar bmp_registrar(
+    Format::BMP, img_lib::ImageFormat::BMP, {".bmp"sv},
+    CodecCapability::STREAMING | CodecCapability::IN_MEMORY | CodecCapability::REGION_DECODE,
+    make_unique<FormatInterfaces::BMPFormat>());
+
+// PNG сжат одним потоком, поэтому область читается через LoadImage и Crop
+const CodecRegistrar png_registrar(
+    Format::PNG, img_lib::ImageFormat::PNG, {".png"sv},
+    CodecCapability::STREAMING | CodecCapability::IN_MEMORY,
+    make_unique<FormatInterfaces::PNGFormat>());
+
+}  // namespace
+
+CodecRegistry& CodecRegistry::Instance() {
+    // создаётся при первом обращении, поэтому порядок статической
+    // инициализации единиц трансляции с регистраторами не важен
+    static CodecRegistry registry;
+    return registry;
+}
+
+void CodecRegistry::Register(CodecInfo info) {
+    codecs_.push_back(move(info));
+}
+
+const CodecInfo* CodecRegistry::FindByFormat(Format format) const {
+    for (const CodecInfo& info : codecs_) {
+        if (info.format == format) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+const CodecInfo* CodecRegistry::FindByExtension(string_view extension) const {
+    for (const CodecInfo& info : codecs_) {
+        for (const string& candidate : info.extensions) {
+            if (candidate == extension) {
+                return &info;
+            }
+        }
+    }
+    return nullptr;
+}
+
+const CodecInfo* CodecRegistry::FindByImageFormat(img_lib::ImageFormat image_format) const {
+    if (image_format == img_lib::ImageFormat::UNKNOWN) {
+        return nullptr;
+    }
+    for (const CodecInfo& info : codecs_) {
+        if (info.image_format == image_format) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+CodecRegistrar::CodecRegistrar(Format format, img_lib::ImageFormat image_format,
+                               initializer_list<string_view> extensions, unsigned capabilities,
+                               unique_ptr<const FormatInterfaces::ImageFormatInterface> codec) {
+    CodecInfo info;
+    info.format = format;
+    info.image_format = image_format;
+    info.extensions.assign(extensions.begin(), extensions.end());
+    info.capabilities = capabilities;
+    info.codec = move(codec);
+    CodecRegistry::Instance().Register(move(info));
+}
+
+Format GetFormatByExtension(const img_lib::Path& input_file) {
+    const CodecInfo* info = CodecRegistry::Instance().FindByExtension(input_file.extension().string());
+    return info ? info->format : Format::UNKNOWN;
+}
+
+Format GetFormatByContent(const img_lib::Path& input_file) {
+    const CodecInfo* info = CodecRegistry::Instance().FindByImageFormat(img_lib::DetectImageFormat(input_file));
+    return info ? info->format : Format::UNKNOWN;
+}
+
+const FormatInterfaces::ImageFormatInterface* GetFormatInterface(Format format) {
+    const CodecInfo* info = CodecRegistry::Instance().FindByFormat(format);
+    return info ? info->codec.get() : nullptr;
+}
+
+const FormatInterfaces::ImageFormatInterface* GetFormatInterface(const img_lib::Path& path) {
+    return GetFormatInterface(GetFormatByExtension(path));
+}
+
+const FormatInterfaces::ImageFormatInterface* GetInputFormatInterface(const img_lib::Path& path) {
+    return GetFormatInterface(GetFormatByContent(path));
+}
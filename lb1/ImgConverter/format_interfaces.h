@@ -0,0 +1,294 @@
+#pragma once
+
+#include <img_lib.h>
+#include <bmp_image.h>
+#include <image_probe.h>
+#include <jpeg_image.h>
+#include <op_graph.h>
+#include <png_image.h>
+#include <ppm_image.h>
+
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Пространство имён для интерфейсов форматов
+namespace FormatInterfaces {
+
+class ImageFormatInterface {
+public:
+    virtual ~ImageFormatInterface() = default;
+    virtual bool SaveImage(const img_lib::Path& file, const img_lib::Image& image) const = 0;
+	virtual img_lib::Image LoadImage(const img_lib::Path& file) const = 0;
+
+	// потоковое чтение и запись по строкам
+	virtual std::unique_ptr<img_lib::RowSource> OpenSource(const img_lib::Path& file) const = 0;
+	virtual std::unique_ptr<img_lib::RowSink> OpenSink(const img_lib::Path& file, img_lib::Size size) const = 0;
+
+	// правки изображения размера size перед записью в этом формате.
+	// граф выполняется между декодером и кодером за один проход по строкам;
+	// по умолчанию изображение сохраняется без дополнительной обработки
+	virtual img_lib::OpGraph GetProcessing(img_lib::Size size) const {
+		return img_lib::OpGraph(size);
+	}
+
+	// декодирование из памяти и кодирование в память; доступны,
+	// если кодек зарегистрирован с CodecCapability::IN_MEMORY
+	virtual img_lib::Image LoadImage(img_lib::ByteSpan /*data*/) const {
+		return {};
+	}
+	virtual bool SaveImage(img_lib::Bytes& /*out*/, const img_lib::Image& /*image*/) const {
+		return false;
+	}
+
+	// чтение области (x, y, w, h). с CodecCapability::REGION_DECODE кодек читает
+	// с диска лишь часть файла, иначе область вырезается из целого изображения
+	// без копирования пикселей
+	virtual img_lib::Image LoadRegion(const img_lib::Path& file, int x, int y, int w, int h) const {
+		return LoadImage(file).Crop(x, y, w, h);
+	}
+};
+
+class PPMFormat : public ImageFormatInterface {
+public:
+    bool SaveImage(const img_lib::Path& file, const img_lib::Image& image) const override {
+        return img_lib::SavePPM(file, image);
+    }
+
+    img_lib::Image LoadImage(const img_lib::Path& file) const override {
+        return img_lib::LoadPPM(file);
+    }
+
+    std::unique_ptr<img_lib::RowSource> OpenSource(const img_lib::Path& file) const override {
+        return img_lib::OpenPPMSource(file);
+    }
+
+    std::unique_ptr<img_lib::RowSink> OpenSink(const img_lib::Path& file, img_lib::Size size) const override {
+        return img_lib::OpenPPMSink(file, size);
+    }
+
+    img_lib::Image LoadImage(img_lib::ByteSpan data) const override {
+        return img_lib::LoadPPM(data);
+    }
+
+    bool SaveImage(img_lib::Bytes& out, const img_lib::Image& image) const override {
+        return img_lib::SavePPM(out, image);
+    }
+
+    img_lib::Image LoadRegion(const img_lib::Path& file, int x, int y, int w, int h) const override {
+        return img_lib::LoadPPMRegion(file, x, y, w, h);
+    }
+};
+
+class JPEGFormat : public ImageFormatInterface {
+public:
+    explicit JPEGFormat(img_lib::JPEGSaveOptions save_options = {})
+        : save_options_(save_options) {
+    }
+
+    bool SaveImage(const img_lib::Path& file, const img_lib::Image& image) const override {
+        return img_lib::SaveJPEG(file, image, save_options_);
+    }
+
+    img_lib::Image LoadImage(const img_lib::Path& file) const override {
+        return img_lib::LoadJPEG(file);
+    }
+
+    std::unique_ptr<img_lib::RowSource> OpenSource(const img_lib::Path& file) const override {
+        return img_lib::OpenJPEGSource(file);
+    }
+
+    std::unique_ptr<img_lib::RowSink> OpenSink(const img_lib::Path& file, img_lib::Size size) const override {
+        return img_lib::OpenJPEGSink(file, size, save_options_);
+    }
+
+    img_lib::Image LoadImage(img_lib::ByteSpan data) const override {
+        return img_lib::LoadJPEG(data);
+    }
+
+    bool SaveImage(img_lib::Bytes& out, const img_lib::Image& image) const override {
+        return img_lib::SaveJPEG(out, image, save_options_);
+    }
+
+    img_lib::Image LoadRegion(const img_lib::Path& file, int x, int y, int w, int h) const override {
+        return img_lib::LoadJPEGRegion(file, x, y, w, h);
+    }
+
+private:
+    img_lib::JPEGSaveOptions save_options_;
+};
+
+class PNGFormat : public ImageFormatInterface {
+public:
+    explicit PNGFormat(img_lib::PNGSaveOptions save_options = {})
+        : save_options_(save_options) {
+    }
+
+    bool SaveImage(const img_lib::Path& file, const img_lib::Image& image) const override {
+        return img_lib::SavePNG(file, image, save_options_);
+    }
+
+    img_lib::Image LoadImage(const img_lib::Path& file) const override {
+        return img_lib::LoadPNG(file);
+    }
+
+    std::unique_ptr<img_lib::RowSource> OpenSource(const img_lib::Path& file) const override {
+        return img_lib::OpenPNGSource(file);
+    }
+
+    std::unique_ptr<img_lib::RowSink> OpenSink(const img_lib::Path& file, img_lib::Size size) const override {
+        return img_lib::OpenPNGSink(file, size, save_options_);
+    }
+
+    img_lib::Image LoadImage(img_lib::ByteSpan data) const override {
+        return img_lib::LoadPNG(data);
+    }
+
+    bool SaveImage(img_lib::Bytes& out, const img_lib::Image& image) const override {
+        return img_lib::SavePNG(out, image, save_options_);
+    }
+
+private:
+    img_lib::PNGSaveOptions save_options_;
+};
+
+class BMPFormat : public ImageFormatInterface {
+public:
+    bool SaveImage(const img_lib::Path& file, const img_lib::Image& image) const override {
+        return img_lib::SaveBMP(file, image);
+    }
+
+    // метки 3x3: синяя в левом верхнем углу, жёлтая посередине верхнего
+    // края и пурпурная в центре изображения
+    img_lib::OpGraph GetProcessing(img_lib::Size size) const override {
+        const img_lib::Color blue{std::byte{0}, std::byte{0}, std::byte{255}, std::byte{255}};
+        const img_lib::Color yellow{std::byte{255}, std::byte{255}, std::byte{0}, std::byte{255}};
+        const img_lib::Color magenta{std::byte{255}, std::byte{0}, std::byte{255}, std::byte{255}};
+        const int center_x = size.width / 2;
+        const int center_y = size.height - 2 - size.height / 2;
+        return img_lib::OpGraph(size)
+            .FillRect(0, 0, 3, 3, blue)
+            .FillRect(center_x - 1, 0, 3, 3, yellow)
+            .FillRect(center_x - 1, center_y, 3, 3, magenta);
+    }
+
+    img_lib::Image LoadImage(const img_lib::Path& file) const override {
+        return img_lib::LoadBMP(file);
+    }
+
+    std::unique_ptr<img_lib::RowSource> OpenSource(const img_lib::Path& file) const override {
+        return img_lib::OpenBMPSource(file);
+    }
+
+    std::unique_ptr<img_lib::RowSink> OpenSink(const img_lib::Path& file, img_lib::Size size) const override {
+        return img_lib::OpenBMPSink(file, size);
+    }
+
+    img_lib::Image LoadImage(img_lib::ByteSpan data) const override {
+        return img_lib::LoadBMP(data);
+    }
+
+    bool SaveImage(img_lib::Bytes& out, const img_lib::Image& image) const override {
+        return img_lib::SaveBMP(out, image);
+    }
+
+    img_lib::Image LoadRegion(const img_lib::Path& file, int x, int y, int w, int h) const override {
+        return img_lib::LoadBMPRegion(file, x, y, w, h);
+    }
+};
+
+} // namespace FormatInterfaces
+
+// Определение формата файла по расширению
+enum class Format {
+    JPEG,
+    PPM,
+    BMP,
+    PNG,
+    UNKNOWN
+};
+
+// Возможности кодека помимо загрузки и сохранения файла целиком;
+// значения - биты маски CodecInfo::capabilities
+enum class CodecCapability : unsigned {
+    STREAMING = 1u << 0,      // OpenSource/OpenSink читают и пишут построчно
+    IN_MEMORY = 1u << 1,      // LoadImage/SaveImage из памяти и в память
+    REGION_DECODE = 1u << 2   // LoadRegion читает с диска лишь часть изображения
+};
+
+constexpr unsigned operator|(CodecCapability lhs, CodecCapability rhs) {
+    return static_cast<unsigned>(lhs) | static_cast<unsigned>(rhs);
+}
+
+constexpr unsigned operator|(unsigned lhs, CodecCapability rhs) {
+    return lhs | static_cast<unsigned>(rhs);
+}
+
+// Описание зарегистрированного кодека
+struct CodecInfo {
+    Format format = Format::UNKNOWN;
+    // сигнатура, по которой кодек узнаёт свои входные файлы
+    img_lib::ImageFormat image_format = img_lib::ImageFormat::UNKNOWN;
+    // расширения выходных файлов вместе с точкой, например ".jpg"
+    std::vector<std::string> extensions;
+    unsigned capabilities = 0;
+    std::unique_ptr<const FormatInterfaces::ImageFormatInterface> codec;
+
+    bool Has(CodecCapability capability) const {
+        return (capabilities & static_cast<unsigned>(capability)) != 0;
+    }
+};
+
+// Реестр кодеков. Кодеки регистрируются при статической инициализации
+// через CodecRegistrar, после чего реестр только читается и безопасен
+// для одновременного использования из нескольких потоков
+class CodecRegistry {
+public:
+    static CodecRegistry& Instance();
+
+    void Register(CodecInfo info);
+
+    // возвращают nullptr, если подходящий кодек не зарегистрирован
+    const CodecInfo* FindByFormat(Format format) const;
+    const CodecInfo* FindByExtension(std::string_view extension) const;
+    const CodecInfo* FindByImageFormat(img_lib::ImageFormat image_format) const;
+
+    const std::vector<CodecInfo>& GetCodecs() const {
+        return codecs_;
+    }
+
+private:
+    CodecRegistry() = default;
+
+    std::vector<CodecInfo> codecs_;
+};
+
+// Регистрирует кодек в CodecRegistry при создании. Встроенные кодеки
+// регистрируются статическими объектами из общего списка в
+// format_interfaces.cpp; новый кодек добавляется в этот список.
+// Регистратор в отдельной единице трансляции статической библиотеки
+// компоновщик может выбросить, если на неё ничего не ссылается, поэтому
+// такой файл нужно собирать в исполняемый файл, а не в библиотеку
+class CodecRegistrar {
+public:
+    CodecRegistrar(Format format, img_lib::ImageFormat image_format,
+                   std::initializer_list<std::string_view> extensions, unsigned capabilities,
+                   std::unique_ptr<const FormatInterfaces::ImageFormatInterface> codec);
+};
+
+Format GetFormatByExtension(const img_lib::Path& input_file);
+
+// Определение формата существующего файла по его сигнатуре,
+// независимо от расширения
+Format GetFormatByContent(const img_lib::Path& input_file);
+
+const FormatInterfaces::ImageFormatInterface* GetFormatInterface(Format format);
+
+// Возвращает интерфейс для обработки форматов изображений по расширению;
+// используется для выходных файлов, которых ещё нет
+const FormatInterfaces::ImageFormatInterface* GetFormatInterface(const img_lib::Path& path);
+
+// Возвращает интерфейс для чтения существующего файла по его содержимому
+const FormatInterfaces::ImageFormatInterface* GetInputFormatInterface(const img_lib::Path& path);
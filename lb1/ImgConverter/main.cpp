@@ -1,143 +1,291 @@
-#include <img_lib.h>
-#include <bmp_image.h>
-#include <jpeg_image.h>
-#include <ppm_image.h>
-#include <tuple>
-#include <filesystem>
+#include "batch.h"
+#include "conversion_cache.h"
+#include "converter.h"
+
+#include <image_probe.h>
+#include <image_stats.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
 #include <string_view>
 #include <iostream>
+#include <vector>
 
 using namespace std;
 
-// Пространство имён для интерфейсов форматов
-namespace FormatInterfaces {
-
-class ImageFormatInterface {
-public:
-    virtual ~ImageFormatInterface() = default;
-    virtual bool SaveImage(const img_lib::Path& file, const img_lib::Image& image) const = 0;
-	virtual img_lib::Image LoadImage(const img_lib::Path& file) const = 0;
+void PrintUsage(const char* program) {
+    cerr << "Usage: "sv << program << " [options] <in_file> <out_file>"sv << endl;
+    cerr << "       "sv << program << " --batch <manifest_or_dir> <out_dir> <format> [--jobs <n>]"sv
+         << " [--prefetch <n>] [--prefetch-mb <n>] [options]"sv << endl;
+    cerr << "       "sv << program << " --probe <file>..."sv << endl;
+    cerr << "Options:"sv << endl;
+    cerr << "  --jpeg-quality <1-100>           JPEG quality (default 75)"sv << endl;
+    cerr << "  --jpeg-subsampling <444|422|420> JPEG chroma subsampling (default 420)"sv << endl;
+    cerr << "  --jpeg-dct <islow|ifast|float>   JPEG DCT method (default islow)"sv << endl;
+    cerr << "  --jpeg-optimize                  optimize JPEG Huffman tables"sv << endl;
+    cerr << "  --jpeg-progressive               write progressive JPEG"sv << endl;
+    cerr << "  --png-level <0-9>                PNG zlib compression level (default 6)"sv << endl;
+    cerr << "  --png-filter <none|sub|up|average|paeth|adaptive>"sv << endl;
+    cerr << "                                   PNG row filter (default adaptive)"sv << endl;
+    cerr << "  --png-strategy <default|filtered|huffman|rle|fixed>"sv << endl;
+    cerr << "                                   PNG zlib strategy (default default)"sv << endl;
+    cerr << "  --png-fast                       fast PNG: level 1, sub filter, rle strategy"sv << endl;
+    cerr << "  --png-alpha                      keep the alpha channel in PNG output"sv << endl;
+    cerr << "  --cache <dir>                    reuse converted files cached in dir;"sv << endl;
+    cerr << "                                   dir must be empty or created by --cache"sv << endl;
+    cerr << "  --cache-mb <n>                   cache size limit in MB (default 1024)"sv << endl;
+    cerr << "  --stats                          print ImgLib timers and counters to stderr"sv << endl;
+}
 
-	virtual bool ProcessImage(const img_lib::Path& file, const img_lib::Image& image) const {
-		return true;
-	}
+// Параметры командной строки, общие для обоих режимов
+struct CommandLine {
+    vector<string_view> positional;
+    ConvertOptions convert;
+    size_t jobs = 0;
+    // упреждающее чтение входных файлов пакета
+    size_t prefetch_files = BatchOptions{}.prefetch_files;
+    size_t prefetch_bytes = BatchOptions{}.prefetch_bytes;
+    // кэш сконвертированных файлов
+    string_view cache_dir;
+    uint64_t cache_bytes = BatchOptions{}.cache_bytes;
+    bool stats = false;
 };
 
-class PPMFormat : public ImageFormatInterface {
-public:
-    bool SaveImage(const img_lib::Path& file, const img_lib::Image& image) const override {
-        return img_lib::SavePPM(file, image);
-    }
+bool ParseCommandLine(int argc, const char** argv, CommandLine& result) {
+    img_lib::JPEGSaveOptions& jpeg = result.convert.jpeg;
+    img_lib::PNGSaveOptions& png = result.convert.png;
 
-    img_lib::Image LoadImage(const img_lib::Path& file) const override {
-        return img_lib::LoadPPM(file);
-    }
-};
+    for (int i = 1; i < argc; ++i) {
+        const string_view arg = argv[i];
+        const bool has_value = i + 1 < argc;
 
-class JPEGFormat : public ImageFormatInterface {
-public:
-    bool SaveImage(const img_lib::Path& file, const img_lib::Image& image) const override {
-        return img_lib::SaveJPEG(file, image);
+        if (arg == "--jpeg-optimize"sv) {
+            jpeg.optimize_coding = true;
+        } else if (arg == "--jpeg-progressive"sv) {
+            jpeg.progressive = true;
+        } else if (arg == "--png-fast"sv) {
+            png.fast = true;
+        } else if (arg == "--png-alpha"sv) {
+            png.format = img_lib::PNGPixelFormat::RGBA8;
+        } else if (arg == "--stats"sv) {
+            result.stats = true;
+        } else if (arg == "--jpeg-quality"sv && has_value) {
+            jpeg.quality = atoi(argv[++i]);
+            if (jpeg.quality < 1 || jpeg.quality > 100) {
+                return false;
+            }
+        } else if (arg == "--jpeg-subsampling"sv && has_value) {
+            const string_view value = argv[++i];
+            if (value == "444"sv) {
+                jpeg.subsampling = img_lib::JPEGSubsampling::S444;
+            } else if (value == "422"sv) {
+                jpeg.subsampling = img_lib::JPEGSubsampling::S422;
+            } else if (value == "420"sv) {
+                jpeg.subsampling = img_lib::JPEGSubsampling::S420;
+            } else {
+                return false;
+            }
+        } else if (arg == "--jpeg-dct"sv && has_value) {
+            const string_view value = argv[++i];
+            if (value == "islow"sv) {
+                jpeg.dct_method = img_lib::JPEGDCTMethod::ISLOW;
+            } else if (value == "ifast"sv) {
+                jpeg.dct_method = img_lib::JPEGDCTMethod::IFAST;
+            } else if (value == "float"sv) {
+                jpeg.dct_method = img_lib::JPEGDCTMethod::FLOAT;
+            } else {
+                return false;
+            }
+        } else if (arg == "--png-level"sv && has_value) {
+            const string_view value = argv[++i];
+            if (value.size() != 1 || value[0] < '0' || value[0] > '9') {
+                return false;
+            }
+            png.level = value[0] - '0';
+        } else if (arg == "--png-filter"sv && has_value) {
+            const string_view value = argv[++i];
+            if (value == "none"sv) {
+                png.filter = img_lib::PNGFilter::NONE;
+            } else if (value == "sub"sv) {
+                png.filter = img_lib::PNGFilter::SUB;
+            } else if (value == "up"sv) {
+                png.filter = img_lib::PNGFilter::UP;
+            } else if (value == "average"sv) {
+                png.filter = img_lib::PNGFilter::AVERAGE;
+            } else if (value == "paeth"sv) {
+                png.filter = img_lib::PNGFilter::PAETH;
+            } else if (value == "adaptive"sv) {
+                png.filter = img_lib::PNGFilter::ADAPTIVE;
+            } else {
+                return false;
+            }
+        } else if (arg == "--png-strategy"sv && has_value) {
+            const string_view value = argv[++i];
+            if (value == "default"sv) {
+                png.strategy = img_lib::PNGStrategy::DEFAULT;
+            } else if (value == "filtered"sv) {
+                png.strategy = img_lib::PNGStrategy::FILTERED;
+            } else if (value == "huffman"sv) {
+                png.strategy = img_lib::PNGStrategy::HUFFMAN_ONLY;
+            } else if (value == "rle"sv) {
+                png.strategy = img_lib::PNGStrategy::RLE;
+            } else if (value == "fixed"sv) {
+                png.strategy = img_lib::PNGStrategy::FIXED;
+            } else {
+                return false;
+            }
+        } else if (arg == "--jobs"sv && has_value) {
+            const int jobs = atoi(argv[++i]);
+            if (jobs <= 0) {
+                return false;
+            }
+            result.jobs = static_cast<size_t>(jobs);
+        } else if (arg == "--prefetch"sv && has_value) {
+            const int files = atoi(argv[++i]);
+            if (files < 0) {
+                return false;
+            }
+            result.prefetch_files = static_cast<size_t>(files);
+        } else if (arg == "--prefetch-mb"sv && has_value) {
+            const int megabytes = atoi(argv[++i]);
+            if (megabytes <= 0) {
+                return false;
+            }
+            result.prefetch_bytes = static_cast<size_t>(megabytes) << 20;
+        } else if (arg == "--cache"sv && has_value) {
+            result.cache_dir = argv[++i];
+        } else if (arg == "--cache-mb"sv && has_value) {
+            const int megabytes = atoi(argv[++i]);
+            if (megabytes <= 0) {
+                return false;
+            }
+            result.cache_bytes = static_cast<uint64_t>(megabytes) << 20;
+        } else if (arg.size() > 2 && arg.substr(0, 2) == "--"sv && arg != "--batch"sv && arg != "--probe"sv) {
+            return false;
+        } else {
+            result.positional.push_back(arg);
+        }
     }
 
-    img_lib::Image LoadImage(const img_lib::Path& file) const override {
-        return img_lib::LoadJPEG(file);
-    }
-};
-    
-class BMPFormat : public ImageFormatInterface {
-public:
-    bool SaveImage(const img_lib::Path& file, const img_lib::Image& image) const override {
-        return img_lib::SaveBMP(file, image);
+    return true;
+}
+
+string_view GetImageFormatName(img_lib::ImageFormat format) {
+    switch (format) {
+        case img_lib::ImageFormat::JPEG:
+            return "JPEG"sv;
+        case img_lib::ImageFormat::PPM:
+            return "PPM"sv;
+        case img_lib::ImageFormat::BMP:
+            return "BMP"sv;
+        case img_lib::ImageFormat::PNG:
+            return "PNG"sv;
+        default:
+            return "unknown"sv;
     }
+}
 
-	bool ProcessImage(const img_lib::Path& file, const img_lib::Image& image) const override {
-   		return img_lib::ProcessBMP(file, image);
+// Печатает формат и размеры файлов, читая только их заголовки
+bool PrintProbe(const vector<string_view>& files) {
+    bool all_known = true;
+    for (const string_view file : files) {
+        const img_lib::ImageInfo info = img_lib::ProbeImage(img_lib::Path(file));
+        cout << file << ": "sv;
+        if (!info) {
+            cout << "unrecognized"sv << endl;
+            all_known = false;
+            continue;
+        }
+        cout << GetImageFormatName(info.format) << ' ' << info.size.width << 'x' << info.size.height
+             << ", "sv << info.channels << " channels"sv << endl;
     }
+    return all_known;
+}
 
-    img_lib::Image LoadImage(const img_lib::Path& file) const override {
-        return img_lib::LoadBMP(file);
+// Печатает статистику ImgLib при выходе из main, если задан --stats;
+// без IMGLIB_ENABLE_STATS сообщает, что статистика не собиралась
+class StatsReport {
+public:
+    explicit StatsReport(bool enabled)
+        : enabled_(enabled) {
     }
-};
 
-} // namespace FormatInterfaces
+    ~StatsReport() {
+        if (enabled_) {
+            cerr << "ImgLib statistics:"sv << endl;
+            img_lib::stats::Print(cerr);
+        }
+    }
 
-// Определение формата файла по расширению
-enum class Format {
-    JPEG,
-    PPM,
-    BMP,
-    UNKNOWN
+private:
+    bool enabled_;
 };
 
-Format GetFormatByExtension(const img_lib::Path& input_file) {
-    const string ext = input_file.extension().string();
-    if (ext == ".jpg"sv || ext == ".jpeg"sv) {
-        return Format::JPEG;
-    }
-    if (ext == ".ppm"sv) {
-        return Format::PPM;
-    }
-    if (ext == ".bmp"sv) {
-        return Format::BMP;
+int main(int argc, const char** argv) {
+    CommandLine command_line;
+    if (!ParseCommandLine(argc, argv, command_line)) {
+        PrintUsage(argv[0]);
+        return 1;
     }
-    
-    return Format::UNKNOWN;
-}
+    const vector<string_view>& args = command_line.positional;
+    const StatsReport stats_report(command_line.stats);
 
-// Возвращает интерфейс для обработки форматов изображений
-const FormatInterfaces::ImageFormatInterface* GetFormatInterface(const img_lib::Path& path) {
-
-    switch (GetFormatByExtension(path)) {
-        case Format::JPEG:
-            static const FormatInterfaces::JPEGFormat jpegInterface;
-            return &jpegInterface;
-        case Format::PPM:
-            static const FormatInterfaces::PPMFormat ppmInterface;
-            return &ppmInterface;
-        case Format::BMP:
-            static const FormatInterfaces::BMPFormat bmpInterface;
-            return &bmpInterface;
-        default:
-            return nullptr;
+    if (!args.empty() && args[0] == "--probe"sv) {
+        if (args.size() < 2) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+        return PrintProbe(vector<string_view>(args.begin() + 1, args.end())) ? 0 : 2;
     }
-}
 
-int main(int argc, const char** argv) {
-    if (argc != 3) {
-        cerr << "Usage: "sv << argv[0] << " <in_file> <out_file>"sv << endl;
-        return 1;
-    }
+    if (!args.empty() && args[0] == "--batch"sv) {
+        if (args.size() != 4) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
 
-    img_lib::Path in_path = argv[1];
-    img_lib::Path out_path = argv[2];
+        BatchOptions options;
+        options.input = args[1];
+        options.output_dir = args[2];
+        options.format = string(args[3]);
+        options.jobs = command_line.jobs;
+        options.prefetch_files = command_line.prefetch_files;
+        options.prefetch_bytes = command_line.prefetch_bytes;
+        options.cache_dir = command_line.cache_dir;
+        options.cache_bytes = command_line.cache_bytes;
+        options.convert = command_line.convert;
 
-    // Определяем форматы входного и выходного файлов
-    const FormatInterfaces::ImageFormatInterface* inputFormat = GetFormatInterface(in_path);
-    if (!inputFormat) {
-        cerr << "Unknown format of the input file"sv << endl;
-        return 2;
+        return RunBatch(options, cout) ? 0 : 6;
     }
 
-    const FormatInterfaces::ImageFormatInterface* outputFormat = GetFormatInterface(out_path);
-    if (!outputFormat) {
-        cerr << "Unknown format of the output file"sv << endl;
-        return 3;
+    if (args.size() != 2) {
+        PrintUsage(argv[0]);
+        return 1;
     }
 
-    // Загружаем изображение
-    img_lib::Image image = inputFormat->LoadImage(in_path);
-    if (!image) {
-        cerr << "Loading failed"sv << endl;
-        return 4;
+    img_lib::Path in_path = args[0];
+    img_lib::Path out_path = args[1];
+
+    unique_ptr<ConversionCache> cache;
+    if (!command_line.cache_dir.empty()) {
+        cache = make_unique<ConversionCache>(img_lib::Path(command_line.cache_dir),
+                                             CacheOptions{command_line.cache_bytes});
+        if (!*cache) {
+            cerr << "Cannot open cache directory "sv << command_line.cache_dir << endl;
+            return 1;
+        }
     }
 
-    // Сохраняем изображение
-    if (!outputFormat->ProcessImage(out_path, image)) {
-        cerr << "Saving failed"sv << endl;
-        return 5;
+    const ConvertStatus status = ConvertImage(in_path, out_path, command_line.convert, cache.get());
+    if (cache && command_line.stats) {
+        PrintCacheStats(cache->GetStats(), cerr);
+    }
+    if (status != ConvertStatus::OK) {
+        cerr << GetStatusMessage(status) << endl;
+        return static_cast<int>(status);
     }
 
-    cout << "Successfully converted"sv << endl;
+    cout << GetStatusMessage(status) << endl;
     return 0;
-}
\ No newline at end of file
+}
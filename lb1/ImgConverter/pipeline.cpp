@@ -0,0 +1,387 @@
+#include "pipeline.h"
+
+#include <mapped_file.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+// Полоса строк одного файла, передаваемая от декодера кодеру
+struct Strip {
+    size_t job = 0;
+    const FormatInterfaces::ImageFormatInterface* output = nullptr;
+    // ошибка декодирования; такая полоса не содержит строк и завершает файл
+    ConvertStatus status = ConvertStatus::OK;
+    // размер всего изображения
+    img_lib::Size size = {0, 0};
+    // номер первой строки полосы; 0 - начало нового файла
+    int first_row = 0;
+    // строки полосы, а если whole_image - изображение целиком
+    img_lib::Image rows;
+    bool whole_image = false;
+    // последняя полоса файла
+    bool last = true;
+    // результат уже скопирован из кэша; полоса не содержит строк
+    bool from_cache = false;
+    // ключ, под которым результат сохраняется в кэш; задан в последней полосе
+    optional<CacheKey> cache_key;
+    Clock::time_point start;
+};
+
+// Очередь ограниченной ёмкости: Push ждёт свободного места, Pop - элемента
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity_(max<size_t>(capacity, 1)) {
+    }
+
+    void Push(T value) {
+        unique_lock lock(mutex_);
+        not_full_.wait(lock, [this] {
+            return items_.size() < capacity_;
+        });
+        items_.push_back(move(value));
+        not_empty_.notify_one();
+    }
+
+    // после Close возвращает false, как только очередь опустеет
+    bool Pop(T& value) {
+        unique_lock lock(mutex_);
+        not_empty_.wait(lock, [this] {
+            return !items_.empty() || closed_;
+        });
+        if (items_.empty()) {
+            return false;
+        }
+        value = move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    void Close() {
+        lock_guard lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+private:
+    const size_t capacity_;
+    mutex mutex_;
+    condition_variable not_full_;
+    condition_variable not_empty_;
+    deque<T> items_;
+    bool closed_ = false;
+};
+
+class Decoder {
+public:
+    Decoder(const ConvertOptions& options, const PipelineOptions& pipeline, img_lib::ImagePool& pool,
+            BoundedQueue<Strip>& queue)
+        : options_(options)
+        , jpeg_output_(options.jpeg)
+        , png_output_(options.png)
+        , strip_rows_(max(pipeline.strip_rows, 1))
+        , prefetch_(pipeline.prefetch)
+        , cache_(pipeline.cache)
+        , pool_(pool)
+        , queue_(queue) {
+    }
+
+    // Исключение кодека (например, bad_alloc на огромном изображении)
+    // завершает ошибкой только этот файл, а не весь конвейер
+    void Decode(size_t index, const ConvertJob& job) {
+        start_ = Clock::now();
+        next_row_ = 0;
+        finished_ = false;
+        try {
+            DecodeJob(index, job);
+        } catch (const exception&) {
+            if (!finished_) {
+                Strip strip;
+                strip.job = index;
+                strip.first_row = next_row_;
+                strip.start = start_;
+                Fail(move(strip), ConvertStatus::LOADING_FAILED);
+            }
+        }
+    }
+
+private:
+    void DecodeJob(size_t index, const ConvertJob& job) {
+        Strip head;
+        head.job = index;
+        head.start = start_;
+
+        // Прочитанный заранее файл не нужно читать с диска ещё раз
+        img_lib::Bytes data;
+        if (prefetch_ && !prefetch_->Take(index, data)) {
+            return Fail(move(head), ConvertStatus::LOADING_FAILED);
+        }
+
+        // Входной формат определяется по содержимому, выходной - по расширению
+        const CodecRegistry& registry = CodecRegistry::Instance();
+        const CodecInfo* input = registry.FindByImageFormat(prefetch_
+            ? img_lib::DetectImageFormat(img_lib::ByteSpan{data.data(), data.size()})
+            : img_lib::DetectImageFormat(job.in_path));
+        if (!input) {
+            return Fail(move(head), ConvertStatus::UNKNOWN_INPUT_FORMAT);
+        }
+        const CodecInfo* output = registry.FindByExtension(job.out_path.extension().string());
+        if (!output) {
+            return Fail(move(head), ConvertStatus::UNKNOWN_OUTPUT_FORMAT);
+        }
+
+        head.output = GetOutput(*output);
+
+        // Ключ считается по байтам входного файла, поэтому попадание
+        // обходится без декодирования и кодирования
+        if (cache_) {
+            head.cache_key = GetCacheKey(job, data, output->format);
+            if (head.cache_key && cache_->Fetch(*head.cache_key, job.out_path)) {
+                head.from_cache = true;
+                head.cache_key.reset();
+                Push(move(head));
+                return;
+            }
+        }
+
+        const bool in_memory = prefetch_ && input->Has(CodecCapability::IN_MEMORY);
+        const bool streaming = input->Has(CodecCapability::STREAMING)
+            && output->Has(CodecCapability::STREAMING);
+        if (in_memory || !streaming) {
+            img_lib::Image image = in_memory
+                ? input->codec->LoadImage(img_lib::ByteSpan{data.data(), data.size()})
+                : input->codec->LoadImage(job.in_path);
+            // сжатые данные не держатся, пока полоса ждёт места в очереди
+            data = img_lib::Bytes();
+            if (!image) {
+                return Fail(move(head), ConvertStatus::LOADING_FAILED);
+            }
+
+            // Все правки выполняются за один проход в изображение результата
+            const img_lib::OpGraph graph = head.output->GetProcessing({image.GetWidth(), image.GetHeight()});
+            if (!graph.IsEmpty()) {
+                img_lib::Image processed = img_lib::ApplyGraph(graph, image);
+                pool_.Release(move(image));
+                if (!processed) {
+                    return Fail(move(head), ConvertStatus::LOADING_FAILED);
+                }
+                image = move(processed);
+            }
+            head.size = {image.GetWidth(), image.GetHeight()};
+            head.rows = move(image);
+            head.whole_image = true;
+            Push(move(head));
+            return;
+        }
+
+        // Строки передаются полосами, и изображение целиком в памяти
+        // не строится. Правки выполняются над каждой строкой по пути
+        // от декодера к кодеру
+        auto source = input->codec->OpenSource(job.in_path);
+        if (source) {
+            const img_lib::OpGraph graph = head.output->GetProcessing(source->GetSize());
+            source = img_lib::OpenGraphSource(graph, move(source));
+        }
+        if (!source) {
+            return Fail(move(head), ConvertStatus::LOADING_FAILED);
+        }
+        head.size = source->GetSize();
+
+        for (int first = 0; first < head.size.height; first += strip_rows_) {
+            Strip strip;
+            strip.job = index;
+            strip.output = head.output;
+            strip.size = head.size;
+            strip.first_row = first;
+            strip.start = head.start;
+
+            const int count = min(strip_rows_, head.size.height - first);
+            strip.rows = pool_.Acquire(head.size.width, count);
+            for (int row = 0; row < count; ++row) {
+                if (!source->ReadRow(strip.rows.GetLine(row))) {
+                    pool_.Release(move(strip.rows));
+                    return Fail(move(strip), ConvertStatus::LOADING_FAILED);
+                }
+            }
+            strip.last = first + count == head.size.height;
+            if (strip.last) {
+                strip.cache_key = head.cache_key;
+            }
+            Push(move(strip));
+        }
+    }
+
+    // запоминает, сколько строк файла уже передано и передан ли он целиком
+    void Push(Strip strip) {
+        next_row_ = strip.first_row + strip.rows.GetHeight();
+        finished_ = strip.last;
+        queue_.Push(move(strip));
+    }
+    // Кодеры JPEG и PNG настраиваются параметрами сжатия из командной строки
+    const FormatInterfaces::ImageFormatInterface* GetOutput(const CodecInfo& output) const {
+        switch (output.format) {
+            case Format::JPEG:
+                return &jpeg_output_;
+            case Format::PNG:
+                return &png_output_;
+            default:
+                return output.codec.get();
+        }
+    }
+
+    // Прочитанный заранее файл хешируется из памяти, остальные - через
+    // отображение в память. nullopt, если файл не удалось прочитать
+    optional<CacheKey> GetCacheKey(const ConvertJob& job, const img_lib::Bytes& data, Format output) const {
+        if (prefetch_) {
+            return MakeCacheKey(img_lib::ByteSpan{data.data(), data.size()}, output, options_);
+        }
+        const img_lib::MappedFile mapped(job.in_path);
+        if (!mapped) {
+            return nullopt;
+        }
+        return MakeCacheKey(img_lib::ByteSpan{mapped.GetData(), mapped.GetSize()}, output, options_);
+    }
+
+    void Fail(Strip strip, ConvertStatus status) {
+        strip.status = status;
+        strip.rows = {};
+        strip.last = true;
+        strip.cache_key.reset();
+        Push(move(strip));
+    }
+
+    const ConvertOptions& options_;
+    const FormatInterfaces::JPEGFormat jpeg_output_;
+    const FormatInterfaces::PNGFormat png_output_;
+    const int strip_rows_;
+    img_lib::PrefetchReader* const prefetch_;
+    ConversionCache* const cache_;
+    img_lib::ImagePool& pool_;
+    BoundedQueue<Strip>& queue_;
+
+    // состояние текущего файла для полосы с ошибкой после исключения
+    Clock::time_point start_;
+    int next_row_ = 0;
+    bool finished_ = false;
+};
+
+}  // namespace
+
+void RunConvertPipeline(const vector<ConvertJob>& jobs, const NextJob& next_job,
+                        const ConvertOptions& options, const JobDone& done,
+                        const PipelineOptions& pipeline) {
+    img_lib::ImagePool local_pool;
+    img_lib::ImagePool& pool = pipeline.image_pool ? *pipeline.image_pool : local_pool;
+    BoundedQueue<Strip> queue(pipeline.queue_capacity);
+    // Полосы ссылаются на кодеки декодера, поэтому он живёт,
+    // пока кодер не разберёт очередь
+    Decoder decoder(options, pipeline, pool, queue);
+
+    thread decode_thread([&] {
+        // Декодеры берут память изображений из пула конвейера,
+        // а кодер возвращает её туда после записи
+        img_lib::SetThreadImagePool(&pool);
+        size_t index = 0;
+        while (next_job(index)) {
+            decoder.Decode(index, jobs[index]);
+        }
+        img_lib::SetThreadImagePool(nullptr);
+        queue.Close();
+    });
+
+    Strip strip;
+    unique_ptr<img_lib::RowSink> sink;
+    ConvertStatus status = ConvertStatus::OK;
+    // выходной файл открывался кодером; при ошибке он удаляется
+    bool output_touched = false;
+
+    while (queue.Pop(strip)) {
+        const ConvertJob& job = jobs[strip.job];
+
+        if (strip.first_row == 0) {
+            status = strip.status;
+            sink.reset();
+            output_touched = false;
+            if (status == ConvertStatus::OK && !strip.whole_image && !strip.from_cache) {
+                output_touched = true;
+                sink = strip.output->OpenSink(job.out_path, strip.size);
+                if (!sink) {
+                    status = ConvertStatus::SAVING_FAILED;
+                }
+            }
+        } else if (status == ConvertStatus::OK) {
+            status = strip.status;
+        }
+
+        // После ошибки оставшиеся полосы файла только освобождаются
+        if (status == ConvertStatus::OK && strip.rows) {
+            if (strip.whole_image) {
+                output_touched = true;
+                if (!strip.output->SaveImage(job.out_path, strip.rows)) {
+                    status = ConvertStatus::SAVING_FAILED;
+                }
+            } else {
+                for (int row = 0; row < strip.rows.GetHeight(); ++row) {
+                    if (!sink->WriteRow(strip.rows.GetLine(row))) {
+                        status = ConvertStatus::SAVING_FAILED;
+                        break;
+                    }
+                }
+            }
+        }
+        if (strip.rows) {
+            pool.Release(move(strip.rows));
+        }
+
+        if (strip.last) {
+            if (status == ConvertStatus::OK && sink && !sink->Finish()) {
+                status = ConvertStatus::SAVING_FAILED;
+            }
+            sink.reset();
+            // Строки пишутся, пока декодер ещё читает файл, поэтому ошибка
+            // чтения или записи оставила бы недописанный файл
+            if (status != ConvertStatus::OK && output_touched) {
+                error_code ec;
+                filesystem::remove(job.out_path, ec);
+            }
+            // в кэш попадает уже закрытый кодером файл
+            if (status == ConvertStatus::OK && strip.cache_key) {
+                pipeline.cache->Store(*strip.cache_key, job.out_path);
+            }
+            done(strip.job, status, chrono::duration<double, milli>(Clock::now() - strip.start).count(),
+                 strip.from_cache);
+        }
+    }
+
+    decode_thread.join();
+}
+
+void RunConvertPipeline(const vector<ConvertJob>& jobs, const ConvertOptions& options,
+                        const JobDone& done, const PipelineOptions& pipeline) {
+    size_t next = 0;
+    const NextJob next_job = [&jobs, &next](size_t& index) {
+        if (next >= jobs.size()) {
+            return false;
+        }
+        index = next++;
+        return true;
+    };
+    RunConvertPipeline(jobs, next_job, options, done, pipeline);
+}
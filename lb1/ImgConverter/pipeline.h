@@ -0,0 +1,55 @@
+#pragma once
+
+#include "conversion_cache.h"
+#include "converter.h"
+
+#include <image_pool.h>
+#include <prefetch_reader.h>
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Одна конвертация: входной файл и выходной, формат которого задан расширением
+struct ConvertJob {
+    img_lib::Path in_path;
+    img_lib::Path out_path;
+};
+
+// Параметры конвейера конвертации
+struct PipelineOptions {
+    // число строк в полосе, передаваемой от декодера кодеру
+    int strip_rows = 32;
+    // число полос в очереди между стадиями; ограничивает память конвейера
+    size_t queue_capacity = 8;
+    // пул для полос и изображений; nullptr - собственный пул конвейера
+    img_lib::ImagePool* image_pool = nullptr;
+    // входные файлы, заранее читаемые в память в порядке jobs; файлы
+    // декодируются из памяти целиком. nullptr - чтение с диска при декодировании
+    img_lib::PrefetchReader* prefetch = nullptr;
+    // кэш готовых результатов: при попадании файл не декодируется и не
+    // кодируется, а копируется из кэша. nullptr - без кэша
+    ConversionCache* cache = nullptr;
+};
+
+// Выдаёт индекс следующей задачи в jobs; возвращает false, когда задачи
+// закончились. Вызывается из потока декодирования
+using NextJob = std::function<bool(size_t& index)>;
+
+// Вызывается в потоке кодирования по завершении каждого файла;
+// ms - время от начала декодирования до окончания записи,
+// from_cache - результат взят из кэша
+using JobDone = std::function<void(size_t index, ConvertStatus status, double ms, bool from_cache)>;
+
+// Двухстадийный конвейер. Отдельный поток декодирует файлы и передаёт их
+// строки полосами через ограниченную очередь потоку кодирования - вызывающему.
+// Пока кодируется файл N, декодируется уже файл N + 1. Правки выходного формата
+// (GetProcessing) выполняются над строками в потоке декодирования. Если один
+// из кодеков не умеет работать построчно, файл передаётся одной полосой
+void RunConvertPipeline(const std::vector<ConvertJob>& jobs, const NextJob& next_job,
+                        const ConvertOptions& options, const JobDone& done,
+                        const PipelineOptions& pipeline = {});
+
+// Конвертирует все jobs по порядку
+void RunConvertPipeline(const std::vector<ConvertJob>& jobs, const ConvertOptions& options,
+                        const JobDone& done, const PipelineOptions& pipeline = {});
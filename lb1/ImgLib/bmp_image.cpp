@@ -1,10 +1,19 @@
 #include "bmp_image.h"
+#include "image_pool.h"
+#include "image_region.h"
+#include "image_stats.h"
 #include "pack_defines.h"
+#include "pixel_pack.h"
 
+#include <algorithm>
 #include <array>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <string_view>
+#include <utility>
 
 using namespace std;
 
@@ -17,6 +26,13 @@ namespace img_lib {
         return STRIDE_SIZE * ((w * PIXEL_SIZE + PIXEL_SIZE) / BLOCK_SIZE);
     }
 
+    // значения поля biCompression
+    static const uint32_t BMP_RGB = 0;
+    static const uint32_t BMP_RLE8 = 1;
+    static const uint32_t BMP_RLE4 = 2;
+    static const uint32_t BMP_BITFIELDS = 3;
+    static const uint32_t BMP_ALPHABITFIELDS = 6;
+
     PACKED_STRUCT_BEGIN BitmapFileHeader{
         BitmapFileHeader(int width, int height) {
             bfSize = GetBMPStride(width) * height;
@@ -48,12 +64,89 @@ namespace img_lib {
     }
     PACKED_STRUCT_END
 
-	bool SaveBMP(const Path& file, const Image& image) {
-        BitmapFileHeader file_header(image.GetWidth(), image.GetHeight());
-        BitmapInfoHeader info_header(image.GetWidth(), image.GetHeight());
+    PACKED_STRUCT_BEGIN BitmapV4Header {
+        // заголовок BITMAPV4HEADER для 32-битных файлов:
+        // битовые маски задают порядок B, G, R, A и наличие альфа-канала
+        BitmapV4Header(int width, int height)
+            : biWidth(width), biHeight(height) {
+            biSizeImage = width * 4 * height;
+        }
+        uint32_t biSize = 108;
+        int32_t biWidth = {};
+        int32_t biHeight = {};
+        uint16_t biPlanes = 1;
+        uint16_t biBitCount = 32;
+        uint32_t biCompression = BMP_BITFIELDS;
+        uint32_t biSizeImage = {};
+        int32_t biXPelsPerMeter = 11811;
+        int32_t biYPelsPerMeter = 11811;
+        int32_t biClrUsed = 0;
+        int32_t biClrImportant = 0;
+        uint32_t bV4RedMask = 0x00FF0000;
+        uint32_t bV4GreenMask = 0x0000FF00;
+        uint32_t bV4BlueMask = 0x000000FF;
+        uint32_t bV4AlphaMask = 0xFF000000;
+        // LCS_sRGB
+        uint32_t bV4CSType = 0x73524742;
+        int32_t bV4Endpoints[9] = {};
+        uint32_t bV4GammaRed = 0;
+        uint32_t bV4GammaGreen = 0;
+        uint32_t bV4GammaBlue = 0;
+    }
+    PACKED_STRUCT_END
+
+    // суммарный размер заголовков, которые предшествуют пикселям
+    static const size_t BMP_HEADERS_SIZE = sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader);
+
+    // длина строки в файле для заданного формата записи
+    static size_t GetBMPRowSize(int width, BMPPixelFormat format) {
+        return format == BMPPixelFormat::BGRA32 ? static_cast<size_t>(width) * 4 : GetBMPStride(width);
+    }
+
+    // заголовки файла для записи изображения в заданном формате
+    static vector<std::byte> MakeBMPHeaders(int width, int height, BMPPixelFormat format) {
+        vector<std::byte> headers;
+        headers.reserve(sizeof(BitmapFileHeader) + sizeof(BitmapV4Header));
+        BitmapFileHeader file_header(width, height);
+
+        const auto append = [&headers](const auto& header) {
+            const auto* bytes = reinterpret_cast<const std::byte*>(&header);
+            headers.insert(headers.end(), bytes, bytes + sizeof(header));
+        };
+
+        if (format == BMPPixelFormat::BGRA32) {
+            const BitmapV4Header info_header(width, height);
+            file_header.bfOffBits = sizeof(BitmapFileHeader) + sizeof(BitmapV4Header);
+            file_header.bfSize = file_header.bfOffBits + info_header.biSizeImage;
+            append(file_header);
+            append(info_header);
+        } else {
+            const BitmapInfoHeader info_header(width, height);
+            // Добавляет размер заголовков к размеру изображения
+            file_header.bfSize += BMP_HEADERS_SIZE;
+            append(file_header);
+            append(info_header);
+        }
+
+        return headers;
+    }
+
+    // Упаковывает строку изображения в формат файла. 32-битные строки
+    // не требуют дополнения и переписываются одной перестановкой байт
+    static void EncodeBMPRow(const Color* src, std::byte* dst, int width, size_t row_size, BMPPixelFormat format) {
+        if (format == BMPPixelFormat::BGRA32) {
+            PackBGRA(src, dst, width);
+            return;
+        }
+        PackBGR(src, dst, width);
+        fill(dst + width * 3, dst + row_size, std::byte{0});
+    }
 
-        // Добавляет размер заголовков к размеру изображения
-        file_header.bfSize += sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader);
+	bool SaveBMP(const Path& file, const Image& image, BMPPixelFormat format) {
+        const int width = image.GetWidth();
+        const int height = image.GetHeight();
+        const vector<std::byte> headers = MakeBMPHeaders(width, height, format);
+        IMGLIB_STATS_TIMER(BMP_ENCODE);
 
         ofstream out(file, ios::binary);
         if (!out) {
@@ -61,142 +154,679 @@ namespace img_lib {
         }
 
         // Записывает заголовки
-        out.write(reinterpret_cast<const char*>(&file_header), sizeof(file_header));
-        out.write(reinterpret_cast<const char*>(&info_header), sizeof(info_header));
+        out.write(reinterpret_cast<const char*>(headers.data()), headers.size());
 
-        const int stride = GetBMPStride(image.GetWidth());
-        vector<char> buff(stride, 0);
+        const size_t row_size = GetBMPRowSize(width, format);
+        vector<std::byte> buff(row_size);
 
         // Записывает данные изображения "строка за строкой", снизу вверх
-        for (int y = image.GetHeight() - 1; y >= 0; --y) {
-            const Color* line = image.GetLine(y);
+        for (int y = height - 1; y >= 0; --y) {
+            EncodeBMPRow(image.GetLine(y), buff.data(), width, row_size, format);
+            IMGLIB_STATS_TIMER(FILE_WRITE);
+            out.write(reinterpret_cast<const char*>(buff.data()), row_size);
+        }
 
-            for (int x = 0; x < image.GetWidth(); ++x) {
-                buff[x * 3 + 0] = static_cast<char>(line[x].b); // B
-                buff[x * 3 + 1] = static_cast<char>(line[x].g); // G
-                buff[x * 3 + 2] = static_cast<char>(line[x].r); // R
-            }
+        IMGLIB_STATS_ADD(ROWS_ENCODED, height);
+        IMGLIB_STATS_ADD(BYTES_WRITTEN, max<streamoff>(out.tellp(), 0));
+        return out.good();
+    }
 
-            out.write(buff.data(), stride);
+    bool SaveBMPParallel(const Path& file, const Image& image, ThreadPool& pool, BMPPixelFormat format) {
+        if (!image) {
+            return false;
         }
+        IMGLIB_STATS_TIMER(BMP_ENCODE);
+        IMGLIB_STATS_ADD(ROWS_ENCODED, image.GetHeight());
+
+        const int width = image.GetWidth();
+        const int height = image.GetHeight();
+        const size_t row_size = GetBMPRowSize(width, format);
+        const vector<std::byte> headers = MakeBMPHeaders(width, height, format);
+
+        // Строки файла идут снизу вверх: строка файла i - это строка изображения height - 1 - i
+        const auto encode_rows = [&image, width, height, row_size, format](int first, int count, std::byte* dst) {
+            for (int i = 0; i < count; ++i) {
+                EncodeBMPRow(image.GetLine(height - 1 - (first + i)), dst + row_size * i, width, row_size, format);
+            }
+        };
 
-        return out.good();
+        return WriteRowsParallel(file, ByteSpan{headers.data(), headers.size()},
+                                 height, row_size, encode_rows, pool);
     }
 
-    bool ProcessBMP(const Path& file, const Image& image) {
-        BitmapFileHeader file_header(image.GetWidth(), image.GetHeight());
-        BitmapInfoHeader info_header(image.GetWidth(), image.GetHeight());
+    // наибольший размер заголовков вместе с палитрой, который читается
+    // целиком перед пиксельными данными
+    static const uint64_t MAX_BMP_HEADERS_SIZE = uint64_t{1} << 20;
+
+    // разобранные заголовки BMP-файла
+    struct BMPLayout {
+        int width = 0;
+        int height = 0;
+        // 1, 4, 8 (с палитрой), 24 или 32
+        int bit_count = 0;
+        uint32_t compression = BMP_RGB;
+        // для 32 бит: четвёртый байт хранит альфа-канал
+        bool has_alpha = false;
+        // для 32 бит: байты идут в порядке R, G, B, A, как в Color
+        bool rgba_order = false;
+        // смещение и размер пиксельных данных в файле
+        uint64_t pixel_offset = 0;
+        uint64_t pixel_size = 0;
+        // для несжатых файлов: смещение верхней строки и шаг между строками
+        uint64_t first_row_offset = 0;
+        ptrdiff_t row_step = 0;
+        // палитра всегда на 256 цветов: индексы за её пределами дают чёрный
+        array<Color, 256> palette;
+
+        bool IsCompressed() const {
+            return compression == BMP_RLE8 or compression == BMP_RLE4;
+        }
+    };
 
-        // Добавляет размер заголовков к размеру изображения
-        file_header.bfSize += sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader);
+    static uint32_t ReadU32(const std::byte* p) {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
 
-        ofstream out(file, ios::binary);
-        if (!out) {
+    // Разбирает заголовки BMP. available - сколько байт от начала файла
+    // доступно в data (заголовки, маски и палитра), file_size - полный
+    // размер файла. Проверяет, что пиксельные данные помещаются в файл
+    static bool ParseBMPHeaders(const std::byte* data, uint64_t available, uint64_t file_size,
+                                BMPLayout& layout) {
+        BitmapFileHeader file_header(0, 0);
+        BitmapInfoHeader info_header(0, 0);
+        if (data == nullptr or available < BMP_HEADERS_SIZE or available > file_size) {
             return false;
         }
+        memcpy(&file_header, data, sizeof(file_header));
+        memcpy(&info_header, data + sizeof(file_header), sizeof(info_header));
 
-        // Записывает заголовки
-        out.write(reinterpret_cast<const char*>(&file_header), sizeof(file_header));
-        out.write(reinterpret_cast<const char*>(&info_header), sizeof(info_header));
+        if (file_header.bfType[0] != 'B' or file_header.bfType[1] != 'M') {
+            return false;
+        }
+        if (info_header.biSize < sizeof(BitmapInfoHeader)
+            or info_header.biSize > available - sizeof(BitmapFileHeader)) {
+            return false;
+        }
 
-        const int stride = GetBMPStride(image.GetWidth());
-        vector<char> buff(stride, 0);
-        int width = image.GetWidth();
-        int height = image.GetHeight();
+        // Допустимые сочетания глубины цвета и сжатия
+        const int bit_count = info_header.biBitCount;
+        const uint32_t compression = info_header.biCompression;
+        bool supported = false;
+        switch (compression) {
+            case BMP_RGB:
+                supported = bit_count == 1 or bit_count == 4 or bit_count == 8
+                    or bit_count == 24 or bit_count == 32;
+                break;
+            case BMP_RLE8:
+                supported = bit_count == 8;
+                break;
+            case BMP_RLE4:
+                supported = bit_count == 4;
+                break;
+            case BMP_BITFIELDS:
+            case BMP_ALPHABITFIELDS:
+                supported = bit_count == 32;
+                break;
+        }
+        if (!supported) {
+            return false;
+        }
 
-        // Записывает данные изображения "строка за строкой", снизу вверх
-        for (int y = height - 1; y >= 0; --y) {
-            const Color* line = image.GetLine(y);
+        // Отрицательная высота означает хранение строк сверху вниз;
+        // сжатые файлы хранятся только снизу вверх
+        const int64_t width = info_header.biWidth;
+        const int64_t height = info_header.biHeight < 0
+            ? -int64_t{info_header.biHeight} : int64_t{info_header.biHeight};
+        if (width <= 0 or height <= 0 or width > numeric_limits<int>::max() / 4
+            or height > numeric_limits<int>::max()) {
+            return false;
+        }
+        const bool top_down = info_header.biHeight < 0;
+        if (top_down and (compression == BMP_RLE8 or compression == BMP_RLE4)) {
+            return false;
+        }
+
+        layout.width = static_cast<int>(width);
+        layout.height = static_cast<int>(height);
+        layout.bit_count = bit_count;
+        layout.compression = compression;
+        layout.has_alpha = false;
+        layout.rgba_order = false;
+
+        // Таблицы после 40-байтового заголовка: битовые маски,
+        // которые в заголовках V2 и новее входят в сам заголовок, и палитра
+        uint64_t tables_end = sizeof(BitmapFileHeader) + uint64_t{info_header.biSize};
+        if (compression == BMP_BITFIELDS or compression == BMP_ALPHABITFIELDS) {
+            const bool with_alpha = compression == BMP_ALPHABITFIELDS or info_header.biSize >= 56;
+            const uint64_t masks_end = BMP_HEADERS_SIZE + (with_alpha ? 16 : 12);
+            if (masks_end > available) {
+                return false;
+            }
+            const uint32_t red = ReadU32(data + BMP_HEADERS_SIZE);
+            const uint32_t green = ReadU32(data + BMP_HEADERS_SIZE + 4);
+            const uint32_t blue = ReadU32(data + BMP_HEADERS_SIZE + 8);
+            const uint32_t alpha = with_alpha ? ReadU32(data + BMP_HEADERS_SIZE + 12) : 0;
+
+            // поддерживаются только побайтовые раскладки
+            if (red == 0x00FF0000 and green == 0x0000FF00 and blue == 0x000000FF) {
+                layout.rgba_order = false;
+            } else if (red == 0x000000FF and green == 0x0000FF00 and blue == 0x00FF0000) {
+                layout.rgba_order = true;
+            } else {
+                return false;
+            }
+            if (alpha != 0 and alpha != 0xFF000000) {
+                return false;
+            }
+            layout.has_alpha = alpha == 0xFF000000;
+            tables_end = max(tables_end, masks_end);
+        }
 
-            for (int x = 0; x < width; ++x) {
-                buff[x * 3 + 0] = static_cast<char>(line[x].b); // B
-                buff[x * 3 + 1] = static_cast<char>(line[x].g); // G
-                buff[x * 3 + 2] = static_cast<char>(line[x].r); // R
+        layout.palette.fill(Color::Black());
+        if (bit_count <= 8) {
+            const int max_colors = 1 << bit_count;
+            if (info_header.biClrUsed < 0) {
+                return false;
+            }
+            const int colors = info_header.biClrUsed == 0 ? max_colors : min(info_header.biClrUsed, max_colors);
+            if (tables_end + uint64_t(colors) * 4 > available) {
+                return false;
             }
+            // Элементы палитры хранятся как B, G, R и неиспользуемый байт
+            const std::byte* entry = data + tables_end;
+            for (int i = 0; i < colors; ++i, entry += 4) {
+                layout.palette[i] = Color{entry[2], entry[1], entry[0], std::byte{255}};
+            }
+        }
 
-            if (y >= 0 && y <= 2) {
-                for (int x = 0; x < 3; x++) {
-                    buff[x * 3 + 0] = static_cast<char>(255); // B
-                    buff[x * 3 + 1] = static_cast<char>(0);   // G
-                    buff[x * 3 + 2] = static_cast<char>(0);   // R
-                }
+        const uint64_t offset = file_header.bfOffBits;
+        if (offset < BMP_HEADERS_SIZE or offset > file_size) {
+            return false;
+        }
+        layout.pixel_offset = offset;
+        layout.pixel_size = file_size - offset;
+
+        if (layout.IsCompressed()) {
+            if (info_header.biSizeImage != 0 and info_header.biSizeImage < layout.pixel_size) {
+                layout.pixel_size = info_header.biSizeImage;
             }
+            return true;
+        }
+
+        // Проверяет, что несжатые строки целиком помещаются в файл
+        const int64_t stride = (width * bit_count + 31) / 32 * 4;
+        if (static_cast<uint64_t>(stride * height) > layout.pixel_size) {
+            return false;
+        }
+
+        if (top_down) {
+            layout.first_row_offset = offset;
+            layout.row_step = stride;
+        } else {
+            layout.first_row_offset = offset + stride * (height - 1);
+            layout.row_step = -stride;
+        }
 
-            if (y >= 0 && y <= 2) {
-                int center_x = width / 2;
-                for (int x = center_x - 1; x <= center_x + 1; x++) {
-                    if (x >= 0 && x < width) {
-                        buff[x * 3 + 0] = static_cast<char>(0);   // B
-                        buff[x * 3 + 1] = static_cast<char>(255); // G
-                        buff[x * 3 + 2] = static_cast<char>(255);   // R
+        return true;
+    }
+
+    // Преобразует count пикселей несжатой строки в Color. first_pixel -
+    // номер первого пикселя внутри байта src для глубин меньше 8 бит
+    static void ConvertBMPRow(const BMPLayout& layout, const std::byte* src, int first_pixel,
+                              int count, Color* dst) {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(src);
+        switch (layout.bit_count) {
+            case 32:
+                // раскладка R, G, B, A совпадает с Color и копируется без перестановок
+                if (layout.rgba_order) {
+                    memcpy(dst, src, static_cast<size_t>(count) * sizeof(Color));
+                    if (!layout.has_alpha) {
+                        for (int x = 0; x < count; ++x) {
+                            dst[x].a = std::byte{255};
+                        }
                     }
+                } else if (layout.has_alpha) {
+                    UnpackBGRA(src, dst, count);
+                } else {
+                    UnpackBGRX(src, dst, count);
+                }
+                break;
+            case 24:
+                UnpackBGR(src, dst, count);
+                break;
+            case 8:
+                ExpandPalette(bytes, layout.palette.data(), dst, count);
+                break;
+            case 4:
+                for (int x = 0; x < count; ++x) {
+                    const int p = first_pixel + x;
+                    const uint8_t pair = bytes[p / 2];
+                    dst[x] = layout.palette[p % 2 == 0 ? pair >> 4 : pair & 0x0F];
                 }
+                break;
+            case 1:
+                for (int x = 0; x < count; ++x) {
+                    const int p = first_pixel + x;
+                    dst[x] = layout.palette[(bytes[p / 8] >> (7 - p % 8)) & 1];
+                }
+                break;
+        }
+    }
+
+    // Распаковывает RLE8 или RLE4. Пиксели, пропущенные командами
+    // перехода и конца строки, остаются чёрными
+    static bool DecodeBMPRLE(const BMPLayout& layout, const std::byte* data, Image& result) {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(data);
+        const uint64_t size = layout.pixel_size;
+        const bool rle8 = layout.compression == BMP_RLE8;
+        const int width = layout.width;
+        const int height = layout.height;
+
+        for (int y = 0; y < height; ++y) {
+            Color* line = result.GetLine(y);
+            fill(line, line + width, Color::Black());
+        }
+
+        // строки файла идут снизу вверх
+        int x = 0;
+        int y = 0;
+        const auto put = [&](uint8_t index) {
+            if (x < width and y < height) {
+                result.GetLine(height - 1 - y)[x] = layout.palette[index];
+            }
+            ++x;
+        };
+
+        uint64_t pos = 0;
+        while (pos + 2 <= size and y < height) {
+            const uint8_t count = bytes[pos];
+            const uint8_t value = bytes[pos + 1];
+            pos += 2;
+
+            // повтор: count пикселей одного индекса (для RLE4 - чередование двух)
+            if (count > 0) {
+                for (int i = 0; i < count; ++i) {
+                    put(rle8 ? value : (i % 2 == 0 ? value >> 4 : value & 0x0F));
+                }
+                continue;
             }
 
-            int center_bmp_y = height / 2;
-            int y_image_center_min = height - 1 - (center_bmp_y + 1);
-            int y_image_center_max = height - 1 - (center_bmp_y - 1);
-            if (y >= y_image_center_min && y <= y_image_center_max) {
-                int center_x = width / 2;
-                for (int x = center_x - 1; x <= center_x + 1; x++) {
-                    if (x >= 0 && x < width) {
-                        buff[x * 3 + 0] = static_cast<char>(255);   // B
-                        buff[x * 3 + 1] = static_cast<char>(0);   // G
-                        buff[x * 3 + 2] = static_cast<char>(255); // R
+            switch (value) {
+                case 0:  // конец строки
+                    x = 0;
+                    ++y;
+                    break;
+                case 1:  // конец изображения
+                    return true;
+                case 2:  // переход вправо и вверх
+                    if (pos + 2 > size) {
+                        return false;
+                    }
+                    x += bytes[pos];
+                    y += bytes[pos + 1];
+                    pos += 2;
+                    break;
+                default: {
+                    // value индексов без сжатия, выровненных до 2 байт
+                    const uint64_t run_bytes = rle8 ? value : (value + 1) / 2;
+                    if (pos + run_bytes > size) {
+                        return false;
+                    }
+                    for (int i = 0; i < value; ++i) {
+                        put(rle8 ? bytes[pos + i] : (i % 2 == 0 ? bytes[pos + i / 2] >> 4 : bytes[pos + i / 2] & 0x0F));
                     }
+                    pos += run_bytes + (run_bytes & 1);
+                    break;
                 }
             }
+        }
+
+        // файл без маркера конца изображения принимается
+        return true;
+    }
+
+    BMPMapping::BMPMapping() = default;
+    BMPMapping::~BMPMapping() = default;
+
+    BMPMapping::BMPMapping(BMPMapping&& other) noexcept
+        : file_(std::move(other.file_))
+        , layout_(std::move(other.layout_))
+        , first_row_(exchange(other.first_row_, nullptr)) {
+    }
 
-            out.write(buff.data(), stride);
+    BMPMapping& BMPMapping::operator=(BMPMapping&& other) noexcept {
+        if (this != &other) {
+            file_ = std::move(other.file_);
+            layout_ = std::move(other.layout_);
+            first_row_ = exchange(other.first_row_, nullptr);
         }
+        return *this;
+    }
 
-        return out.good();
+    int BMPMapping::GetWidth() const {
+        return layout_ ? layout_->width : 0;
     }
 
-    Image LoadBMP(const Path& file) {
-        std::ifstream in(file, std::ios::binary);
+    int BMPMapping::GetHeight() const {
+        return layout_ ? layout_->height : 0;
+    }
+
+    int BMPMapping::GetBitCount() const {
+        return layout_ ? layout_->bit_count : 0;
+    }
+
+    ptrdiff_t BMPMapping::GetRowStep() const {
+        return layout_ ? layout_->row_step : 0;
+    }
+
+    const std::byte* BMPMapping::GetRow(int y) const {
+        assert(y >= 0 && y < GetHeight());
+        return first_row_ + layout_->row_step * y;
+    }
+
+    void BMPMapping::ReadRow(int y, Color* dst) const {
+        ConvertBMPRow(*layout_, GetRow(y), 0, layout_->width, dst);
+    }
+
+    Image LoadBMPRegion(const Path& file, int x, int y, int w, int h) {
+        IMGLIB_STATS_TIMER(BMP_DECODE);
+        // Без буфера потока каждое чтение забирает с диска ровно
+        // нужные байты, а не целый блок вокруг них
+        ifstream in;
+        in.rdbuf()->pubsetbuf(nullptr, 0);
+        in.open(file, ios::binary | ios::ate);
         if (!in) {
             return {};
         }
+        const uint64_t file_size = static_cast<uint64_t>(in.tellg());
 
-        // Читает заголовки
+        // Заголовки вместе с масками и палитрой занимают начало файла
+        // вплоть до пиксельных данных
         BitmapFileHeader file_header(0, 0);
-        BitmapInfoHeader info_header(0, 0);
-        if (!in.read(reinterpret_cast<char*>(&file_header), sizeof(file_header))) return {};
-        if (!in.read(reinterpret_cast<char*>(&info_header), sizeof(info_header))) return {};
+        in.seekg(0);
+        if (!in.read(reinterpret_cast<char*>(&file_header), sizeof(file_header))) {
+            return {};
+        }
+        const uint64_t headers_size = max<uint64_t>(file_header.bfOffBits, BMP_HEADERS_SIZE);
+        if (headers_size > file_size or headers_size > MAX_BMP_HEADERS_SIZE) {
+            return {};
+        }
+
+        vector<char> headers(headers_size);
+        in.seekg(0);
+        if (!in.read(headers.data(), headers.size())) {
+            return {};
+        }
+
+        BMPLayout layout;
+        if (!ParseBMPHeaders(reinterpret_cast<const std::byte*>(headers.data()), headers_size, file_size, layout)
+            or !IsValidRegion({layout.width, layout.height}, x, y, w, h)) {
+            return {};
+        }
 
+        Image result = AcquireImage(w, h);
 
+        // Сжатые строки не адресуемы: файл распаковывается целиком
+        if (layout.IsCompressed()) {
+            const Image full = LoadBMP(file);
+            if (!full) {
+                return {};
+            }
+            for (int row = 0; row < h; ++row) {
+                const Color* src = full.GetLine(y + row) + x;
+                copy(src, src + w, result.GetLine(row));
+            }
+            return result;
+        }
 
-        if (file_header.bfType != "BM" or info_header.biBitCount != 24 or info_header.biCompression != 0) {
+        // Участок строки от байта с первым пикселем до байта с последним
+        const int bits = layout.bit_count;
+        const uint64_t first_byte = uint64_t{static_cast<uint32_t>(x)} * bits / 8;
+        const uint64_t end_byte = (uint64_t{static_cast<uint32_t>(x + w)} * bits + 7) / 8;
+        const int first_pixel = x - static_cast<int>(first_byte * 8 / bits);
+        vector<char> buff(end_byte - first_byte);
+
+        // Переходит к началу нужного участка каждой строки
+        for (int row = 0; row < h; ++row) {
+            const int64_t offset = static_cast<int64_t>(layout.first_row_offset)
+                + static_cast<int64_t>(layout.row_step) * (y + row) + static_cast<int64_t>(first_byte);
+            in.seekg(offset);
+            if (!in.read(buff.data(), buff.size())) {
+                return {};
+            }
+            ConvertBMPRow(layout, reinterpret_cast<const std::byte*>(buff.data()), first_pixel, w, result.GetLine(row));
+        }
+
+        IMGLIB_STATS_ADD(BYTES_READ, headers_size + buff.size() * h);
+        IMGLIB_STATS_ADD(ROWS_DECODED, h);
+        return result;
+    }
+
+    ImageInfo ProbeBMP(ByteSpan data) {
+        BMPLayout layout;
+        if (!ParseBMPHeaders(data.data, data.size, data.size, layout)) {
             return {};
         }
+        ImageInfo info;
+        info.format = ImageFormat::BMP;
+        info.size = {layout.width, layout.height};
+        info.channels = layout.has_alpha ? 4 : 3;
+        return info;
+    }
 
-        const int width = info_header.biWidth;
-        const int height = info_header.biHeight;
-        const int stride = GetBMPStride(width);
+    BMPMapping MapBMP(const Path& file) {
+        BMPMapping mapping;
+        mapping.file_ = MappedFile(file);
+        if (!mapping.file_) {
+            return {};
+        }
 
-        Image result(width, height, Color::Black());
-        std::vector<char> buffer(stride);
+        auto layout = make_unique<BMPLayout>();
+        if (!ParseBMPHeaders(mapping.file_.GetData(), mapping.file_.GetSize(), mapping.file_.GetSize(), *layout)
+            or layout->IsCompressed()) {
+            return {};
+        }
 
-        // Читает строки изображения
-        for (int y = height - 1; y >= 0; --y) {
-            Color* line = result.GetLine(y);
-            in.read(buffer.data(), stride);
+        mapping.first_row_ = mapping.file_.GetData() + layout->first_row_offset;
+        mapping.layout_ = std::move(layout);
+        return mapping;
+    }
+
+    Image LoadBMP(ByteSpan data) {
+        IMGLIB_STATS_TIMER(BMP_DECODE);
+        BMPLayout layout;
+        if (!ParseBMPHeaders(data.data, data.size, data.size, layout)) {
+            return {};
+        }
+
+        Image result = AcquireImage(layout.width, layout.height);
 
-            if (!in) { 
+        if (layout.IsCompressed()) {
+            if (!DecodeBMPRLE(layout, data.data + layout.pixel_offset, result)) {
                 return {};
             }
+            IMGLIB_STATS_ADD(ROWS_DECODED, layout.height);
+            return result;
+        }
 
-            for (int x = 0; x < width; ++x) {
-                line[x].b = static_cast<std::byte>(buffer[x * 3 + 0]);
-                line[x].g = static_cast<std::byte>(buffer[x * 3 + 1]);
-                line[x].r = static_cast<std::byte>(buffer[x * 3 + 2]);
-            }
+        // Декодирует строки прямо из памяти, без промежуточного буфера
+        const std::byte* first_row = data.data + layout.first_row_offset;
+        for (int y = 0; y < layout.height; ++y) {
+            ConvertBMPRow(layout, first_row + layout.row_step * y, 0, layout.width, result.GetLine(y));
         }
-        if (!in) {
+
+        IMGLIB_STATS_ADD(ROWS_DECODED, layout.height);
+        return result;
+    }
+
+    Image LoadBMP(const Path& file) {
+        // Строки декодируются прямо из отображённых в память страниц
+        const MappedFile mapped(file);
+        if (!mapped) {
             return {};
         }
-        return result;
+        return LoadBMP(ByteSpan{mapped.GetData(), mapped.GetSize()});
+    }
+
+    bool SaveBMP(Bytes& out, const Image& image, BMPPixelFormat format) {
+        if (!image) {
+            return false;
+        }
+
+        const int width = image.GetWidth();
+        const int height = image.GetHeight();
+        const size_t row_size = GetBMPRowSize(width, format);
+        const vector<std::byte> headers = MakeBMPHeaders(width, height, format);
+        IMGLIB_STATS_TIMER(BMP_ENCODE);
+
+        out.resize(headers.size() + row_size * height);
+        copy(headers.begin(), headers.end(), out.begin());
+
+        // Упаковывает строки сразу на их место в буфере, снизу вверх
+        for (int y = 0; y < height; ++y) {
+            std::byte* row = out.data() + headers.size() + row_size * (height - 1 - y);
+            EncodeBMPRow(image.GetLine(y), row, width, row_size, format);
+        }
+
+        IMGLIB_STATS_ADD(ROWS_ENCODED, height);
+        IMGLIB_STATS_ADD(BYTES_WRITTEN, out.size());
+        return true;
+    }
+
+    namespace {
+
+    class BMPRowSource : public RowSource {
+    public:
+        explicit BMPRowSource(BMPMapping mapping)
+            : mapping_(std::move(mapping)) {
+        }
+
+        Size GetSize() const override {
+            return {mapping_.GetWidth(), mapping_.GetHeight()};
+        }
+
+        // Строки берутся прямо из отображённого файла в любом порядке,
+        // поэтому хранение снизу вверх не требует буферизации
+        bool ReadRow(Color* dst) override {
+            if (next_row_ >= mapping_.GetHeight()) {
+                return false;
+            }
+            IMGLIB_STATS_TIMER(BMP_DECODE);
+            IMGLIB_STATS_ADD(ROWS_DECODED, 1);
+            mapping_.ReadRow(next_row_++, dst);
+            return true;
+        }
+
+    private:
+        BMPMapping mapping_;
+        int next_row_ = 0;
+    };
+
+    // Источник для сжатых файлов: RLE распаковывается только
+    // целиком, снизу вверх, поэтому строки отдаются из готового изображения
+    class BMPImageRowSource : public RowSource {
+    public:
+        explicit BMPImageRowSource(Image image)
+            : image_(std::move(image)) {
+        }
+
+        Size GetSize() const override {
+            return {image_.GetWidth(), image_.GetHeight()};
+        }
+
+        bool ReadRow(Color* dst) override {
+            if (next_row_ >= image_.GetHeight()) {
+                return false;
+            }
+            const Color* line = image_.GetLine(next_row_++);
+            copy(line, line + image_.GetWidth(), dst);
+            return true;
+        }
+
+    private:
+        Image image_;
+        int next_row_ = 0;
+    };
+
+    class BMPRowSink : public RowSink {
+    public:
+        BMPRowSink(const Path& file, Size size, BMPPixelFormat format)
+            : out_(file, ios::binary)
+            , size_(size)
+            , format_(format)
+            , headers_size_(0)
+            , row_size_(GetBMPRowSize(size.width, format))
+            , buff_(row_size_) {
+            const vector<std::byte> headers = MakeBMPHeaders(size.width, size.height, format);
+            headers_size_ = headers.size();
+            out_.write(reinterpret_cast<const char*>(headers.data()), headers.size());
+        }
+
+        // Строки приходят сверху вниз, а в файле хранятся снизу вверх,
+        // поэтому каждая строка пишется по своему смещению
+        bool WriteRow(const Color* row) override {
+            if (next_row_ >= size_.height) {
+                return false;
+            }
+            const streamoff offset = static_cast<streamoff>(headers_size_)
+                + static_cast<streamoff>(row_size_) * (size_.height - 1 - next_row_);
+
+            IMGLIB_STATS_TIMER(BMP_ENCODE);
+            EncodeBMPRow(row, buff_.data(), size_.width, row_size_, format_);
+            out_.seekp(offset);
+            out_.write(reinterpret_cast<const char*>(buff_.data()), row_size_);
+            IMGLIB_STATS_ADD(BYTES_WRITTEN, row_size_);
+            IMGLIB_STATS_ADD(ROWS_ENCODED, 1);
+            ++next_row_;
+            return out_.good();
+        }
+
+        bool Finish() override {
+            out_.flush();
+            return next_row_ == size_.height && out_.good();
+        }
+
+        bool IsOpen() const {
+            return out_.good();
+        }
+
+    private:
+        ofstream out_;
+        Size size_;
+        BMPPixelFormat format_;
+        size_t headers_size_;
+        size_t row_size_;
+        int next_row_ = 0;
+        vector<std::byte> buff_;
+    };
+
+    }  // namespace
+
+    unique_ptr<RowSource> OpenBMPSource(const Path& file) {
+        BMPMapping mapping = MapBMP(file);
+        if (mapping) {
+            return make_unique<BMPRowSource>(std::move(mapping));
+        }
+
+        // MapBMP отвергает сжатые файлы - их можно прочитать только целиком
+        Image image = LoadBMP(file);
+        if (!image) {
+            return nullptr;
+        }
+        return make_unique<BMPImageRowSource>(std::move(image));
+    }
+
+    unique_ptr<RowSink> OpenBMPSink(const Path& file, Size size, BMPPixelFormat format) {
+        if (size.width <= 0 || size.height <= 0) {
+            return nullptr;
+        }
+        auto sink = make_unique<BMPRowSink>(file, size, format);
+        if (!sink->IsOpen()) {
+            return nullptr;
+        }
+        return sink;
     }
 
-};  // namespace img_lib
\ No newline at end of file
+};  // namespace img_lib
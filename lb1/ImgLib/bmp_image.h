@@ -1,13 +1,98 @@
 #pragma once
 #include "img_lib.h"
+#include "mapped_file.h"
+#include "parallel_writer.h"
+#include "row_stream.h"
+#include "thread_pool.h"
 
+#include <cstddef>
 #include <filesystem>
+#include <memory>
 
 namespace img_lib {
 using Path = std::filesystem::path;
 
-bool SaveBMP(const Path& file, const Image& image);
-bool ProcessBMP(const Path& file, const Image& image);
+// формат пикселей при записи BMP
+enum class BMPPixelFormat {
+    BGR24,  // 3 байта B, G, R; строки дополняются до кратной 4 длины
+    BGRA32  // 4 байта B, G, R, A с альфа-каналом; строки без дополнения
+};
+
+// разобранные заголовки BMP-файла; определена в bmp_image.cpp
+struct BMPLayout;
+
+// представление несжатого BMP-файла, отображённого в память, без копирования
+// пикселей. строки выдаются сверху вниз независимо от порядка хранения в файле.
+// GetRow возвращает строку в формате файла (1, 4, 8 бит с палитрой, 24 бит
+// B, G, R или 32 бит), ReadRow преобразует её в Color
+class BMPMapping {
+public:
+    BMPMapping();
+    ~BMPMapping();
+
+    BMPMapping(BMPMapping&& other) noexcept;
+    BMPMapping& operator=(BMPMapping&& other) noexcept;
+
+    int GetWidth() const;
+    int GetHeight() const;
+    int GetBitCount() const;
+
+    // смещение в байтах между соседними строками изображения;
+    // для BMP, хранящегося снизу вверх, оно отрицательно
+    std::ptrdiff_t GetRowStep() const;
+
+    const std::byte* GetRow(int y) const;
+
+    // преобразует строку y в GetWidth() пикселей Color
+    void ReadRow(int y, Color* dst) const;
+
+    explicit operator bool() const {
+        return first_row_ != nullptr;
+    }
+
+    bool operator!() const {
+        return !operator bool();
+    }
+
+private:
+    friend BMPMapping MapBMP(const Path& file);
+
+    MappedFile file_;
+    std::unique_ptr<BMPLayout> layout_;
+    const std::byte* first_row_ = nullptr;
+};
+
+bool SaveBMP(const Path& file, const Image& image, BMPPixelFormat format = BMPPixelFormat::BGR24);
+
+// читает несжатые BMP с 1, 4, 8 (палитра), 24 и 32 битами на пиксель,
+// а также сжатые RLE8 и RLE4. 32-битные файлы сохраняют альфа-канал,
+// если он объявлен в заголовке битовой маской
 Image LoadBMP(const Path& file);
 
-} // namespace img_lib
\ No newline at end of file
+// кодирует полосы строк в пуле потоков и пишет их на свои места в файле;
+// на больших изображениях быстрее последовательной SaveBMP
+bool SaveBMPParallel(const Path& file, const Image& image, ThreadPool& pool = GetWriterThreadPool(),
+                     BMPPixelFormat format = BMPPixelFormat::BGR24);
+
+// декодирование из памяти и кодирование в память, без обращения к файлам
+Image LoadBMP(ByteSpan data);
+bool SaveBMP(Bytes& out, const Image& image, BMPPixelFormat format = BMPPixelFormat::BGR24);
+
+// читает с диска только байты строк и столбцов области (x, y, w, h);
+// при ошибке или выходе области за границы возвращает пустое изображение
+Image LoadBMPRegion(const Path& file, int x, int y, int w, int h);
+
+// читает только заголовки BitmapFileHeader и BitmapInfoHeader;
+// при ошибке возвращает пустые сведения
+ImageInfo ProbeBMP(ByteSpan data);
+
+// отображает файл в память и проверяет заголовки; при ошибке, а также
+// для сжатых RLE файлов, строки которых не адресуемы, возвращает пустое представление
+BMPMapping MapBMP(const Path& file);
+
+// потоковое чтение и запись строк; при ошибке открытия возвращают nullptr
+std::unique_ptr<RowSource> OpenBMPSource(const Path& file);
+std::unique_ptr<RowSink> OpenBMPSink(const Path& file, Size size,
+                                     BMPPixelFormat format = BMPPixelFormat::BGR24);
+
+} // namespace img_lib
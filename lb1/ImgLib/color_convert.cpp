@@ -0,0 +1,538 @@
+#include "color_convert.h"
+#include "image_ops.h"
+#include "image_pool.h"
+#include "image_stats.h"
+#include "pixel_pack.h"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define IMGLIB_COLOR_X86 1
+    #include <immintrin.h>
+    #define IMGLIB_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+using namespace std;
+
+namespace img_lib {
+
+namespace {
+
+// прямое преобразование, масштаб 2^16. _mm_madd_epi16 умножает на 16-битные
+// знаковые множители, поэтому веса больше 32767 в SIMD-ядрах разбиты на две
+// равные половины; сумма произведений при этом та же, что в скалярной версии
+constexpr int Y_R = 19595;
+constexpr int Y_G = 38470;
+constexpr int Y_B = 7471;
+constexpr int CB_R = -11059;
+constexpr int CB_G = -21709;
+constexpr int CB_B = 32768;
+constexpr int CR_R = 32768;
+constexpr int CR_G = -27439;
+constexpr int CR_B = -5329;
+constexpr int Y_ROUND = 1 << 15;
+// смещение 128 и округление на единицу меньше половины, как в LibJPEG:
+// так Cb и Cr не выходят за 255 без насыщения
+constexpr int CHROMA_ROUND = (128 << 16) + (1 << 15) - 1;
+
+// обратное преобразование, масштаб 2^14: все множители помещаются в int16
+constexpr int INV_SHIFT = 14;
+constexpr int R_CR = 22970;   // 1.402
+constexpr int G_CB = -5638;   // -0.344136
+constexpr int G_CR = -11700;  // -0.714136
+constexpr int B_CB = 29032;   // 1.772
+constexpr int INV_ROUND = 1 << (INV_SHIFT - 1);
+
+int ClampByte(int value) {
+    return min(max(value, 0), 255);
+}
+
+template <bool CHROMA>
+void RGBToYCbCrScalar(const Color* src, uint8_t* y, uint8_t* cb, uint8_t* cr, int count) {
+    for (int x = 0; x < count; ++x) {
+        const int r = to_integer<int>(src[x].r);
+        const int g = to_integer<int>(src[x].g);
+        const int b = to_integer<int>(src[x].b);
+        y[x] = static_cast<uint8_t>((Y_R * r + Y_G * g + Y_B * b + Y_ROUND) >> 16);
+        if (CHROMA) {
+            cb[x] = static_cast<uint8_t>((CB_R * r + CB_G * g + CB_B * b + CHROMA_ROUND) >> 16);
+            cr[x] = static_cast<uint8_t>((CR_R * r + CR_G * g + CR_B * b + CHROMA_ROUND) >> 16);
+        }
+    }
+}
+
+void YCbCrToRGBScalar(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, Color* dst, int count) {
+    for (int x = 0; x < count; ++x) {
+        const int luma = y[x];
+        const int u = cb[x] - 128;
+        const int v = cr[x] - 128;
+        dst[x] = {
+            static_cast<std::byte>(ClampByte(luma + ((R_CR * v + INV_ROUND) >> INV_SHIFT))),
+            static_cast<std::byte>(ClampByte(luma + ((G_CB * u + G_CR * v + INV_ROUND) >> INV_SHIFT))),
+            static_cast<std::byte>(ClampByte(luma + ((B_CB * u + INV_ROUND) >> INV_SHIFT))),
+            std::byte{255}
+        };
+    }
+}
+
+#ifdef IMGLIB_COLOR_X86
+
+// маска pshufb, раскладывающая 4 пикселя Color в пары 16-битных
+// отсчётов (first, second) в каждом 32-битном слове
+IMGLIB_TARGET("ssse3") __m128i GetPairMask(int first, int second) {
+    return _mm_setr_epi8(first, -128, second, -128, 4 + first, -128, 4 + second, -128,
+                         8 + first, -128, 8 + second, -128, 12 + first, -128, 12 + second, -128);
+}
+
+IMGLIB_TARGET("ssse3") __m128i GetWeightPair(int first, int second) {
+    return _mm_set1_epi32(static_cast<int>((static_cast<uint32_t>(second) << 16) | static_cast<uint16_t>(first)));
+}
+
+// отсчёты трёх каналов 4 пикселей в 32-битных словах
+struct Channels128 {
+    __m128i y;
+    __m128i cb;
+    __m128i cr;
+};
+
+template <bool CHROMA>
+IMGLIB_TARGET("ssse3") Channels128 ConvertSSSE3(__m128i pixels) {
+    const __m128i rg = _mm_shuffle_epi8(pixels, GetPairMask(0, 1));
+    const __m128i gb = _mm_shuffle_epi8(pixels, GetPairMask(1, 2));
+
+    Channels128 out;
+    out.y = _mm_add_epi32(_mm_madd_epi16(rg, GetWeightPair(Y_R, Y_G / 2)),
+                          _mm_madd_epi16(gb, GetWeightPair(Y_G / 2, Y_B)));
+    out.y = _mm_srai_epi32(_mm_add_epi32(out.y, _mm_set1_epi32(Y_ROUND)), 16);
+    if (CHROMA) {
+        const __m128i rr = _mm_shuffle_epi8(pixels, GetPairMask(0, 0));
+        const __m128i bb = _mm_shuffle_epi8(pixels, GetPairMask(2, 2));
+        const __m128i round = _mm_set1_epi32(CHROMA_ROUND);
+        out.cb = _mm_add_epi32(_mm_madd_epi16(rg, GetWeightPair(CB_R, CB_G)),
+                               _mm_madd_epi16(bb, GetWeightPair(CB_B / 2, CB_B / 2)));
+        out.cb = _mm_srai_epi32(_mm_add_epi32(out.cb, round), 16);
+        out.cr = _mm_add_epi32(_mm_madd_epi16(rr, GetWeightPair(CR_R / 2, CR_R / 2)),
+                               _mm_madd_epi16(gb, GetWeightPair(CR_G, CR_B)));
+        out.cr = _mm_srai_epi32(_mm_add_epi32(out.cr, round), 16);
+    }
+    return out;
+}
+
+// 16 значений в 32-битных словах в 16 байт
+IMGLIB_TARGET("ssse3") __m128i PackBytes(__m128i a, __m128i b, __m128i c, __m128i d) {
+    return _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+}
+
+template <bool CHROMA>
+IMGLIB_TARGET("ssse3") void RGBToYCbCrSSSE3(const Color* src, uint8_t* y, uint8_t* cb, uint8_t* cr, int count) {
+    int x = 0;
+    for (; x + 16 <= count; x += 16) {
+        Channels128 c[4];
+        for (int i = 0; i < 4; ++i) {
+            c[i] = ConvertSSSE3<CHROMA>(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x + i * 4)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y + x), PackBytes(c[0].y, c[1].y, c[2].y, c[3].y));
+        if (CHROMA) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(cb + x), PackBytes(c[0].cb, c[1].cb, c[2].cb, c[3].cb));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(cr + x), PackBytes(c[0].cr, c[1].cr, c[2].cr, c[3].cr));
+        }
+    }
+    RGBToYCbCrScalar<CHROMA>(src + x, y + x, cb + x, cr + x, count - x);
+}
+
+// канал 8 пикселей: яркость в 32-битных словах плюс поправка по парам
+// (Cb - 128, Cr - 128), сведённая к 8 байтам с насыщением
+IMGLIB_TARGET("ssse3") __m128i GetChannelSSSE3(__m128i luma_lo, __m128i luma_hi,
+                                               __m128i uv_lo, __m128i uv_hi, __m128i weights) {
+    const __m128i round = _mm_set1_epi32(INV_ROUND);
+    const __m128i lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(uv_lo, weights), round), INV_SHIFT);
+    const __m128i hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(uv_hi, weights), round), INV_SHIFT);
+    const __m128i value = _mm_packs_epi32(_mm_add_epi32(luma_lo, lo), _mm_add_epi32(luma_hi, hi));
+    return _mm_packus_epi16(value, value);
+}
+
+// 8 пикселей за итерацию: Cb и Cr чередуются парами 16-битных отсчётов,
+// и один _mm_madd_epi16 даёт поправку канала сразу для 4 пикселей
+IMGLIB_TARGET("ssse3") void YCbCrToRGBSSSE3(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, Color* dst, int count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i r_weights = GetWeightPair(0, R_CR);
+    const __m128i g_weights = GetWeightPair(G_CB, G_CR);
+    const __m128i b_weights = GetWeightPair(B_CB, 0);
+    const __m128i alpha = _mm_set1_epi8(-1);
+
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        const __m128i luma = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + x)), zero);
+        const __m128i luma_lo = _mm_unpacklo_epi16(luma, zero);
+        const __m128i luma_hi = _mm_unpackhi_epi16(luma, zero);
+        const __m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(cb + x)),
+                                             _mm_loadl_epi64(reinterpret_cast<const __m128i*>(cr + x)));
+        const __m128i uv_lo = _mm_sub_epi16(_mm_unpacklo_epi8(uv, zero), bias);
+        const __m128i uv_hi = _mm_sub_epi16(_mm_unpackhi_epi8(uv, zero), bias);
+
+        const __m128i r = GetChannelSSSE3(luma_lo, luma_hi, uv_lo, uv_hi, r_weights);
+        const __m128i g = GetChannelSSSE3(luma_lo, luma_hi, uv_lo, uv_hi, g_weights);
+        const __m128i b = GetChannelSSSE3(luma_lo, luma_hi, uv_lo, uv_hi, b_weights);
+
+        const __m128i rg = _mm_unpacklo_epi8(r, g);
+        const __m128i ba = _mm_unpacklo_epi8(b, alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x + 4), _mm_unpackhi_epi16(rg, ba));
+    }
+    YCbCrToRGBScalar(y + x, cb + x, cr + x, dst + x, count - x);
+}
+
+struct Channels256 {
+    __m256i y;
+    __m256i cb;
+    __m256i cr;
+};
+
+IMGLIB_TARGET("avx2") __m256i GetWeightPair256(int first, int second) {
+    return _mm256_broadcastsi128_si256(GetWeightPair(first, second));
+}
+
+template <bool CHROMA>
+IMGLIB_TARGET("avx2") Channels256 ConvertAVX2(__m256i pixels) {
+    // pshufb работает внутри 128-битных половин, а в каждой из них по 4 пикселя
+    const __m256i rg = _mm256_shuffle_epi8(pixels, _mm256_broadcastsi128_si256(GetPairMask(0, 1)));
+    const __m256i gb = _mm256_shuffle_epi8(pixels, _mm256_broadcastsi128_si256(GetPairMask(1, 2)));
+
+    Channels256 out;
+    out.y = _mm256_add_epi32(_mm256_madd_epi16(rg, GetWeightPair256(Y_R, Y_G / 2)),
+                             _mm256_madd_epi16(gb, GetWeightPair256(Y_G / 2, Y_B)));
+    out.y = _mm256_srai_epi32(_mm256_add_epi32(out.y, _mm256_set1_epi32(Y_ROUND)), 16);
+    if (CHROMA) {
+        const __m256i rr = _mm256_shuffle_epi8(pixels, _mm256_broadcastsi128_si256(GetPairMask(0, 0)));
+        const __m256i bb = _mm256_shuffle_epi8(pixels, _mm256_broadcastsi128_si256(GetPairMask(2, 2)));
+        const __m256i round = _mm256_set1_epi32(CHROMA_ROUND);
+        out.cb = _mm256_add_epi32(_mm256_madd_epi16(rg, GetWeightPair256(CB_R, CB_G)),
+                                  _mm256_madd_epi16(bb, GetWeightPair256(CB_B / 2, CB_B / 2)));
+        out.cb = _mm256_srai_epi32(_mm256_add_epi32(out.cb, round), 16);
+        out.cr = _mm256_add_epi32(_mm256_madd_epi16(rr, GetWeightPair256(CR_R / 2, CR_R / 2)),
+                                  _mm256_madd_epi16(gb, GetWeightPair256(CR_G, CR_B)));
+        out.cr = _mm256_srai_epi32(_mm256_add_epi32(out.cr, round), 16);
+    }
+    return out;
+}
+
+// упаковка чередует 128-битные половины, поэтому 4-байтовые группы
+// результата возвращаются на места перестановкой
+IMGLIB_TARGET("avx2") __m256i PackBytes(__m256i a, __m256i b, __m256i c, __m256i d) {
+    const __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+    return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+template <bool CHROMA>
+IMGLIB_TARGET("avx2") void RGBToYCbCrAVX2(const Color* src, uint8_t* y, uint8_t* cb, uint8_t* cr, int count) {
+    int x = 0;
+    for (; x + 32 <= count; x += 32) {
+        Channels256 c[4];
+        for (int i = 0; i < 4; ++i) {
+            c[i] = ConvertAVX2<CHROMA>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x + i * 8)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + x), PackBytes(c[0].y, c[1].y, c[2].y, c[3].y));
+        if (CHROMA) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(cb + x), PackBytes(c[0].cb, c[1].cb, c[2].cb, c[3].cb));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(cr + x), PackBytes(c[0].cr, c[1].cr, c[2].cr, c[3].cr));
+        }
+    }
+    RGBToYCbCrSSSE3<CHROMA>(src + x, y + x, cb + x, cr + x, count - x);
+}
+
+IMGLIB_TARGET("avx2") __m256i GetChannelAVX2(__m256i luma_lo, __m256i luma_hi,
+                                             __m256i uv_lo, __m256i uv_hi, __m256i weights) {
+    const __m256i round = _mm256_set1_epi32(INV_ROUND);
+    const __m256i lo = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(uv_lo, weights), round), INV_SHIFT);
+    const __m256i hi = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(uv_hi, weights), round), INV_SHIFT);
+    const __m256i value = _mm256_packs_epi32(_mm256_add_epi32(luma_lo, lo), _mm256_add_epi32(luma_hi, hi));
+    return _mm256_max_epi16(_mm256_min_epi16(value, _mm256_set1_epi16(255)), _mm256_setzero_si256());
+}
+
+// 16 пикселей за итерацию. после _mm256_packs_epi32 половины регистра
+// держат пиксели 0-3, 8-11 и 4-7, 12-15, и чередование 16-битных пар
+// внутри половин собирает из них пиксели 0-7 и 8-15 по порядку
+IMGLIB_TARGET("avx2") void YCbCrToRGBAVX2(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, Color* dst, int count) {
+    const __m256i bias = _mm256_set1_epi16(128);
+    const __m256i r_weights = GetWeightPair256(0, R_CR);
+    const __m256i g_weights = GetWeightPair256(G_CB, G_CR);
+    const __m256i b_weights = GetWeightPair256(B_CB, 0);
+    const __m256i alpha = _mm256_set1_epi16(static_cast<short>(0xFF00));
+
+    int x = 0;
+    for (; x + 16 <= count; x += 16) {
+        const __m128i luma = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x));
+        const __m256i luma_lo = _mm256_cvtepu8_epi32(luma);
+        const __m256i luma_hi = _mm256_cvtepu8_epi32(_mm_srli_si128(luma, 8));
+        const __m128i u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cb + x));
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cr + x));
+        const __m256i uv_lo = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(u, v)), bias);
+        const __m256i uv_hi = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpackhi_epi8(u, v)), bias);
+
+        const __m256i r = GetChannelAVX2(luma_lo, luma_hi, uv_lo, uv_hi, r_weights);
+        const __m256i g = GetChannelAVX2(luma_lo, luma_hi, uv_lo, uv_hi, g_weights);
+        const __m256i b = GetChannelAVX2(luma_lo, luma_hi, uv_lo, uv_hi, b_weights);
+
+        const __m256i rg = _mm256_or_si256(r, _mm256_slli_epi16(g, 8));
+        const __m256i ba = _mm256_or_si256(b, alpha);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), _mm256_unpacklo_epi16(rg, ba));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x + 8), _mm256_unpackhi_epi16(rg, ba));
+    }
+    YCbCrToRGBSSSE3(y + x, cb + x, cr + x, dst + x, count - x);
+}
+
+#endif
+
+template <bool CHROMA>
+void ConvertToYCbCr(const Color* src, uint8_t* y, uint8_t* cb, uint8_t* cr, int count) {
+    IMGLIB_STATS_TIMER(COLOR_CONVERT);
+    switch (GetPackKernel()) {
+#ifdef IMGLIB_COLOR_X86
+        case PackKernel::AVX2:
+            return RGBToYCbCrAVX2<CHROMA>(src, y, cb, cr, count);
+        case PackKernel::SSSE3:
+            return RGBToYCbCrSSSE3<CHROMA>(src, y, cb, cr, count);
+#endif
+        default:
+            return RGBToYCbCrScalar<CHROMA>(src, y, cb, cr, count);
+    }
+}
+
+// HSV: обратные величины в масштабе 2^12, как в OpenCV
+constexpr int HSV_SHIFT = 12;
+constexpr int HSV_ROUND = 1 << (HSV_SHIFT - 1);
+constexpr int HUE_RANGE = 256;
+
+struct HSVTables {
+    HSVTables() {
+        saturation[0] = 0;
+        hue[0] = 0;
+        for (int i = 1; i < 256; ++i) {
+            saturation[i] = ((255 << HSV_SHIFT) + i / 2) / i;
+            hue[i] = ((HUE_RANGE << HSV_SHIFT) + 3 * i) / (6 * i);
+        }
+    }
+
+    // 255 / v и HUE_RANGE / (6 * (max - min))
+    array<int, 256> saturation;
+    array<int, 256> hue;
+};
+
+const HSVTables& GetHSVTables() {
+    static const HSVTables tables;
+    return tables;
+}
+
+// x / 255 с округлением для x от 0 до 65535
+int Div255(int x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+}  // namespace
+
+void RGBToYCbCr(const Color* src, uint8_t* y, uint8_t* cb, uint8_t* cr, int count) {
+    ConvertToYCbCr<true>(src, y, cb, cr, count);
+}
+
+void RGBToLuma(const Color* src, uint8_t* dst, int count) {
+    ConvertToYCbCr<false>(src, dst, nullptr, nullptr, count);
+}
+
+void YCbCrToRGB(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, Color* dst, int count) {
+    IMGLIB_STATS_TIMER(COLOR_CONVERT);
+    switch (GetPackKernel()) {
+#ifdef IMGLIB_COLOR_X86
+        case PackKernel::AVX2:
+            return YCbCrToRGBAVX2(y, cb, cr, dst, count);
+        case PackKernel::SSSE3:
+            return YCbCrToRGBSSSE3(y, cb, cr, dst, count);
+#endif
+        default:
+            return YCbCrToRGBScalar(y, cb, cr, dst, count);
+    }
+}
+
+// тон считается по каналу-максимуму: масками vr и vg выбирается одна из трёх
+// разностей, поэтому цикл обходится без ветвлений
+void RGBToHSV(const Color* src, uint8_t* h, uint8_t* s, uint8_t* v, int count) {
+    IMGLIB_STATS_TIMER(COLOR_CONVERT);
+    const HSVTables& tables = GetHSVTables();
+    for (int x = 0; x < count; ++x) {
+        const int r = to_integer<int>(src[x].r);
+        const int g = to_integer<int>(src[x].g);
+        const int b = to_integer<int>(src[x].b);
+        const int value = max(max(r, g), b);
+        const int diff = value - min(min(r, g), b);
+        const int vr = value == r ? -1 : 0;
+        const int vg = value == g ? -1 : 0;
+
+        int hue = (vr & (g - b)) + (~vr & ((vg & (b - r + 2 * diff)) + (~vg & (r - g + 4 * diff))));
+        hue = (hue * tables.hue[diff] + HSV_ROUND) >> HSV_SHIFT;
+        hue += hue < 0 ? HUE_RANGE : 0;
+
+        h[x] = static_cast<uint8_t>(hue);
+        s[x] = static_cast<uint8_t>((diff * tables.saturation[value] + HSV_ROUND) >> HSV_SHIFT);
+        v[x] = static_cast<uint8_t>(value);
+    }
+}
+
+void HSVToRGB(const uint8_t* h, const uint8_t* s, const uint8_t* v, Color* dst, int count) {
+    IMGLIB_STATS_TIMER(COLOR_CONVERT);
+    for (int x = 0; x < count; ++x) {
+        // шестая часть круга и положение внутри неё в 1/256
+        const int hue = h[x] * 6;
+        const int sector = hue >> 8;
+        const int fraction = hue & 255;
+        const int value = v[x];
+        const int saturation = s[x];
+
+        const int p = Div255(value * (255 - saturation));
+        const int q = Div255(value * (255 - Div255(saturation * fraction)));
+        const int t = Div255(value * (255 - Div255(saturation * (255 - fraction))));
+
+        int r, g, b;
+        switch (sector) {
+            case 0:
+                r = value, g = t, b = p;
+                break;
+            case 1:
+                r = q, g = value, b = p;
+                break;
+            case 2:
+                r = p, g = value, b = t;
+                break;
+            case 3:
+                r = p, g = q, b = value;
+                break;
+            case 4:
+                r = t, g = p, b = value;
+                break;
+            default:
+                r = value, g = p, b = q;
+                break;
+        }
+        dst[x] = {static_cast<std::byte>(r), static_cast<std::byte>(g), static_cast<std::byte>(b), std::byte{255}};
+    }
+}
+
+namespace {
+
+template <typename Planes>
+Planes MakePlanes(int w, int h) {
+    Planes result;
+    for (GrayImage& plane : result.planes) {
+        plane = GrayImage(w, h);
+    }
+    return result;
+}
+
+bool HasEqualPlanes(const ColorPlanes& planes) {
+    const int w = planes.GetWidth();
+    const int h = planes.GetHeight();
+    for (const GrayImage& plane : planes.planes) {
+        if (plane.GetWidth() != w || plane.GetHeight() != h) {
+            return false;
+        }
+    }
+    return w > 0 && h > 0;
+}
+
+// RowFunc(const Color*, uint8_t*, uint8_t*, uint8_t*, int)
+template <typename Planes, typename RowFunc>
+Planes SplitImage(const Image& image, RowFunc row_func) {
+    if (!image) {
+        return {};
+    }
+    const int w = image.GetWidth();
+    Planes result = MakePlanes<Planes>(w, image.GetHeight());
+    ForEachRow(image, [&](int y, const Color* line) {
+        row_func(line, result.planes[0].GetLine(y), result.planes[1].GetLine(y), result.planes[2].GetLine(y), w);
+    });
+    return result;
+}
+
+// RowFunc(const uint8_t*, const uint8_t*, const uint8_t*, Color*, int)
+template <typename RowFunc>
+Image MergePlanes(const ColorPlanes& planes, RowFunc row_func) {
+    if (!HasEqualPlanes(planes)) {
+        return {};
+    }
+    const int w = planes.GetWidth();
+    Image result = AcquireImage(w, planes.GetHeight());
+    ForEachRow(result, [&](int y, Color* line) {
+        row_func(planes.planes[0].GetLine(y), planes.planes[1].GetLine(y), planes.planes[2].GetLine(y), line, w);
+    });
+    return result;
+}
+
+// во сколько раз прорежен канал размером chroma_size относительно luma_size;
+// 0, если размер не получается делением с округлением вверх
+int GetSubsampling(int luma_size, int chroma_size) {
+    if (chroma_size <= 0) {
+        return 0;
+    }
+    const int factor = (luma_size + chroma_size - 1) / chroma_size;
+    return (luma_size + factor - 1) / factor == chroma_size ? factor : 0;
+}
+
+void UpsampleRow(const uint8_t* src, uint8_t* dst, int width, int factor) {
+    for (int x = 0; x < width; ++x) {
+        dst[x] = src[x / factor];
+    }
+}
+
+}  // namespace
+
+YCbCrImage ImageToYCbCr(const Image& image) {
+    return SplitImage<YCbCrImage>(image, RGBToYCbCr);
+}
+
+Image YCbCrToImage(const YCbCrImage& ycbcr) {
+    const int w = ycbcr.GetWidth();
+    const int h = ycbcr.GetHeight();
+    const GrayImage& cb = ycbcr.Cb();
+    const GrayImage& cr = ycbcr.Cr();
+    if (w <= 0 || h <= 0 || cb.GetWidth() != cr.GetWidth() || cb.GetHeight() != cr.GetHeight()) {
+        return {};
+    }
+    const int x_factor = GetSubsampling(w, cb.GetWidth());
+    const int y_factor = GetSubsampling(h, cb.GetHeight());
+    if (x_factor == 0 || y_factor == 0) {
+        return {};
+    }
+    if (x_factor == 1 && y_factor == 1) {
+        return MergePlanes(ycbcr, YCbCrToRGB);
+    }
+
+    // строки Cb и Cr растягиваются во временные буферы, по паре на полосу
+    Image result = AcquireImage(w, h);
+    result.Detach();
+    ParallelRows(h, static_cast<size_t>(w) * sizeof(Color), [&](int first, int last) {
+        vector<uint8_t> cb_row(w);
+        vector<uint8_t> cr_row(w);
+        int chroma_y = -1;
+        for (int y = first; y < last; ++y) {
+            if (y / y_factor != chroma_y) {
+                chroma_y = y / y_factor;
+                UpsampleRow(cb.GetLine(chroma_y), cb_row.data(), w, x_factor);
+                UpsampleRow(cr.GetLine(chroma_y), cr_row.data(), w, x_factor);
+            }
+            YCbCrToRGB(ycbcr.Y().GetLine(y), cb_row.data(), cr_row.data(), result.GetLine(y), w);
+        }
+    }, GetPixelThreadPool());
+    return result;
+}
+
+HSVImage ImageToHSV(const Image& image) {
+    return SplitImage<HSVImage>(image, RGBToHSV);
+}
+
+Image HSVToImage(const HSVImage& hsv) {
+    return MergePlanes(hsv, HSVToRGB);
+}
+
+}  // namespace img_lib
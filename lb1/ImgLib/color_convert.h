@@ -0,0 +1,105 @@
+#pragma once
+#include "gray_image.h"
+#include "img_lib.h"
+
+#include <cstdint>
+
+namespace img_lib {
+
+// преобразования цветовых пространств в целочисленной арифметике.
+// строковые функции выполняются тем же ядром, что и упаковка пикселей
+// (см. GetPackKernel), и дают одинаковый результат на всех ядрах.
+//
+// YCbCr - полный диапазон 0..255 по JFIF (BT.601), как внутри JPEG:
+// яркость с весами 0.299, 0.587, 0.114, цветоразностные каналы смещены на 128.
+// прямое преобразование идёт в масштабе 2^16, обратное - в масштабе 2^14,
+// поэтому с цветовым преобразованием LibJPEG результат может расходиться на 1
+void RGBToYCbCr(const Color* src, std::uint8_t* y, std::uint8_t* cb, std::uint8_t* cr, int count);
+// альфа-канал заполняется значением 255
+void YCbCrToRGB(const std::uint8_t* y, const std::uint8_t* cb, const std::uint8_t* cr, Color* dst, int count);
+
+// только яркостный канал YCbCr; совпадает с ImageToGray
+void RGBToLuma(const Color* src, std::uint8_t* dst, int count);
+
+// HSV в 8-битных отсчётах: тон h проходит полный круг за 256 шагов
+// (0 - красный, около 85 - зелёный, около 171 - синий), насыщенность s
+// и яркость v - 0..255. деление заменено умножением на табличные обратные величины
+void RGBToHSV(const Color* src, std::uint8_t* h, std::uint8_t* s, std::uint8_t* v, int count);
+// альфа-канал заполняется значением 255
+void HSVToRGB(const std::uint8_t* h, const std::uint8_t* s, const std::uint8_t* v, Color* dst, int count);
+
+// три плоскости одного размера; для YCbCr - Y, Cb, Cr, для HSV - H, S, V
+struct ColorPlanes {
+    GrayImage planes[3];
+
+    int GetWidth() const {
+        return planes[0].GetWidth();
+    }
+
+    int GetHeight() const {
+        return planes[0].GetHeight();
+    }
+
+    explicit operator bool() const {
+        return static_cast<bool>(planes[0]);
+    }
+
+    bool operator!() const {
+        return !operator bool();
+    }
+};
+
+// Cb и Cr могут быть меньше Y в целое число раз по каждой оси, как
+// прореженные каналы JPEG; YCbCrToImage размножает их отсчёты на соседние пиксели
+struct YCbCrImage : ColorPlanes {
+    GrayImage& Y() {
+        return planes[0];
+    }
+    GrayImage& Cb() {
+        return planes[1];
+    }
+    GrayImage& Cr() {
+        return planes[2];
+    }
+    const GrayImage& Y() const {
+        return planes[0];
+    }
+    const GrayImage& Cb() const {
+        return planes[1];
+    }
+    const GrayImage& Cr() const {
+        return planes[2];
+    }
+};
+
+struct HSVImage : ColorPlanes {
+    GrayImage& H() {
+        return planes[0];
+    }
+    GrayImage& S() {
+        return planes[1];
+    }
+    GrayImage& V() {
+        return planes[2];
+    }
+    const GrayImage& H() const {
+        return planes[0];
+    }
+    const GrayImage& S() const {
+        return planes[1];
+    }
+    const GrayImage& V() const {
+        return planes[2];
+    }
+};
+
+// преобразования целых изображений; строки обрабатываются параллельно
+// в общем пуле. ImageToYCbCr не прореживает каналы. плоскости
+// неподходящего размера дают пустое изображение
+YCbCrImage ImageToYCbCr(const Image& image);
+Image YCbCrToImage(const YCbCrImage& ycbcr);
+
+HSVImage ImageToHSV(const Image& image);
+Image HSVToImage(const HSVImage& hsv);
+
+}  // namespace img_lib
@@ -0,0 +1,136 @@
+#include "content_hash.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace img_lib {
+
+namespace {
+
+constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t PRIME_3 = 0x165667B19E3779F9ull;
+constexpr uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t PRIME_5 = 0x27D4EB2F165667C5ull;
+
+uint64_t RotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// XXH64 определён для порядка байт little-endian, как и остальные форматы ImgLib
+uint64_t Read64(const unsigned char* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t Read32(const unsigned char* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint64_t Round(uint64_t lane, uint64_t input) {
+    lane += input * PRIME_2;
+    lane = RotateLeft(lane, 31);
+    return lane * PRIME_1;
+}
+
+uint64_t MergeRound(uint64_t hash, uint64_t lane) {
+    hash ^= Round(0, lane);
+    return hash * PRIME_1 + PRIME_4;
+}
+
+// обрабатывает 32-байтовую полосу: по 8 байт на каждую из четырёх дорожек
+void ProcessStripe(uint64_t* lanes, const unsigned char* p) {
+    lanes[0] = Round(lanes[0], Read64(p));
+    lanes[1] = Round(lanes[1], Read64(p + 8));
+    lanes[2] = Round(lanes[2], Read64(p + 16));
+    lanes[3] = Round(lanes[3], Read64(p + 24));
+}
+
+}  // namespace
+
+Hasher64::Hasher64(uint64_t seed)
+    : lanes_{seed + PRIME_1 + PRIME_2, seed + PRIME_2, seed, seed - PRIME_1}
+    , seed_(seed) {
+}
+
+void Hasher64::Update(ByteSpan data) {
+    const auto* p = reinterpret_cast<const unsigned char*>(data.data);
+    size_t size = data.size;
+    total_size_ += size;
+
+    // сначала дополняется начатая полоса
+    if (buffered_ > 0) {
+        const size_t count = min(size, sizeof(buffer_) - buffered_);
+        memcpy(buffer_ + buffered_, p, count);
+        buffered_ += count;
+        p += count;
+        size -= count;
+        if (buffered_ < sizeof(buffer_)) {
+            return;
+        }
+        ProcessStripe(lanes_, buffer_);
+        buffered_ = 0;
+    }
+
+    for (; size >= sizeof(buffer_); p += sizeof(buffer_), size -= sizeof(buffer_)) {
+        ProcessStripe(lanes_, p);
+    }
+
+    if (size > 0) {
+        memcpy(buffer_, p, size);
+        buffered_ = size;
+    }
+}
+
+uint64_t Hasher64::GetHash() const {
+    uint64_t hash;
+    if (total_size_ >= sizeof(buffer_)) {
+        hash = RotateLeft(lanes_[0], 1) + RotateLeft(lanes_[1], 7)
+            + RotateLeft(lanes_[2], 12) + RotateLeft(lanes_[3], 18);
+        for (const uint64_t lane : lanes_) {
+            hash = MergeRound(hash, lane);
+        }
+    } else {
+        hash = seed_ + PRIME_5;
+    }
+    hash += total_size_;
+
+    // хвост короче полосы
+    const unsigned char* p = buffer_;
+    size_t size = buffered_;
+    for (; size >= 8; p += 8, size -= 8) {
+        hash ^= Round(0, Read64(p));
+        hash = RotateLeft(hash, 27) * PRIME_1 + PRIME_4;
+    }
+    if (size >= 4) {
+        hash ^= Read32(p) * PRIME_1;
+        hash = RotateLeft(hash, 23) * PRIME_2 + PRIME_3;
+        p += 4;
+        size -= 4;
+    }
+    for (; size > 0; ++p, --size) {
+        hash ^= *p * PRIME_5;
+        hash = RotateLeft(hash, 11) * PRIME_1;
+    }
+
+    // перемешивание, чтобы каждый бит входа влиял на все биты результата
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+uint64_t Hash64(ByteSpan data, uint64_t seed) {
+    Hasher64 hasher(seed);
+    hasher.Update(data);
+    return hasher.GetHash();
+}
+
+}  // namespace img_lib
@@ -0,0 +1,36 @@
+#pragma once
+#include "img_lib.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace img_lib {
+
+// 64-битный некриптографический хеш по алгоритму XXH64: значения совпадают
+// с эталонной реализацией xxHash. подходит для поиска одинаковых данных,
+// но не для защиты от намеренно подобранных коллизий
+class Hasher64 {
+public:
+    explicit Hasher64(std::uint64_t seed = 0);
+
+    // данные можно подавать частями любого размера
+    void Update(ByteSpan data);
+    void Update(const void* data, size_t size) {
+        Update(ByteSpan{static_cast<const std::byte*>(data), size});
+    }
+
+    // хеш всех поданных данных; состояние не меняется
+    std::uint64_t GetHash() const;
+
+private:
+    std::uint64_t lanes_[4];
+    std::uint64_t seed_;
+    std::uint64_t total_size_ = 0;
+    // неполная 32-байтовая полоса, ожидающая продолжения
+    unsigned char buffer_[32];
+    size_t buffered_ = 0;
+};
+
+std::uint64_t Hash64(ByteSpan data, std::uint64_t seed = 0);
+
+}  // namespace img_lib
@@ -0,0 +1,35 @@
+#include "gray_image.h"
+#include "color_convert.h"
+
+namespace img_lib {
+
+Image GrayToImage(const GrayImage& gray) {
+    const int w = gray.GetWidth();
+    const int h = gray.GetHeight();
+    Image result(w, h);
+
+    for (int y = 0; y < h; ++y) {
+        const std::uint8_t* src = gray.GetLine(y);
+        Color* dst = result.GetLine(y);
+        for (int x = 0; x < w; ++x) {
+            const std::byte value{src[x]};
+            dst[x] = {value, value, value, std::byte{255}};
+        }
+    }
+
+    return result;
+}
+
+GrayImage ImageToGray(const Image& image) {
+    const int w = image.GetWidth();
+    const int h = image.GetHeight();
+    GrayImage result(w, h);
+
+    for (int y = 0; y < h; ++y) {
+        RGBToLuma(image.GetLine(y), result.GetLine(y), w);
+    }
+
+    return result;
+}
+
+}  // namespace img_lib
@@ -0,0 +1,100 @@
+#pragma once
+#include "img_lib.h"
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+namespace img_lib {
+
+// одноканальное изображение (оттенки серого, карта глубины, маска):
+// один отсчёт на пиксель, без расширения до 4-байтного Color
+template <typename Sample>
+class BasicGrayImage {
+public:
+    using Buffer = std::vector<Sample, AlignedAllocator<Sample, IMAGE_ROW_ALIGNMENT>>;
+
+    // создаёт пустое изображение
+    BasicGrayImage() = default;
+
+    // создаёт изображение заданного размера, заполняя его заданным значением
+    BasicGrayImage(int w, int h, Sample fill)
+        : width_(w)
+        , height_(h)
+        , step_(GetAlignedStep(w))
+        , samples_(static_cast<size_t>(step_) * height_, fill) {
+    }
+
+    // создаёт изображение заданного размера без заполнения;
+    // содержимое отсчётов не определено
+    BasicGrayImage(int w, int h)
+        : width_(w)
+        , height_(h)
+        , step_(GetAlignedStep(w)) {
+        // resize не заполняет новые отсчёты, см. AlignedAllocator::construct
+        samples_.resize(static_cast<size_t>(step_) * height_);
+    }
+
+    // шаг строки для ширины w: каждая строка начинается
+    // на границе IMAGE_ROW_ALIGNMENT байт
+    static int GetAlignedStep(int w) {
+        constexpr int samples_per_alignment = IMAGE_ROW_ALIGNMENT / sizeof(Sample);
+        return (w + samples_per_alignment - 1) / samples_per_alignment * samples_per_alignment;
+    }
+
+    Sample GetPixel(int x, int y) const {
+        return const_cast<BasicGrayImage*>(this)->GetPixel(x, y);
+    }
+    Sample& GetPixel(int x, int y) {
+        assert(x < GetWidth() && y < GetHeight() && x >= 0 && y >= 0);
+        return GetLine(y)[x];
+    }
+
+    Sample* GetLine(int y) {
+        assert(y >= 0 && y < height_);
+        return samples_.data() + static_cast<size_t>(step_) * y;
+    }
+    const Sample* GetLine(int y) const {
+        return const_cast<BasicGrayImage*>(this)->GetLine(y);
+    }
+
+    int GetWidth() const {
+        return width_;
+    }
+    int GetHeight() const {
+        return height_;
+    }
+
+    // шаг в отсчётах между соседними строками
+    int GetStep() const {
+        return step_;
+    }
+
+    explicit operator bool() const {
+        return GetWidth() > 0 && GetHeight() > 0;
+    }
+
+    bool operator!() const {
+        return !operator bool();
+    }
+
+private:
+    int width_ = 0;
+    int height_ = 0;
+    int step_ = 0;
+
+    Buffer samples_;
+};
+
+// 8-битные отсчёты - маски и обычные оттенки серого
+using GrayImage = BasicGrayImage<std::uint8_t>;
+// 16-битные отсчёты в порядке байтов машины - карты глубины
+using GrayImage16 = BasicGrayImage<std::uint16_t>;
+
+// размножает отсчёт на каналы R, G, B; альфа непрозрачна
+Image GrayToImage(const GrayImage& gray);
+
+// яркость по весам BT.601 в целочисленной арифметике
+GrayImage ImageToGray(const Image& image);
+
+}  // namespace img_lib
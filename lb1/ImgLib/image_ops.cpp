@@ -0,0 +1,110 @@
+#include "image_ops.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+namespace img_lib {
+
+// полоса меньше этого размера не окупает передачу в другой поток
+static const size_t MIN_CHUNK_BYTES = size_t{256} << 10;
+// полос на поток: запас, чтобы выровнять нагрузку при неравных потоках
+static const size_t CHUNKS_PER_THREAD = 4;
+
+namespace {
+
+// общее состояние вызова ParallelRows. задачи пула держат его через
+// shared_ptr: задача, запущенная после возврата из ParallelRows, находит
+// все полосы разобранными и завершается, не вызывая func
+struct RowJob {
+    RowRangeFunc func;
+    int height = 0;
+    int rows_per_chunk = 0;
+    int chunk_count = 0;
+    atomic<int> next_chunk{0};
+
+    mutex done_mutex;
+    condition_variable all_done;
+    int done_chunks = 0;
+
+    // выполняет полосы, пока они не кончатся
+    void Run() {
+        int completed = 0;
+        for (int chunk = next_chunk.fetch_add(1); chunk < chunk_count; chunk = next_chunk.fetch_add(1)) {
+            const int first = chunk * rows_per_chunk;
+            func(first, min(height, first + rows_per_chunk));
+            ++completed;
+        }
+        if (completed > 0) {
+            lock_guard lock(done_mutex);
+            done_chunks += completed;
+            if (done_chunks == chunk_count) {
+                all_done.notify_all();
+            }
+        }
+    }
+};
+
+}  // namespace
+
+void ParallelRows(int height, size_t row_bytes, const RowRangeFunc& func, ThreadPool& pool) {
+    if (height <= 0) {
+        return;
+    }
+
+    const size_t total_bytes = max<size_t>(row_bytes, 1) * height;
+    const size_t max_chunks = pool.GetThreadCount() * CHUNKS_PER_THREAD;
+    const size_t chunk_count = min({max_chunks, total_bytes / MIN_CHUNK_BYTES, static_cast<size_t>(height)});
+    if (chunk_count <= 1 || pool.GetThreadCount() <= 1) {
+        func(0, height);
+        return;
+    }
+
+    auto job = make_shared<RowJob>();
+    // ссылки в func остаются в силе до возврата: после него func не вызывается
+    job->func = func;
+    job->height = height;
+    job->rows_per_chunk = static_cast<int>((height + chunk_count - 1) / chunk_count);
+    job->chunk_count = (height + job->rows_per_chunk - 1) / job->rows_per_chunk;
+
+    const size_t helpers = min(pool.GetThreadCount(), static_cast<size_t>(job->chunk_count) - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        pool.Submit([job] {
+            job->Run();
+        });
+    }
+    job->Run();
+
+    unique_lock lock(job->done_mutex);
+    job->all_done.wait(lock, [&job] {
+        return job->done_chunks == job->chunk_count;
+    });
+}
+
+ThreadPool& GetPixelThreadPool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void Fill(Image& image, Color color, ThreadPool& pool) {
+    const int w = image.GetWidth();
+    ForEachRow(image, [w, color](int, Color* line) {
+        fill_n(line, w, color);
+    }, pool);
+}
+
+bool Copy(const Image& src, Image& dst, ThreadPool& pool) {
+    if (src.GetWidth() != dst.GetWidth() || src.GetHeight() != dst.GetHeight()) {
+        return false;
+    }
+    const size_t row_bytes = static_cast<size_t>(src.GetWidth()) * sizeof(Color);
+    ForEachRow(dst, [row_bytes, &src](int y, Color* line) {
+        memcpy(line, src.GetLine(y), row_bytes);
+    }, pool);
+    return true;
+}
+
+}  // namespace img_lib
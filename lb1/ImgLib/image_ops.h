@@ -0,0 +1,85 @@
+#pragma once
+
+#include "img_lib.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+
+namespace img_lib {
+
+// обрабатывает строки [first, last)
+using RowRangeFunc = std::function<void(int first, int last)>;
+
+// делит height строк по row_bytes байт на полосы и выполняет их в пуле потоков.
+// вызывающий поток тоже берёт полосы и не ждёт задач, до которых не дошла
+// очередь, поэтому вызов безопасен и из задачи того же пула. небольшие
+// изображения обрабатываются целиком в вызывающем потоке.
+// func вызывается одновременно из нескольких потоков и не должна бросать исключений
+void ParallelRows(int height, size_t row_bytes, const RowRangeFunc& func, ThreadPool& pool);
+
+// общий пул потоков для операций над пикселями, по потоку на ядро
+ThreadPool& GetPixelThreadPool();
+
+// вызывает func(y, line) для каждой строки изображения
+template <typename Func>
+void ForEachRow(Image& image, Func func, ThreadPool& pool = GetPixelThreadPool()) {
+    // общий буфер отделяется до запуска потоков, а не в каждом из них
+    image.Detach();
+    ParallelRows(image.GetHeight(), static_cast<size_t>(image.GetWidth()) * sizeof(Color),
+                 [&image, &func](int first, int last) {
+                     for (int y = first; y < last; ++y) {
+                         func(y, image.GetLine(y));
+                     }
+                 }, pool);
+}
+
+template <typename Func>
+void ForEachRow(const Image& image, Func func, ThreadPool& pool = GetPixelThreadPool()) {
+    ParallelRows(image.GetHeight(), static_cast<size_t>(image.GetWidth()) * sizeof(Color),
+                 [&image, &func](int first, int last) {
+                     for (int y = first; y < last; ++y) {
+                         func(y, image.GetLine(y));
+                     }
+                 }, pool);
+}
+
+// заменяет каждый пиксель на func(pixel). внутренний цикл идёт по строке
+// без ветвлений, и встроенный func компилятор может векторизовать
+template <typename Func>
+void Transform(Image& image, Func func, ThreadPool& pool = GetPixelThreadPool()) {
+    const int w = image.GetWidth();
+    ForEachRow(image, [w, &func](int, Color* line) {
+        for (int x = 0; x < w; ++x) {
+            line[x] = func(line[x]);
+        }
+    }, pool);
+}
+
+// записывает в dst пиксели func(pixel) из src; размеры должны совпадать
+template <typename Func>
+bool Transform(const Image& src, Image& dst, Func func, ThreadPool& pool = GetPixelThreadPool()) {
+    if (src.GetWidth() != dst.GetWidth() || src.GetHeight() != dst.GetHeight()) {
+        return false;
+    }
+    const int w = src.GetWidth();
+    ForEachRow(dst, [w, &src, &func](int y, Color* line) {
+        const Color* in = src.GetLine(y);
+        for (int x = 0; x < w; ++x) {
+            line[x] = func(in[x]);
+        }
+    }, pool);
+    return true;
+}
+
+// заполняет изображение цветом; в отличие от конструктора Image(w, h, fill)
+// работает на всех ядрах. Image(w, h) с последующим Fill не трогает
+// страницы памяти дважды
+void Fill(Image& image, Color color, ThreadPool& pool = GetPixelThreadPool());
+
+// копирует пиксели src в dst; размеры должны совпадать, шаг строк может отличаться
+bool Copy(const Image& src, Image& dst, ThreadPool& pool = GetPixelThreadPool());
+
+}  // namespace img_lib
@@ -0,0 +1,83 @@
+#include "image_pool.h"
+
+using namespace std;
+
+namespace img_lib {
+
+static thread_local ImagePool* thread_image_pool = nullptr;
+
+ImagePool::ImagePool(size_t max_cached_bytes)
+    : max_cached_bytes_(max_cached_bytes) {
+}
+
+Image ImagePool::Acquire(int w, int h) {
+    const size_t pixel_count = static_cast<size_t>(Image::GetAlignedStep(w)) * h;
+    PixelBuffer buffer;
+    {
+        lock_guard lock(mutex_);
+        const auto bucket = buckets_.find(pixel_count);
+        if (bucket != buckets_.end() && !bucket->second.empty()) {
+            buffer = move(bucket->second.back());
+            bucket->second.pop_back();
+            cached_bytes_ -= buffer.capacity() * sizeof(Color);
+            ++hits_;
+        } else {
+            ++misses_;
+        }
+    }
+    return Image(w, h, move(buffer));
+}
+
+void ImagePool::Release(Image&& image) {
+    PixelBuffer buffer = image.ReleaseBuffer();
+    const size_t bytes = buffer.capacity() * sizeof(Color);
+    if (buffer.empty()) {
+        return;
+    }
+
+    lock_guard lock(mutex_);
+    if (cached_bytes_ + bytes > max_cached_bytes_) {
+        // буфер освобождается при выходе из функции
+        return;
+    }
+    cached_bytes_ += bytes;
+    buckets_[buffer.size()].push_back(move(buffer));
+}
+
+void ImagePool::Clear() {
+    lock_guard lock(mutex_);
+    buckets_.clear();
+    cached_bytes_ = 0;
+}
+
+size_t ImagePool::GetCachedBytes() const {
+    lock_guard lock(mutex_);
+    return cached_bytes_;
+}
+
+size_t ImagePool::GetHitCount() const {
+    lock_guard lock(mutex_);
+    return hits_;
+}
+
+size_t ImagePool::GetMissCount() const {
+    lock_guard lock(mutex_);
+    return misses_;
+}
+
+void SetThreadImagePool(ImagePool* pool) {
+    thread_image_pool = pool;
+}
+
+ImagePool* GetThreadImagePool() {
+    return thread_image_pool;
+}
+
+Image AcquireImage(int w, int h) {
+    if (thread_image_pool != nullptr) {
+        return thread_image_pool->Acquire(w, h);
+    }
+    return Image(w, h);
+}
+
+}  // namespace img_lib
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "img_lib.h"
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace img_lib {
+
+// пул буферов пикселей, разложенных по размеру.
+// пакетная обработка одинаковых по размеру кадров берёт память из пула
+// и возвращает её обратно, не обращаясь к malloc и не получая
+// новых page fault на каждое изображение
+class ImagePool {
+public:
+    // max_cached_bytes ограничивает объём памяти, удерживаемой пулом
+    explicit ImagePool(size_t max_cached_bytes = DEFAULT_MAX_CACHED_BYTES);
+
+    ImagePool(const ImagePool&) = delete;
+    ImagePool& operator=(const ImagePool&) = delete;
+
+    // выдаёт изображение заданного размера; содержимое пикселей не определено
+    Image Acquire(int w, int h);
+
+    // возвращает буфер изображения в пул; изображение становится пустым.
+    // если пул переполнен, буфер освобождается
+    void Release(Image&& image);
+
+    // освобождает все удерживаемые буферы
+    void Clear();
+
+    size_t GetCachedBytes() const;
+    size_t GetHitCount() const;
+    size_t GetMissCount() const;
+
+    static constexpr size_t DEFAULT_MAX_CACHED_BYTES = size_t{512} << 20;
+
+private:
+    mutable std::mutex mutex_;
+    // корзины по числу пикселей в буфере
+    std::map<size_t, std::vector<PixelBuffer>> buckets_;
+    size_t max_cached_bytes_;
+    size_t cached_bytes_ = 0;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+// пул, из которого декодеры текущего потока берут память для изображений;
+// nullptr (по умолчанию) означает обычное выделение памяти
+void SetThreadImagePool(ImagePool* pool);
+ImagePool* GetThreadImagePool();
+
+// выделяет изображение для декодера: из пула текущего потока, если он задан.
+// содержимое пикселей не определено
+Image AcquireImage(int w, int h);
+
+}  // namespace img_lib
@@ -0,0 +1,75 @@
+#include "image_probe.h"
+#include "bmp_image.h"
+#include "jpeg_image.h"
+#include "mapped_file.h"
+#include "png_image.h"
+#include "ppm_image.h"
+
+#include <array>
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+namespace img_lib {
+
+// самая короткая и самая длинная из проверяемых сигнатур
+static const size_t MIN_SIGNATURE_SIZE = 2;
+static const size_t SIGNATURE_SIZE = 8;
+
+ImageFormat DetectImageFormat(ByteSpan data) {
+    if (data.data == nullptr || data.size < MIN_SIGNATURE_SIZE) {
+        return ImageFormat::UNKNOWN;
+    }
+
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data.data);
+    if (bytes[0] == 0xFF && bytes[1] == 0xD8) {
+        return ImageFormat::JPEG;
+    }
+    if (bytes[0] == 'B' && bytes[1] == 'M') {
+        return ImageFormat::BMP;
+    }
+    if (bytes[0] == 'P' && (bytes[1] == '5' || bytes[1] == '6')) {
+        return ImageFormat::PPM;
+    }
+    static const unsigned char png_signature[] = {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A};
+    if (data.size >= sizeof(png_signature) && memcmp(bytes, png_signature, sizeof(png_signature)) == 0) {
+        return ImageFormat::PNG;
+    }
+    return ImageFormat::UNKNOWN;
+}
+
+ImageFormat DetectImageFormat(const Path& file) {
+    ifstream in(file, ios::binary);
+    array<char, SIGNATURE_SIZE> signature;
+    // файл может быть короче самой длинной сигнатуры
+    in.read(signature.data(), signature.size());
+    const size_t read = static_cast<size_t>(in.gcount());
+    return DetectImageFormat(ByteSpan{reinterpret_cast<const std::byte*>(signature.data()), read});
+}
+
+ImageInfo ProbeImage(ByteSpan data) {
+    switch (DetectImageFormat(data)) {
+        case ImageFormat::JPEG:
+            return ProbeJPEG(data);
+        case ImageFormat::PPM:
+            return ProbePPM(data);
+        case ImageFormat::BMP:
+            return ProbeBMP(data);
+        case ImageFormat::PNG:
+            return ProbePNG(data);
+        default:
+            return {};
+    }
+}
+
+ImageInfo ProbeImage(const Path& file) {
+    // отображение в память подгружает только страницы с заголовками
+    const MappedFile mapped(file);
+    if (!mapped) {
+        return {};
+    }
+    return ProbeImage(ByteSpan{mapped.GetData(), mapped.GetSize()});
+}
+
+}  // namespace img_lib
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "img_lib.h"
+
+#include <filesystem>
+
+namespace img_lib {
+using Path = std::filesystem::path;
+
+// определяет формат по сигнатуре в первых байтах данных
+ImageFormat DetectImageFormat(ByteSpan data);
+
+// читает из файла только сигнатуру и определяет по ней формат
+ImageFormat DetectImageFormat(const Path& file);
+
+// разбирает только заголовок изображения, не декодируя пиксели:
+// BitmapFileHeader/BitmapInfoHeader для BMP, заголовок P5 или P6 для PPM,
+// маркер SOF для JPEG. при ошибке возвращает пустые сведения
+ImageInfo ProbeImage(ByteSpan data);
+ImageInfo ProbeImage(const Path& file);
+
+}  // namespace img_lib
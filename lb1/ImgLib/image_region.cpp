@@ -0,0 +1,32 @@
+#include "image_region.h"
+#include "bmp_image.h"
+#include "image_probe.h"
+#include "jpeg_image.h"
+#include "png_image.h"
+#include "ppm_image.h"
+
+namespace img_lib {
+
+bool IsValidRegion(Size size, int x, int y, int w, int h) {
+    return x >= 0 && y >= 0 && w > 0 && h > 0
+        && w <= size.width - x && h <= size.height - y;
+}
+
+Image LoadRegion(const Path& file, int x, int y, int w, int h) {
+    switch (DetectImageFormat(file)) {
+        case ImageFormat::JPEG:
+            return LoadJPEGRegion(file, x, y, w, h);
+        case ImageFormat::PPM:
+            return LoadPPMRegion(file, x, y, w, h);
+        case ImageFormat::BMP:
+            return LoadBMPRegion(file, x, y, w, h);
+        case ImageFormat::PNG:
+            // строки PNG сжаты одним потоком: распаковывается всё изображение,
+            // область вырезается без копирования пикселей
+            return LoadPNG(file).Crop(x, y, w, h);
+        default:
+            return {};
+    }
+}
+
+}  // namespace img_lib
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "img_lib.h"
+
+#include <filesystem>
+
+namespace img_lib {
+using Path = std::filesystem::path;
+
+// проверяет, что прямоугольник (x, y, w, h) непуст и целиком лежит
+// внутри изображения заданного размера
+bool IsValidRegion(Size size, int x, int y, int w, int h);
+
+// загружает из файла только прямоугольную область изображения.
+// формат определяется по содержимому. BMP и PPM читают с диска лишь нужные
+// байты строк, JPEG распаковывает только нужные столбцы и не распаковывает
+// строки после области. если область выходит за границы изображения
+// или файл не читается, возвращается пустое изображение
+Image LoadRegion(const Path& file, int x, int y, int w, int h);
+
+}  // namespace img_lib
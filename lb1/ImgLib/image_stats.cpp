@@ -0,0 +1,133 @@
+#include "image_stats.h"
+
+#include <atomic>
+#include <iomanip>
+#include <ostream>
+
+using namespace std;
+
+namespace img_lib::stats {
+
+namespace {
+
+struct AtomicTimer {
+    atomic<uint64_t> nanoseconds{0};
+    atomic<uint64_t> calls{0};
+};
+
+array<atomic<uint64_t>, COUNTER_COUNT> g_counters{};
+array<AtomicTimer, TIMER_COUNT> g_timers;
+
+}  // namespace
+
+void Add(Counter counter, uint64_t value) {
+    g_counters[static_cast<size_t>(counter)].fetch_add(value, memory_order_relaxed);
+}
+
+void AddTime(Timer timer, uint64_t nanoseconds) {
+    AtomicTimer& slot = g_timers[static_cast<size_t>(timer)];
+    slot.nanoseconds.fetch_add(nanoseconds, memory_order_relaxed);
+    slot.calls.fetch_add(1, memory_order_relaxed);
+}
+
+Snapshot GetSnapshot() {
+    Snapshot result;
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        result.counters[i] = g_counters[i].load(memory_order_relaxed);
+    }
+    for (size_t i = 0; i < TIMER_COUNT; ++i) {
+        result.timers[i].nanoseconds = g_timers[i].nanoseconds.load(memory_order_relaxed);
+        result.timers[i].calls = g_timers[i].calls.load(memory_order_relaxed);
+    }
+    return result;
+}
+
+void Reset() {
+    for (auto& counter : g_counters) {
+        counter.store(0, memory_order_relaxed);
+    }
+    for (AtomicTimer& timer : g_timers) {
+        timer.nanoseconds.store(0, memory_order_relaxed);
+        timer.calls.store(0, memory_order_relaxed);
+    }
+}
+
+const char* GetName(Counter counter) {
+    switch (counter) {
+        case Counter::BYTES_READ:
+            return "bytes_read";
+        case Counter::BYTES_WRITTEN:
+            return "bytes_written";
+        case Counter::ROWS_DECODED:
+            return "rows_decoded";
+        case Counter::ROWS_ENCODED:
+            return "rows_encoded";
+        case Counter::PIXEL_ALLOCATIONS:
+            return "pixel_allocations";
+        case Counter::PIXEL_ALLOCATED_BYTES:
+            return "pixel_allocated_bytes";
+        default:
+            return "unknown";
+    }
+}
+
+const char* GetName(Timer timer) {
+    switch (timer) {
+        case Timer::JPEG_DECODE:
+            return "jpeg_decode";
+        case Timer::JPEG_ENCODE:
+            return "jpeg_encode";
+        case Timer::PPM_DECODE:
+            return "ppm_decode";
+        case Timer::PPM_ENCODE:
+            return "ppm_encode";
+        case Timer::BMP_DECODE:
+            return "bmp_decode";
+        case Timer::BMP_ENCODE:
+            return "bmp_encode";
+        case Timer::PNG_DECODE:
+            return "png_decode";
+        case Timer::PNG_ENCODE:
+            return "png_encode";
+        case Timer::PIXEL_PACK:
+            return "pixel_pack";
+        case Timer::COLOR_CONVERT:
+            return "color_convert";
+        case Timer::FILE_MAP:
+            return "file_map";
+        case Timer::FILE_WRITE:
+            return "file_write";
+        default:
+            return "unknown";
+    }
+}
+
+void Print(ostream& out) {
+    if (!IsEnabled()) {
+        out << "ImgLib statistics are compiled out, rebuild with -DIMGLIB_ENABLE_STATS=ON" << endl;
+        return;
+    }
+
+    const Snapshot snapshot = GetSnapshot();
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+
+    for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+        if (snapshot.counters[i] != 0) {
+            out << left << setw(24) << GetName(static_cast<Counter>(i)) << snapshot.counters[i] << endl;
+        }
+    }
+    out << fixed << setprecision(3);
+    for (size_t i = 0; i < TIMER_COUNT; ++i) {
+        const TimerValue& timer = snapshot.timers[i];
+        if (timer.calls != 0) {
+            out << left << setw(24) << GetName(static_cast<Timer>(i)) << timer.nanoseconds / 1e6 << " ms in "
+                << timer.calls << " calls" << endl;
+        }
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+}  // namespace img_lib::stats
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+// Счётчики и таймеры для разбора, на что ушло время конвертации.
+// Включаются опцией CMake IMGLIB_ENABLE_STATS; без неё макросы
+// IMGLIB_STATS_* раскрываются в пустые выражения и ничего не стоят
+#ifndef IMGLIB_ENABLE_STATS
+#define IMGLIB_ENABLE_STATS 0
+#endif
+
+namespace img_lib::stats {
+
+enum class Counter {
+    BYTES_READ,             // байт прочитано из файлов (отображено в память или считано)
+    BYTES_WRITTEN,          // байт записано в файлы и буферы в памяти
+    ROWS_DECODED,           // строк декодировано
+    ROWS_ENCODED,           // строк закодировано
+    PIXEL_ALLOCATIONS,      // выделений памяти под пиксели изображений
+    PIXEL_ALLOCATED_BYTES,  // байт, выделенных под пиксели
+    COUNT
+};
+
+// таймеры включают время вложенных: PIXEL_PACK входит в *_DECODE и *_ENCODE
+enum class Timer {
+    JPEG_DECODE,
+    JPEG_ENCODE,
+    PPM_DECODE,
+    PPM_ENCODE,
+    BMP_DECODE,
+    BMP_ENCODE,
+    PNG_DECODE,
+    PNG_ENCODE,
+    PIXEL_PACK,     // перестановка каналов между форматом файла и Color
+    COLOR_CONVERT,  // преобразование цветовых пространств, color_convert.h
+    FILE_MAP,       // открытие и отображение файлов в память
+    FILE_WRITE,     // запись закодированных строк в файл
+    COUNT
+};
+
+constexpr size_t COUNTER_COUNT = static_cast<size_t>(Counter::COUNT);
+constexpr size_t TIMER_COUNT = static_cast<size_t>(Timer::COUNT);
+
+struct TimerValue {
+    uint64_t nanoseconds = 0;
+    uint64_t calls = 0;
+};
+
+// значения на момент вызова GetSnapshot
+struct Snapshot {
+    std::array<uint64_t, COUNTER_COUNT> counters = {};
+    std::array<TimerValue, TIMER_COUNT> timers = {};
+};
+
+constexpr bool IsEnabled() {
+    return IMGLIB_ENABLE_STATS != 0;
+}
+
+// потокобезопасны; вызываются через макросы ниже
+void Add(Counter counter, uint64_t value);
+void AddTime(Timer timer, uint64_t nanoseconds);
+
+Snapshot GetSnapshot();
+void Reset();
+
+const char* GetName(Counter counter);
+const char* GetName(Timer timer);
+
+// печатает ненулевые счётчики и таймеры, по одному на строку
+void Print(std::ostream& out);
+
+// добавляет время жизни объекта к таймеру
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Timer timer)
+        : timer_(timer)
+        , start_(std::chrono::steady_clock::now()) {
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    ~ScopedTimer() {
+        const auto elapsed = std::chrono::steady_clock::now() - start_;
+        AddTime(timer_, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+private:
+    Timer timer_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace img_lib::stats
+
+#if IMGLIB_ENABLE_STATS
+#define IMGLIB_STATS_CONCAT_IMPL(a, b) a##b
+#define IMGLIB_STATS_CONCAT(a, b) IMGLIB_STATS_CONCAT_IMPL(a, b)
+// замеряет время до конца текущей области видимости. В функциях с setjmp
+// таймер объявляется до setjmp, чтобы longjmp не пропускал его деструктор
+#define IMGLIB_STATS_TIMER(timer) \
+    const ::img_lib::stats::ScopedTimer IMGLIB_STATS_CONCAT(imglib_stats_timer_, __LINE__)(::img_lib::stats::Timer::timer)
+#define IMGLIB_STATS_ADD(counter, value) \
+    ::img_lib::stats::Add(::img_lib::stats::Counter::counter, static_cast<uint64_t>(value))
+#else
+#define IMGLIB_STATS_TIMER(timer) static_cast<void>(0)
+#define IMGLIB_STATS_ADD(counter, value) static_cast<void>(0)
+#endif
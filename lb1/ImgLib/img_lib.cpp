@@ -1,21 +1,98 @@
 #include "img_lib.h"
 
+#include <algorithm>
+#include <atomic>
+
 namespace img_lib {
 
+// количество пикселей в одной границе выравнивания строки
+static const int COLORS_PER_ALIGNMENT = static_cast<int>(IMAGE_ROW_ALIGNMENT / sizeof(Color));
+
+// прямоугольник (x, y, w, h) непуст и лежит внутри width x height
+static bool IsInside(int width, int height, int x, int y, int w, int h) {
+    return w > 0 && h > 0 && x >= 0 && y >= 0 && x <= width - w && y <= height - h;
+}
+
 Image::Image(int w, int h, Color fill)
     : width_(w)
     , height_(h)
-    , step_(w)
-    , pixels_(step_ * height_, fill) {
+    , step_(GetAlignedStep(w))
+    , pixels_(std::make_shared<PixelBuffer>(static_cast<size_t>(step_) * height_, fill)) {
+}
+
+Image::Image(int w, int h)
+    : Image(w, h, PixelBuffer{}) {
+}
+
+Image::Image(int w, int h, PixelBuffer&& buffer)
+    : width_(w)
+    , height_(h)
+    , step_(GetAlignedStep(w))
+    , pixels_(std::make_shared<PixelBuffer>(std::move(buffer))) {
+    // resize не заполняет новые пиксели, см. AlignedAllocator::construct
+    pixels_->resize(static_cast<size_t>(step_) * height_);
+}
+
+Image::Image(const ImageView& view)
+    : width_(view.width_)
+    , height_(view.height_)
+    , step_(view.step_)
+    , offset_(view.offset_)
+    // изображение не пишет в общий буфер: GetLine сначала вызывает Detach
+    , pixels_(std::const_pointer_cast<PixelBuffer>(view.pixels_)) {
+}
+
+int Image::GetAlignedStep(int w) {
+    return (w + COLORS_PER_ALIGNMENT - 1) / COLORS_PER_ALIGNMENT * COLORS_PER_ALIGNMENT;
+}
+
+PixelBuffer Image::ReleaseBuffer() {
+    PixelBuffer result;
+    if (pixels_ && pixels_.use_count() == 1 && offset_ == 0 && step_ == GetAlignedStep(width_)) {
+        result = std::move(*pixels_);
+    }
+    pixels_.reset();
+    width_ = height_ = step_ = 0;
+    offset_ = 0;
+    return result;
+}
+
+Image Image::Crop(int x, int y, int w, int h) const {
+    return Image(View().Crop(x, y, w, h));
+}
+
+ImageView Image::View() const {
+    return ImageView(*this);
+}
+
+void Image::Detach() {
+    if (!IsShared()) {
+        // счётчик мог только что уменьшиться в другом потоке:
+        // его чтения буфера должны завершиться до наших записей
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return;
+    }
+
+    const int step = GetAlignedStep(width_);
+    auto pixels = std::make_shared<PixelBuffer>(static_cast<size_t>(step) * height_);
+    for (int y = 0; y < height_; ++y) {
+        const Color* line = pixels_->data() + offset_ + static_cast<size_t>(step_) * y;
+        std::copy_n(line, width_, pixels->data() + static_cast<size_t>(step) * y);
+    }
+    pixels_ = std::move(pixels);
+    step_ = step;
+    offset_ = 0;
 }
 
 Color* Image::GetLine(int y) {
     assert(y >= 0 && y < height_);
-    return pixels_.data() + step_ * y;
+    Detach();
+    return pixels_->data() + offset_ + static_cast<size_t>(step_) * y;
 }
 
 const Color* Image::GetLine(int y) const {
-    return const_cast<Image*>(this)->GetLine(y);
+    assert(y >= 0 && y < height_);
+    return pixels_->data() + offset_ + static_cast<size_t>(step_) * y;
 }
 
 int Image::GetWidth() const {
@@ -27,9 +104,28 @@ int Image::GetHeight() const {
 }
 
 // шаг задаёт смещение соседних строк изображения
-// он обычно совпадает с width, но может быть больше
+// он дополняет width до границы выравнивания строк
 int Image::GetStep() const {
     return step_;
 }
 
-}  // namespace img_lib
\ No newline at end of file
+ImageView::ImageView(const Image& image)
+    : width_(image.width_)
+    , height_(image.height_)
+    , step_(image.step_)
+    , offset_(image.offset_)
+    , pixels_(image.pixels_) {
+}
+
+ImageView ImageView::Crop(int x, int y, int w, int h) const {
+    if (!IsInside(width_, height_, x, y, w, h)) {
+        return {};
+    }
+    ImageView result = *this;
+    result.width_ = w;
+    result.height_ = h;
+    result.offset_ = offset_ + static_cast<size_t>(step_) * y + x;
+    return result;
+}
+
+}  // namespace img_lib
@@ -1,17 +1,111 @@
 #pragma once
 
+#include "image_stats.h"
+
 #include <array>
 #include <cassert>
 #include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace img_lib {
 
+// непрерывный участок памяти только для чтения, аналог std::span<const std::byte>
+struct ByteSpan {
+    const std::byte* data = nullptr;
+    size_t size = 0;
+};
+
+// буфер с закодированным изображением
+using Bytes = std::vector<std::byte>;
+
+// выравнивание начала каждой строки изображения - размер строки кэша
+constexpr size_t IMAGE_ROW_ALIGNMENT = 64;
+
+// аллокатор, выдающий память с заданным выравниванием.
+// construct без аргументов не обнуляет память, поэтому resize буфера
+// не трогает страницы, которые декодер всё равно перезапишет
+template <typename T, size_t Alignment>
+class AlignedAllocator {
+public:
+    using value_type = T;
+    using is_always_equal = std::true_type;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {
+    }
+
+    T* allocate(size_t n) {
+        IMGLIB_STATS_ADD(PIXEL_ALLOCATIONS, 1);
+        IMGLIB_STATS_ADD(PIXEL_ALLOCATED_BYTES, n * sizeof(T));
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{Alignment}));
+    }
+
+    void deallocate(T* p, size_t) noexcept {
+        ::operator delete(p, std::align_val_t{Alignment});
+    }
+
+    template <typename U>
+    void construct(U* p) noexcept {
+        ::new (static_cast<void*>(p)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept {
+        return false;
+    }
+};
+
 struct Size {
     int width;
     int height;
 };
 
+// формат изображения, определённый по содержимому файла
+enum class ImageFormat {
+    UNKNOWN,
+    JPEG,
+    PPM,
+    BMP,
+    PNG
+};
+
+// сведения об изображении, прочитанные только из заголовка файла
+struct ImageInfo {
+    ImageFormat format = ImageFormat::UNKNOWN;
+    Size size = {0, 0};
+    // число цветовых каналов в файле (1 - оттенки серого, 3 - RGB, 4 - CMYK)
+    int channels = 0;
+
+    explicit operator bool() const {
+        return format != ImageFormat::UNKNOWN;
+    }
+
+    bool operator!() const {
+        return !operator bool();
+    }
+};
+
 struct Color {
     static Color Black() {
         return {std::byte{0}, std::byte{0}, std::byte{0}, std::byte{255}};
@@ -20,6 +114,16 @@ struct Color {
     std::byte r, g, b, a;
 };
 
+// память пикселей изображения: начало буфера выровнено по строке кэша
+using PixelBuffer = std::vector<Color, AlignedAllocator<Color, IMAGE_ROW_ALIGNMENT>>;
+
+class ImageView;
+
+// изображение ссылается на буфер пикселей со счётчиком ссылок. копирование
+// и вырезание области не копируют пиксели: копии делят общий буфер, пока одна
+// из них не запросит изменяемый доступ к строке (копирование при записи).
+// одно изображение не следует менять из нескольких потоков, пока буфер
+// общий, - перед этим вызовите Detach
 class Image {
 public:
     // создаёт пустое изображение
@@ -28,16 +132,55 @@ public:
     // создаёт изображение заданного размера, заполняя его заданным цветом
     Image(int w, int h, Color fill);
 
+    // создаёт изображение заданного размера без заполнения;
+    // содержимое пикселей не определено
+    Image(int w, int h);
+
+    // создаёт изображение поверх готового буфера, например из ImagePool;
+    // буфер при необходимости расширяется, содержимое не определено
+    Image(int w, int h, PixelBuffer&& buffer);
+
+    // изображение с пикселями представления; буфер остаётся общим
+    explicit Image(const ImageView& view);
+
+    // шаг строки для ширины w: каждая строка начинается
+    // на границе IMAGE_ROW_ALIGNMENT байт
+    static int GetAlignedStep(int w);
+
+    // забирает буфер пикселей, оставляя изображение пустым. если буфер
+    // общий с другими изображениями или это вырезанная область,
+    // возвращается пустой буфер
+    PixelBuffer ReleaseBuffer();
+
+    // прямоугольная область (x, y, w, h), разделяющая буфер с этим
+    // изображением. если область не лежит целиком внутри изображения,
+    // возвращается пустое изображение
+    Image Crop(int x, int y, int w, int h) const;
+
+    // представление только для чтения, разделяющее буфер с этим изображением
+    ImageView View() const;
+
+    // копирует пиксели в собственный буфер, если он общий с кем-то ещё
+    void Detach();
+
+    // true, если буфер пикселей разделяют несколько изображений или представлений
+    bool IsShared() const {
+        return pixels_.use_count() > 1;
+    }
+
     // геттеры для отдельного пикселя изображения
+    // константная версия читает общий буфер, не отделяя его
     Color GetPixel(int x, int y) const {
-        return const_cast<Image*>(this)->GetPixel(x, y);
+        assert(x < GetWidth() && y < GetHeight() && x >= 0 && y >= 0);
+        return GetLine(y)[x];
     }
     Color& GetPixel(int x, int y) {
         assert(x < GetWidth() && y < GetHeight() && x >= 0 && y >= 0);
         return GetLine(y)[x];
     }
 
-    // геттер для заданной строки изображения
+    // геттер для заданной строки изображения. изменяемая версия
+    // сначала отделяет общий буфер, см. Detach
     Color* GetLine(int y);
     const Color* GetLine(int y) const;
 
@@ -45,7 +188,8 @@ public:
     int GetHeight() const;
 
     // шаг задаёт смещение соседних строк изображения
-    // он обычно совпадает с шириной, но может быть больше неё
+    // он дополняет ширину до границы выравнивания строк;
+    // у вырезанной области шаг равен шагу исходного изображения
     int GetStep() const;
 
     // будем считать изображение корректным, если
@@ -59,11 +203,70 @@ public:
     }
 
 private:
+    friend class ImageView;
+
+    int width_ = 0;
+    int height_ = 0;
+    int step_ = 0;
+    // смещение первого пикселя области от начала буфера
+    size_t offset_ = 0;
+
+    std::shared_ptr<PixelBuffer> pixels_;
+};
+
+// лёгкое представление прямоугольной области изображения только для чтения:
+// ссылка на общий буфер, смещение, ширина, высота и шаг строк.
+// пока представление живо, изменение исходного изображения копирует его пиксели
+class ImageView {
+public:
+    ImageView() = default;
+
+    // представление всего изображения
+    ImageView(const Image& image);
+
+    // область (x, y, w, h) этого представления; если она не лежит
+    // целиком внутри, возвращается пустое представление
+    ImageView Crop(int x, int y, int w, int h) const;
+
+    Color GetPixel(int x, int y) const {
+        assert(x < GetWidth() && y < GetHeight() && x >= 0 && y >= 0);
+        return GetLine(y)[x];
+    }
+
+    const Color* GetLine(int y) const {
+        assert(y >= 0 && y < height_);
+        return pixels_->data() + offset_ + static_cast<size_t>(step_) * y;
+    }
+
+    int GetWidth() const {
+        return width_;
+    }
+
+    int GetHeight() const {
+        return height_;
+    }
+
+    int GetStep() const {
+        return step_;
+    }
+
+    explicit operator bool() const {
+        return width_ > 0 && height_ > 0;
+    }
+
+    bool operator!() const {
+        return !operator bool();
+    }
+
+private:
+    friend class Image;
+
     int width_ = 0;
     int height_ = 0;
-    int step_;
+    int step_ = 0;
+    size_t offset_ = 0;
 
-    std::vector<Color> pixels_;
+    std::shared_ptr<const PixelBuffer> pixels_;
 };
 
 }  // namespace img_lib
\ No newline at end of file
@@ -1,7 +1,16 @@
-#include "ppm_image.h"
-
+#include "jpeg_image.h"
+#include "color_convert.h"
+#include "image_pool.h"
+#include "image_region.h"
+#include "image_stats.h"
+#include "mapped_file.h"
+#include "pixel_pack.h"
+
+#include <algorithm>
 #include <array>
+#include <cstdlib>
 #include <fstream>
+#include <memory>
 #include <setjmp.h>
 #include <stdio.h>
 
@@ -27,72 +36,358 @@ my_error_exit (j_common_ptr cinfo) {
     longjmp(myerr->setjmp_buffer, 1);
 }
 
+// Приёмник LibJPEG, который пишет сжатые данные прямо в Bytes.
+// Буфер растёт удвоением и в конце обрезается до записанного размера,
+// так что копировать результат не нужно. Вся память принадлежит out:
+// после longjmp освобождать нечего
+struct BytesDestination {
+    jpeg_destination_mgr pub;
+    Bytes* out = nullptr;
+};
 
-bool SaveJPEG(const Path& file, const Image& image) {
-    // Проверяет, что изображение корректное
-    if (!image || image.GetWidth() == 0 || image.GetHeight() == 0) {
-        return false;
+static const size_t JPEG_MEM_DEST_INITIAL_SIZE = size_t{64} << 10;
+
+METHODDEF(void)
+InitBytesDestination(j_compress_ptr cinfo) {
+    BytesDestination* dest = reinterpret_cast<BytesDestination*>(cinfo->dest);
+    dest->out->resize(max(dest->out->capacity(), JPEG_MEM_DEST_INITIAL_SIZE));
+    dest->pub.next_output_byte = reinterpret_cast<JOCTET*>(dest->out->data());
+    dest->pub.free_in_buffer = dest->out->size();
+}
+
+// вызывается, когда буфер заполнен целиком
+METHODDEF(boolean)
+EmptyBytesDestination(j_compress_ptr cinfo) {
+    BytesDestination* dest = reinterpret_cast<BytesDestination*>(cinfo->dest);
+    const size_t used = dest->out->size();
+    dest->out->resize(used * 2);
+    dest->pub.next_output_byte = reinterpret_cast<JOCTET*>(dest->out->data() + used);
+    dest->pub.free_in_buffer = dest->out->size() - used;
+    return TRUE;
+}
+
+METHODDEF(void)
+TermBytesDestination(j_compress_ptr cinfo) {
+    BytesDestination* dest = reinterpret_cast<BytesDestination*>(cinfo->dest);
+    dest->out->resize(dest->out->size() - dest->pub.free_in_buffer);
+}
+
+// объекты компрессии и декомпрессии создаются один раз на поток
+// и переиспользуются между вызовами: пакетная конвертация не платит
+// за повторную инициализацию LibJPEG на каждом файле
+struct JPEGCompressState {
+    JPEGCompressState() {
+        cinfo.err = jpeg_std_error(&jerr.pub);
+        jerr.pub.error_exit = my_error_exit;
+        jpeg_create_compress(&cinfo);
     }
 
-    // Открывает файл
-    FILE* outfile = nullptr;
-#if defined(_MSC_VER)
-    outfile = _wfopen(file.c_str(), L"wb");
-#else
-    outfile = fopen(file.c_str(), "wb");
-#endif
-    if (!outfile) {
-        return false;
+    ~JPEGCompressState() {
+        jpeg_destroy_compress(&cinfo);
     }
 
+    JPEGCompressState(const JPEGCompressState&) = delete;
+    JPEGCompressState& operator=(const JPEGCompressState&) = delete;
+
     jpeg_compress_struct cinfo;
-    jpeg_error_mgr jerr;
+    my_error_mgr jerr;
+
+    // приёмник для кодирования в память
+    BytesDestination mem_dest;
+};
 
-    // Устанавливает обработчик ошибок
-    cinfo.err = jpeg_std_error(&jerr);
+struct JPEGDecompressState {
+    JPEGDecompressState() {
+        cinfo.err = jpeg_std_error(&jerr.pub);
+        jerr.pub.error_exit = my_error_exit;
+        jpeg_create_decompress(&cinfo);
+    }
 
-    // Инициализирует объект компрессии JPEG
-    jpeg_create_compress(&cinfo);
+    ~JPEGDecompressState() {
+        jpeg_destroy_decompress(&cinfo);
+    }
 
-    // Указывает выходной файл
-    jpeg_stdio_dest(&cinfo, outfile);
+    JPEGDecompressState(const JPEGDecompressState&) = delete;
+    JPEGDecompressState& operator=(const JPEGDecompressState&) = delete;
+
+    jpeg_decompress_struct cinfo;
+    my_error_mgr jerr;
+};
 
+static JPEGCompressState& GetCompressState() {
+    thread_local JPEGCompressState state;
+    return state;
+}
+
+// jpeg_stdio_dest не позволяет переключать объект с другого приёмника
+// на файловый, поэтому для записи в память заведён отдельный
+static JPEGCompressState& GetMemoryCompressState() {
+    thread_local JPEGCompressState state;
+    return state;
+}
+
+static JPEGDecompressState& GetDecompressState() {
+    thread_local JPEGDecompressState state;
+    return state;
+}
+
+// Тут не избежать функции открытия файла из языка C,
+// поэтому приходится использовать конвертацию пути к string.
+// Под Visual Studio это может быть опасно, и нужно применить
+// нестандартную функцию _wfopen
+static FILE* OpenCFile(const Path& file, bool for_writing) {
+#ifdef _MSC_VER
+    return _wfopen(file.wstring().c_str(), for_writing ? L"wb" : L"rb");
+#else
+    return fopen(file.string().c_str(), for_writing ? "wb" : "rb");
+#endif
+}
+
+// LibJPEG-turbo с версии 1.5 умеет распаковывать часть столбцов
+// и пропускать строки без вывода
+#if defined(LIBJPEG_TURBO_VERSION_NUMBER) && LIBJPEG_TURBO_VERSION_NUMBER >= 1005000
+#define IMGLIB_JPEG_HAS_CROP 1
+#endif
+
+#ifdef JCS_EXTENSIONS
+// LibJPEG-turbo умеет читать и писать 4-байтовые пиксели. Порядок компонентов
+// в JCS_EXT_RGBA совпадает с Color, поэтому строки изображения передаются
+// кодеку напрямую, без промежуточного буфера и перепаковки
+static_assert(sizeof(Color) == 4, "Color must be a packed RGBA quadruple");
+#endif
+
+// число строк, передаваемых кодеру за один вызов jpeg_write_scanlines
+static const int JPEG_WRITE_STRIP_ROWS = 16;
+
+static bool IsValidSaveOptions(const JPEGSaveOptions& options) {
+    return options.quality >= 1 && options.quality <= 100;
+}
+
+static J_DCT_METHOD GetDCTMethod(JPEGDCTMethod method) {
+    switch (method) {
+        case JPEGDCTMethod::IFAST:
+            return JDCT_IFAST;
+        case JPEGDCTMethod::FLOAT:
+            return JDCT_FLOAT;
+        default:
+            return JDCT_ISLOW;
+    }
+}
+
+// Стандартные таблицы Хаффмана. LibJPEG-turbo записывает их только в пустые
+// слоты, а оптимизация кодов и прогрессивный режим переписывают таблицы
+// на месте, поэтому в переиспользуемом объекте они восстанавливаются явно
+struct StandardHuffTables {
+    JHUFF_TBL dc[2];
+    JHUFF_TBL ac[2];
+};
+
+static const StandardHuffTables& GetStandardHuffTables() {
+    static const StandardHuffTables tables = [] {
+        jpeg_compress_struct cinfo;
+        jpeg_error_mgr jerr;
+        cinfo.err = jpeg_std_error(&jerr);
+        jpeg_create_compress(&cinfo);
+        cinfo.input_components = 3;
+        cinfo.in_color_space = JCS_RGB;
+        jpeg_set_defaults(&cinfo);
+
+        StandardHuffTables result;
+        for (int i = 0; i < 2; ++i) {
+            result.dc[i] = *cinfo.dc_huff_tbl_ptrs[i];
+            result.ac[i] = *cinfo.ac_huff_tbl_ptrs[i];
+        }
+        jpeg_destroy_compress(&cinfo);
+        return result;
+    }();
+    return tables;
+}
+
+// Устанавливает параметры сжатия RGB-изображения заданного размера
+static void SetupCompress(jpeg_compress_struct& cinfo, int width, int height, const JPEGSaveOptions& options) {
     // Устанавливает параметры изображения
-    cinfo.image_width = image.GetWidth();
-    cinfo.image_height = image.GetHeight();
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+#ifdef JCS_EXTENSIONS
+    cinfo.input_components = 4;  // Компоненты R, G, B и неиспользуемый A
+    cinfo.in_color_space = JCS_EXT_RGBX; // Цветовое пространство
+#else
     cinfo.input_components = 3;  // Компоненты R, G, B
     cinfo.in_color_space = JCS_RGB; // Цветовое пространство
+#endif
 
     // Использует параметры по умолчанию
     jpeg_set_defaults(&cinfo);
+    const StandardHuffTables& standard = GetStandardHuffTables();
+    for (int i = 0; i < 2; ++i) {
+        *cinfo.dc_huff_tbl_ptrs[i] = standard.dc[i];
+        *cinfo.ac_huff_tbl_ptrs[i] = standard.ac[i];
+    }
 
-    // Начинает компрессию
-    jpeg_start_compress(&cinfo, TRUE);
+    // и уточняет их заданными настройками
+    jpeg_set_quality(&cinfo, options.quality, TRUE);
+
+    // Прореживание задаётся множителями дискретизации яркостного канала,
+    // цветоразностные каналы остаются 1x1
+    const int h_factor = options.subsampling == JPEGSubsampling::S444 ? 1 : 2;
+    const int v_factor = options.subsampling == JPEGSubsampling::S420 ? 2 : 1;
+    cinfo.comp_info[0].h_samp_factor = h_factor;
+    cinfo.comp_info[0].v_samp_factor = v_factor;
+    for (int c = 1; c < cinfo.num_components; ++c) {
+        cinfo.comp_info[c].h_samp_factor = 1;
+        cinfo.comp_info[c].v_samp_factor = 1;
+    }
+
+    cinfo.optimize_coding = options.optimize_coding ? TRUE : FALSE;
+    cinfo.dct_method = GetDCTMethod(options.dct_method);
+    if (options.progressive) {
+        jpeg_simple_progression(&cinfo);
+    }
+}
+
+// Запускает распаковку прочитанного заголовка с заданными параметрами
+// и выходным цветовым пространством
+static void StartDecompress(jpeg_decompress_struct& cinfo, const JPEGLoadOptions& options,
+                            J_COLOR_SPACE out_color_space) {
+    cinfo.out_color_space = out_color_space;
+
+    // Уменьшение масштаба выполняется внутри обратного ДКП
+    // и заметно ускоряет получение эскизов
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = options.scale_denom;
+    cinfo.dct_method = options.fast_dct ? JDCT_IFAST : JDCT_ISLOW;
+    cinfo.do_fancy_upsampling = options.fancy_upsampling ? TRUE : FALSE;
+
+    (void) jpeg_start_decompress(&cinfo);
+}
+
+// Читает заголовок и запускает распаковку в пиксели Color
+static void SetupDecompress(jpeg_decompress_struct& cinfo, const JPEGLoadOptions& options) {
+    (void) jpeg_read_header(&cinfo, TRUE);
+#ifdef JCS_EXTENSIONS
+    StartDecompress(cinfo, options, JCS_EXT_RGBA);
+#else
+    StartDecompress(cinfo, options, JCS_RGB);
+#endif
+}
+
+static bool IsValidScale(int scale_denom) {
+    return scale_denom == 1 || scale_denom == 2 || scale_denom == 4 || scale_denom == 8;
+}
+
+// Выделяет массив указателей на строки в пуле LibJPEG,
+// чтобы он освобождался и при аварийном выходе через longjmp
+template <typename Info>
+static JSAMPARRAY AllocRowPointers(Info& cinfo, int count) {
+    return static_cast<JSAMPARRAY>((*cinfo.mem->alloc_small)
+                ((j_common_ptr) &cinfo, JPOOL_IMAGE, count * sizeof(JSAMPROW)));
+}
 
-    // Создаёт временный буфер для строки изображения
-    std::vector<JSAMPLE> row_buffer(image.GetWidth() * 3);
 
-    // Получает доступ к данным изображения
-    for (int y = 0; y < image.GetHeight(); ++y) {
-        const Color* line = image.GetLine(y);
-        for (int x = 0; x < image.GetWidth(); ++x) {
-            const Color& pixel = line[x];
-            row_buffer[x * 3] = static_cast<JSAMPLE>(pixel.r);
-            row_buffer[x * 3 + 1] = static_cast<JSAMPLE>(pixel.g);
-            row_buffer[x * 3 + 2] = static_cast<JSAMPLE>(pixel.b);
+// Передаёт изображение запущенному кодеру полосами по несколько строк
+static void WriteImageStrips(jpeg_compress_struct& cinfo, const Image& image) {
+    const int height = image.GetHeight();
+    JSAMPARRAY rows = AllocRowPointers(cinfo, JPEG_WRITE_STRIP_ROWS);
+#ifndef JCS_EXTENSIONS
+    // Создаёт временный буфер для полосы строк
+    JSAMPARRAY strip_buffer = (*cinfo.mem->alloc_sarray)
+                ((j_common_ptr) &cinfo, JPOOL_IMAGE, image.GetWidth() * 3, JPEG_WRITE_STRIP_ROWS);
+#endif
+
+    while (cinfo.next_scanline < cinfo.image_height) {
+        const int y = cinfo.next_scanline;
+        const int count = min(JPEG_WRITE_STRIP_ROWS, height - y);
+
+        for (int i = 0; i < count; ++i) {
+#ifdef JCS_EXTENSIONS
+            // LibJPEG не изменяет входные строки, хоть и принимает их не как const
+            rows[i] = reinterpret_cast<JSAMPROW>(const_cast<Color*>(image.GetLine(y + i)));
+#else
+            PackRGB(image.GetLine(y + i), reinterpret_cast<std::byte*>(strip_buffer[i]), image.GetWidth());
+            rows[i] = strip_buffer[i];
+#endif
         }
 
-        // Указатель на строку для записи
-        JSAMPLE* row_pointer = row_buffer.data();
-        jpeg_write_scanlines(&cinfo, &row_pointer, 1);
+        jpeg_write_scanlines(&cinfo, rows, count);
+    }
+}
+
+bool SaveJPEG(const Path& file, const Image& image, const JPEGSaveOptions& options) {
+    // Проверяет, что изображение и параметры корректны
+    if (!image || image.GetWidth() == 0 || image.GetHeight() == 0 || !IsValidSaveOptions(options)) {
+        return false;
+    }
+
+    IMGLIB_STATS_TIMER(JPEG_ENCODE);
+
+    // Открывает файл
+    FILE* outfile = OpenCFile(file, true);
+    if (!outfile) {
+        return false;
+    }
+
+    // Берёт объект компрессии JPEG текущего потока
+    JPEGCompressState& state = GetCompressState();
+    jpeg_compress_struct& cinfo = state.cinfo;
+
+    // При ошибке сбрасывает объект в исходное состояние для следующего вызова
+    if (setjmp(state.jerr.setjmp_buffer)) {
+        jpeg_abort_compress(&cinfo);
+        fclose(outfile);
+        return false;
     }
 
-    // Завершает компрессию
+    // Указывает выходной файл
+    jpeg_stdio_dest(&cinfo, outfile);
+
+    SetupCompress(cinfo, image.GetWidth(), image.GetHeight(), options);
+
+    // Начинает компрессию
+    jpeg_start_compress(&cinfo, TRUE);
+
+    WriteImageStrips(cinfo, image);
+
+    // Завершает компрессию, объект остаётся готовым к следующему изображению
     jpeg_finish_compress(&cinfo);
+    IMGLIB_STATS_ADD(ROWS_ENCODED, image.GetHeight());
+    IMGLIB_STATS_ADD(BYTES_WRITTEN, max(ftell(outfile), 0L));
 
     // Освобождает ресурсы
-    jpeg_destroy_compress(&cinfo);
-    fclose(outfile);
+    const bool ok = fclose(outfile) == 0;
+
+    return ok;
+}
+
+bool SaveJPEG(Bytes& out, const Image& image, const JPEGSaveOptions& options) {
+    if (!image || !IsValidSaveOptions(options)) {
+        return false;
+    }
+
+    IMGLIB_STATS_TIMER(JPEG_ENCODE);
+    JPEGCompressState& state = GetMemoryCompressState();
+    jpeg_compress_struct& cinfo = state.cinfo;
+
+    out.clear();
+
+    if (setjmp(state.jerr.setjmp_buffer)) {
+        jpeg_abort_compress(&cinfo);
+        out.clear();
+        return false;
+    }
+
+    state.mem_dest.pub.init_destination = InitBytesDestination;
+    state.mem_dest.pub.empty_output_buffer = EmptyBytesDestination;
+    state.mem_dest.pub.term_destination = TermBytesDestination;
+    state.mem_dest.out = &out;
+    cinfo.dest = &state.mem_dest.pub;
+
+    SetupCompress(cinfo, image.GetWidth(), image.GetHeight(), options);
+    jpeg_start_compress(&cinfo, TRUE);
+    WriteImageStrips(cinfo, image);
+    jpeg_finish_compress(&cinfo);
+
+    IMGLIB_STATS_ADD(ROWS_ENCODED, image.GetHeight());
+    IMGLIB_STATS_ADD(BYTES_WRITTEN, out.size());
 
     return true;
 }
@@ -100,73 +395,588 @@ bool SaveJPEG(const Path& file, const Image& image) {
 
 // тип JSAMPLE фактически псевдоним для unsigned char
 void SaveSсanlineToImage(const JSAMPLE* row, int y, Image& out_image) {
-    Color* line = out_image.GetLine(y);
-    for (int x = 0; x < out_image.GetWidth(); ++x) {
-        const JSAMPLE* pixel = row + x * 3;
-        line[x] = Color{byte{pixel[0]}, byte{pixel[1]}, byte{pixel[2]}, byte{255}};
-    }
+    UnpackRGB(reinterpret_cast<const std::byte*>(row), out_image.GetLine(y), out_image.GetWidth());
 }
 
-Image LoadJPEG(const Path& file) {
-    jpeg_decompress_struct cinfo;
-    my_error_mgr jerr;
-    
-    FILE* infile;
-    JSAMPARRAY buffer;
-    int row_stride;
-
-    // Тут не избежать функции открытия файла из языка C,
-    // поэтому приходится использовать конвертацию пути к string.
-    // Под Visual Studio это может быть опасно, и нужно применить
-    // нестандартную функцию _wfopen
-#ifdef _MSC_VER
-    if ((infile = _wfopen(file.wstring().c_str(), "rb")) == NULL) {
+Image LoadJPEG(ByteSpan data, const JPEGLoadOptions& options) {
+    if (!IsValidScale(options.scale_denom) || data.data == nullptr || data.size == 0) {
+        return {};
+    }
+
+    IMGLIB_STATS_TIMER(JPEG_DECODE);
+    JPEGDecompressState& state = GetDecompressState();
+    jpeg_decompress_struct& cinfo = state.cinfo;
+
+    // объявлен до setjmp, чтобы его деструктор не пропускался при longjmp
+    Image result;
+    int strip_rows;
+
+    // При ошибке сбрасывает объект в исходное состояние для следующего вызова
+    if (setjmp(state.jerr.setjmp_buffer)) {
+        jpeg_abort_decompress(&cinfo);
+        return {};
+    }
+
+    // Все загрузки идут через источник в памяти: LibJPEG переиспользует
+    // его между вызовами, а файлы отображаются в память без копирования
+    jpeg_mem_src(&cinfo, reinterpret_cast<const unsigned char*>(data.data), data.size);
+
+    SetupDecompress(cinfo, options);
+
+    // По умолчанию полоса равна числу строк, которое декодер
+    // выдаёт за один проход без внутренней буферизации
+    strip_rows = options.strip_rows > 0 ? options.strip_rows : max(cinfo.rec_outbuf_height, 1);
+
+    result = AcquireImage(cinfo.output_width, cinfo.output_height);
+    const int height = result.GetHeight();
+
+#ifdef JCS_EXTENSIONS
+    // Декодирует полосы строк прямо в память изображения
+    JSAMPARRAY rows = AllocRowPointers(cinfo, strip_rows);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        const int y = cinfo.output_scanline;
+        const int count = min(strip_rows, height - y);
+        for (int i = 0; i < count; ++i) {
+            rows[i] = reinterpret_cast<JSAMPROW>(result.GetLine(y + i));
+        }
+        (void) jpeg_read_scanlines(&cinfo, rows, count);
+    }
 #else
-    if ((infile = fopen(file.string().c_str(), "rb")) == NULL) {
+    JSAMPARRAY buffer = (*cinfo.mem->alloc_sarray)
+                ((j_common_ptr) &cinfo, JPOOL_IMAGE, cinfo.output_width * 3, strip_rows);
+
+    while (cinfo.output_scanline < cinfo.output_height) {
+        const int y = cinfo.output_scanline;
+        const int count = min(strip_rows, height - y);
+        const JDIMENSION read = jpeg_read_scanlines(&cinfo, buffer, count);
+
+        for (JDIMENSION i = 0; i < read; ++i) {
+            SaveSсanlineToImage(buffer[i], y + i, result);
+        }
+    }
 #endif
+
+    (void) jpeg_finish_decompress(&cinfo);
+    IMGLIB_STATS_ADD(ROWS_DECODED, height);
+
+    return result;
+}
+
+Image LoadJPEG(const Path& file, const JPEGLoadOptions& options) {
+    const MappedFile mapped(file);
+    if (!mapped) {
         return {};
     }
+    return LoadJPEG(ByteSpan{mapped.GetData(), mapped.GetSize()}, options);
+}
 
-    cinfo.err = jpeg_std_error(&jerr.pub);
-    jerr.pub.error_exit = my_error_exit;
+// Распаковывает оставшиеся строки полосами прямо в строки плоскости
+static void ReadPlaneStrips(jpeg_decompress_struct& cinfo, GrayImage& plane, int strip_rows) {
+    JSAMPARRAY rows = AllocRowPointers(cinfo, strip_rows);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        const int y = cinfo.output_scanline;
+        const int count = min(strip_rows, plane.GetHeight() - y);
+        for (int i = 0; i < count; ++i) {
+            rows[i] = plane.GetLine(y + i);
+        }
+        (void) jpeg_read_scanlines(&cinfo, rows, count);
+    }
+}
 
-    if (setjmp(jerr.setjmp_buffer)) {
-        jpeg_destroy_decompress(&cinfo);
-        fclose(infile);
+// Размер блока ДКП компонента после масштабирования; в API LibJPEG 7
+// и новее он задаётся отдельно по каждой оси
+#if JPEG_LIB_VERSION >= 70
+static int GetScaledBlockWidth(const jpeg_component_info& comp) {
+    return comp.DCT_h_scaled_size;
+}
+static int GetScaledBlockHeight(const jpeg_component_info& comp) {
+    return comp.DCT_v_scaled_size;
+}
+static int GetMinScaledBlockHeight(const jpeg_decompress_struct& cinfo) {
+    return cinfo.min_DCT_v_scaled_size;
+}
+#else
+static int GetScaledBlockWidth(const jpeg_component_info& comp) {
+    return comp.DCT_scaled_size;
+}
+static int GetScaledBlockHeight(const jpeg_component_info& comp) {
+    return comp.DCT_scaled_size;
+}
+static int GetMinScaledBlockHeight(const jpeg_decompress_struct& cinfo) {
+    return cinfo.min_DCT_scaled_size;
+}
+#endif
+
+// Запускает распаковку в режиме raw_data_out: LibJPEG отдаёт отсчёты
+// компонентов после обратного ДКП, без интерполяции прореженных каналов
+// и без цветового преобразования. Плоскости получают размер компонентов
+// в файле, данные читаются по строке MCU, выровненной до целых блоков
+static void ReadRawPlanes(jpeg_decompress_struct& cinfo, const JPEGLoadOptions& options, YCbCrImage& result) {
+    cinfo.raw_data_out = TRUE;
+    StartDecompress(cinfo, options, JCS_YCbCr);
+
+    JSAMPARRAY buffers[3];
+    int rows_per_call[3];
+    int plane_rows[3] = {0, 0, 0};
+    for (int c = 0; c < 3; ++c) {
+        const jpeg_component_info& comp = cinfo.comp_info[c];
+        // при уменьшении LibJPEG может распаковывать прореженный канал
+        // с большим размером блока, поэтому размер берётся из описания
+        // компонента, пересчитанного jpeg_start_decompress
+        result.planes[c] = GrayImage(comp.downsampled_width, comp.downsampled_height);
+
+        rows_per_call[c] = comp.v_samp_factor * GetScaledBlockHeight(comp);
+        buffers[c] = (*cinfo.mem->alloc_sarray)((j_common_ptr) &cinfo, JPOOL_IMAGE,
+                        comp.width_in_blocks * GetScaledBlockWidth(comp), rows_per_call[c]);
+    }
+
+    const int lines_per_call = cinfo.max_v_samp_factor * GetMinScaledBlockHeight(cinfo);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        (void) jpeg_read_raw_data(&cinfo, buffers, lines_per_call);
+        // Последняя строка MCU может выходить за нижний край изображения
+        for (int c = 0; c < 3; ++c) {
+            GrayImage& plane = result.planes[c];
+            for (int i = 0; i < rows_per_call[c] && plane_rows[c] < plane.GetHeight(); ++i) {
+                copy_n(buffers[c][i], plane.GetWidth(), plane.GetLine(plane_rows[c]++));
+            }
+        }
+    }
+}
+
+GrayImage LoadJPEGGray(ByteSpan data, const JPEGLoadOptions& options) {
+    if (!IsValidScale(options.scale_denom) || data.data == nullptr || data.size == 0) {
         return {};
     }
 
-    jpeg_create_decompress(&cinfo);
+    IMGLIB_STATS_TIMER(JPEG_DECODE);
+    JPEGDecompressState& state = GetDecompressState();
+    jpeg_decompress_struct& cinfo = state.cinfo;
 
-    jpeg_stdio_src(&cinfo, infile);
+    // объявлен до setjmp, чтобы его деструктор не пропускался при longjmp
+    GrayImage result;
 
+    if (setjmp(state.jerr.setjmp_buffer)) {
+        jpeg_abort_decompress(&cinfo);
+        return {};
+    }
+
+    jpeg_mem_src(&cinfo, reinterpret_cast<const unsigned char*>(data.data), data.size);
     (void) jpeg_read_header(&cinfo, TRUE);
 
-    cinfo.out_color_space = JCS_RGB;
-    cinfo.output_components = 3;
+    // У файлов YCbCr LibJPEG отдаёт яркостный канал как есть и пропускает
+    // распаковку цветоразностных, RGB переводит в яркость сама
+    StartDecompress(cinfo, options, JCS_GRAYSCALE);
 
-    (void) jpeg_start_decompress(&cinfo);
-    
-    row_stride = cinfo.output_width * cinfo.output_components;
-    
-    buffer = (*cinfo.mem->alloc_sarray)
-                ((j_common_ptr) &cinfo, JPOOL_IMAGE, row_stride, 1);
+    result = GrayImage(cinfo.output_width, cinfo.output_height);
+    ReadPlaneStrips(cinfo, result, options.strip_rows > 0 ? options.strip_rows : max(cinfo.rec_outbuf_height, 1));
+
+    (void) jpeg_finish_decompress(&cinfo);
+    IMGLIB_STATS_ADD(ROWS_DECODED, result.GetHeight());
 
-    Image result(cinfo.output_width, cinfo.output_height, Color::Black());
+    return result;
+}
 
-    while (cinfo.output_scanline < cinfo.output_height) {
-        int y = cinfo.output_scanline;
-        (void) jpeg_read_scanlines(&cinfo, buffer, 1);
+GrayImage LoadJPEGGray(const Path& file, const JPEGLoadOptions& options) {
+    const MappedFile mapped(file);
+    if (!mapped) {
+        return {};
+    }
+    return LoadJPEGGray(ByteSpan{mapped.GetData(), mapped.GetSize()}, options);
+}
 
-        SaveSсanlineToImage(buffer[0], y, result);
+YCbCrImage LoadJPEGYCbCr(ByteSpan data, const JPEGLoadOptions& options) {
+    if (!IsValidScale(options.scale_denom) || data.data == nullptr || data.size == 0) {
+        return {};
     }
 
-    (void) jpeg_finish_decompress(&cinfo);
+    JPEGDecompressState& state = GetDecompressState();
+    jpeg_decompress_struct& cinfo = state.cinfo;
 
-    jpeg_destroy_decompress(&cinfo);
-    fclose(infile);
+    // объявлены до setjmp, чтобы их деструкторы не пропускались при longjmp
+    YCbCrImage result;
+    bool convert_rgb = false;
 
+    {
+        IMGLIB_STATS_TIMER(JPEG_DECODE);
+
+        if (setjmp(state.jerr.setjmp_buffer)) {
+            jpeg_abort_decompress(&cinfo);
+            return {};
+        }
+
+        jpeg_mem_src(&cinfo, reinterpret_cast<const unsigned char*>(data.data), data.size);
+        (void) jpeg_read_header(&cinfo, TRUE);
+
+        const J_COLOR_SPACE color_space = cinfo.jpeg_color_space;
+        if ((color_space == JCS_YCbCr && cinfo.num_components == 3) || color_space == JCS_GRAYSCALE) {
+            if (color_space == JCS_GRAYSCALE) {
+                // Серый файл распаковывается без преобразования прямо в плоскость Y
+                StartDecompress(cinfo, options, color_space);
+                const int w = cinfo.output_width;
+                const int h = cinfo.output_height;
+                result.Y() = GrayImage(w, h);
+                result.Cb() = GrayImage(w, h, 128);
+                result.Cr() = GrayImage(w, h, 128);
+                ReadPlaneStrips(cinfo, result.Y(), options.strip_rows > 0 ? options.strip_rows : max(cinfo.rec_outbuf_height, 1));
+            } else {
+                ReadRawPlanes(cinfo, options, result);
+            }
+
+            (void) jpeg_finish_decompress(&cinfo);
+            IMGLIB_STATS_ADD(ROWS_DECODED, result.GetHeight());
+        } else {
+            jpeg_abort_decompress(&cinfo);
+            convert_rgb = true;
+        }
+    }
+
+    // RGB, CMYK и прочие пространства идут обычным путём через Color
+    if (convert_rgb) {
+        return ImageToYCbCr(LoadJPEG(data, options));
+    }
     return result;
 }
 
+YCbCrImage LoadJPEGYCbCr(const Path& file, const JPEGLoadOptions& options) {
+    const MappedFile mapped(file);
+    if (!mapped) {
+        return {};
+    }
+    return LoadJPEGYCbCr(ByteSpan{mapped.GetData(), mapped.GetSize()}, options);
+}
+
+Image LoadJPEGRegion(ByteSpan data, int x, int y, int w, int h, const JPEGLoadOptions& options) {
+    if (!IsValidScale(options.scale_denom) || data.data == nullptr || data.size == 0) {
+        return {};
+    }
+
+    IMGLIB_STATS_TIMER(JPEG_DECODE);
+    JPEGDecompressState& state = GetDecompressState();
+    jpeg_decompress_struct& cinfo = state.cinfo;
+
+    // объявлен до setjmp, чтобы его деструктор не пропускался при longjmp
+    Image result;
+
+    if (setjmp(state.jerr.setjmp_buffer)) {
+        jpeg_abort_decompress(&cinfo);
+        return {};
+    }
+
+    jpeg_mem_src(&cinfo, reinterpret_cast<const unsigned char*>(data.data), data.size);
+    SetupDecompress(cinfo, options);
+
+    const Size size = {static_cast<int>(cinfo.output_width), static_cast<int>(cinfo.output_height)};
+    if (!IsValidRegion(size, x, y, w, h)) {
+        jpeg_abort_decompress(&cinfo);
+        return {};
+    }
+
+    // смещение области внутри распакованной строки
+    int column = x;
+#ifdef IMGLIB_JPEG_HAS_CROP
+    // Границы расширяются до ближайших границ MCU, поэтому
+    // распакованная строка может быть немного шире области. Цветоразностные
+    // каналы на краю обрезки интерполируются как на краю изображения,
+    // поэтому слева запрашивается ещё пиксель, а справа - столько, чтобы
+    // и у самой узкой области в строке было не меньше двух отсчётов цветности
+    JDIMENSION crop_x = max(x - 1, 0);
+    JDIMENSION crop_width = min(x + w + cinfo.max_h_samp_factor, size.width) - static_cast<int>(crop_x);
+    jpeg_crop_scanline(&cinfo, &crop_x, &crop_width);
+    column = x - static_cast<int>(crop_x);
+
+    if (y > 0) {
+        (void) jpeg_skip_scanlines(&cinfo, y);
+    }
+#endif
+
+    JSAMPARRAY buffer = (*cinfo.mem->alloc_sarray)
+                ((j_common_ptr) &cinfo, JPOOL_IMAGE, cinfo.output_width * cinfo.output_components, 1);
+
+#ifndef IMGLIB_JPEG_HAS_CROP
+    // Без поддержки пропуска строки выше области распаковываются и отбрасываются
+    while (cinfo.output_scanline < static_cast<JDIMENSION>(y)) {
+        (void) jpeg_read_scanlines(&cinfo, buffer, 1);
+    }
+#endif
+
+    result = AcquireImage(w, h);
+    for (int row = 0; row < h; ++row) {
+        (void) jpeg_read_scanlines(&cinfo, buffer, 1);
+#ifdef JCS_EXTENSIONS
+        const Color* src = reinterpret_cast<const Color*>(buffer[0]) + column;
+        copy(src, src + w, result.GetLine(row));
+#else
+        UnpackRGB(reinterpret_cast<const std::byte*>(buffer[0]) + column * 3, result.GetLine(row), w);
+#endif
+    }
+
+    // Строки ниже области не нужны - распаковка прерывается
+    jpeg_abort_decompress(&cinfo);
+    IMGLIB_STATS_ADD(ROWS_DECODED, h);
+
+    return result;
+}
+
+Image LoadJPEGRegion(const Path& file, int x, int y, int w, int h, const JPEGLoadOptions& options) {
+    // Отображение в память подгружает только страницы, которые прочитает декодер
+    const MappedFile mapped(file);
+    if (!mapped) {
+        return {};
+    }
+    return LoadJPEGRegion(ByteSpan{mapped.GetData(), mapped.GetSize()}, x, y, w, h, options);
+}
+
+ImageInfo ProbeJPEG(ByteSpan data) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(data.data);
+    const size_t size = data.size;
+    if (bytes == nullptr || size < 4 || bytes[0] != 0xFF || bytes[1] != 0xD8) {
+        return {};
+    }
+
+    // Проходит по сегментам заголовка, перескакивая их содержимое по длине
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (bytes[pos] != 0xFF) {
+            return {};
+        }
+        const uint8_t marker = bytes[pos + 1];
+        ++pos;
+        if (marker == 0xFF) {
+            // байт-заполнитель перед маркером
+            continue;
+        }
+        ++pos;
+
+        // маркеры без сегмента данных: RSTn, TEM
+        if ((marker >= 0xD0 && marker <= 0xD7) || marker == 0x01) {
+            continue;
+        }
+        // до SOF дошли данные изображения или конец файла
+        if (marker == 0xD9 || marker == 0xDA) {
+            return {};
+        }
+
+        const size_t length = (size_t{bytes[pos]} << 8) | bytes[pos + 1];
+        if (length < 2 || length > size - pos) {
+            return {};
+        }
+
+        // SOF0-SOF15, кроме DHT (C4), JPG (C8) и DAC (CC)
+        const bool is_sof = marker >= 0xC0 && marker <= 0xCF
+            && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (is_sof) {
+            // длина, точность, высота, ширина, число компонентов
+            if (length < 8) {
+                return {};
+            }
+            const uint8_t* sof = bytes + pos;
+            ImageInfo info;
+            info.size.height = (sof[3] << 8) | sof[4];
+            info.size.width = (sof[5] << 8) | sof[6];
+            info.channels = sof[7];
+            // высота 0 задаётся маркером DNL после данных - такие файлы не поддерживаются
+            if (info.size.width == 0 || info.size.height == 0 || info.channels == 0) {
+                return {};
+            }
+            info.format = ImageFormat::JPEG;
+            return info;
+        }
+
+        pos += length;
+    }
+
+    return {};
+}
+
+namespace {
+
+// Потоковые источник и приёмник владеют собственными объектами LibJPEG:
+// в одном потоке их может быть открыто несколько одновременно
+class JPEGRowSource : public RowSource {
+public:
+    JPEGRowSource(const Path& file, const JPEGLoadOptions& options) {
+        cinfo_.err = jpeg_std_error(&jerr_.pub);
+        jerr_.pub.error_exit = my_error_exit;
+        jpeg_create_decompress(&cinfo_);
+
+        infile_ = OpenCFile(file, false);
+        if (!infile_) {
+            return;
+        }
+
+        if (setjmp(jerr_.setjmp_buffer)) {
+            return;
+        }
+
+        jpeg_stdio_src(&cinfo_, infile_);
+        SetupDecompress(cinfo_, options);
+
+#ifndef JCS_EXTENSIONS
+        buffer_ = (*cinfo_.mem->alloc_sarray)
+                    ((j_common_ptr) &cinfo_, JPOOL_IMAGE, cinfo_.output_width * 3, 1);
+#endif
+        ok_ = true;
+    }
+
+    ~JPEGRowSource() override {
+        jpeg_destroy_decompress(&cinfo_);
+        if (infile_) {
+            fclose(infile_);
+        }
+    }
+
+    Size GetSize() const override {
+        if (!ok_) {
+            return {0, 0};
+        }
+        return {static_cast<int>(cinfo_.output_width), static_cast<int>(cinfo_.output_height)};
+    }
+
+    bool ReadRow(Color* dst) override {
+        if (!ok_ || cinfo_.output_scanline >= cinfo_.output_height) {
+            return false;
+        }
+        IMGLIB_STATS_TIMER(JPEG_DECODE);
+
+        if (setjmp(jerr_.setjmp_buffer)) {
+            ok_ = false;
+            return false;
+        }
+
+#ifdef JCS_EXTENSIONS
+        JSAMPROW row = reinterpret_cast<JSAMPROW>(dst);
+        (void) jpeg_read_scanlines(&cinfo_, &row, 1);
+#else
+        (void) jpeg_read_scanlines(&cinfo_, buffer_, 1);
+        UnpackRGB(reinterpret_cast<const std::byte*>(buffer_[0]), dst, cinfo_.output_width);
+#endif
+        IMGLIB_STATS_ADD(ROWS_DECODED, 1);
+        // файл читается через stdio блоками, поэтому объём учитывается в конце
+        if (cinfo_.output_scanline == cinfo_.output_height) {
+            IMGLIB_STATS_ADD(BYTES_READ, max(ftell(infile_), 0L));
+        }
+        return true;
+    }
+
+private:
+    jpeg_decompress_struct cinfo_;
+    my_error_mgr jerr_;
+    FILE* infile_ = nullptr;
+    JSAMPARRAY buffer_ = nullptr;
+    bool ok_ = false;
+};
+
+class JPEGRowSink : public RowSink {
+public:
+    JPEGRowSink(const Path& file, Size size, const JPEGSaveOptions& options)
+        : width_(size.width) {
+        cinfo_.err = jpeg_std_error(&jerr_.pub);
+        jerr_.pub.error_exit = my_error_exit;
+        jpeg_create_compress(&cinfo_);
+
+        outfile_ = OpenCFile(file, true);
+        if (!outfile_) {
+            return;
+        }
+
+        if (setjmp(jerr_.setjmp_buffer)) {
+            return;
+        }
+
+        jpeg_stdio_dest(&cinfo_, outfile_);
+        SetupCompress(cinfo_, size.width, size.height, options);
+        jpeg_start_compress(&cinfo_, TRUE);
+
+#ifndef JCS_EXTENSIONS
+        buffer_ = (*cinfo_.mem->alloc_sarray)
+                    ((j_common_ptr) &cinfo_, JPOOL_IMAGE, size.width * 3, 1);
+#endif
+        ok_ = true;
+    }
+
+    ~JPEGRowSink() override {
+        jpeg_destroy_compress(&cinfo_);
+        if (outfile_) {
+            fclose(outfile_);
+        }
+    }
+
+    bool WriteRow(const Color* row) override {
+        if (!ok_ || cinfo_.next_scanline >= cinfo_.image_height) {
+            return false;
+        }
+        IMGLIB_STATS_TIMER(JPEG_ENCODE);
+
+        if (setjmp(jerr_.setjmp_buffer)) {
+            ok_ = false;
+            return false;
+        }
+
+#ifdef JCS_EXTENSIONS
+        JSAMPROW input = reinterpret_cast<JSAMPROW>(const_cast<Color*>(row));
+        jpeg_write_scanlines(&cinfo_, &input, 1);
+#else
+        PackRGB(row, reinterpret_cast<std::byte*>(buffer_[0]), width_);
+        jpeg_write_scanlines(&cinfo_, buffer_, 1);
+#endif
+        IMGLIB_STATS_ADD(ROWS_ENCODED, 1);
+        return true;
+    }
+
+    bool Finish() override {
+        if (!ok_ || cinfo_.next_scanline != cinfo_.image_height) {
+            return false;
+        }
+
+        if (setjmp(jerr_.setjmp_buffer)) {
+            ok_ = false;
+            return false;
+        }
+
+        jpeg_finish_compress(&cinfo_);
+        ok_ = false;
+        IMGLIB_STATS_ADD(BYTES_WRITTEN, max(ftell(outfile_), 0L));
+
+        const bool closed = fclose(outfile_) == 0;
+        outfile_ = nullptr;
+        return closed;
+    }
+
+    bool IsOpen() const {
+        return ok_;
+    }
+
+private:
+    jpeg_compress_struct cinfo_;
+    my_error_mgr jerr_;
+    FILE* outfile_ = nullptr;
+    JSAMPARRAY buffer_ = nullptr;
+    int width_;
+    bool ok_ = false;
+};
+
+}  // namespace
+
+unique_ptr<RowSource> OpenJPEGSource(const Path& file, const JPEGLoadOptions& options) {
+    if (!IsValidScale(options.scale_denom)) {
+        return nullptr;
+    }
+    auto source = make_unique<JPEGRowSource>(file, options);
+    if (source->GetSize().width <= 0) {
+        return nullptr;
+    }
+    return source;
+}
+
+unique_ptr<RowSink> OpenJPEGSink(const Path& file, Size size, const JPEGSaveOptions& options) {
+    if (size.width <= 0 || size.height <= 0 || !IsValidSaveOptions(options)) {
+        return nullptr;
+    }
+    auto sink = make_unique<JPEGRowSink>(file, size, options);
+    if (!sink->IsOpen()) {
+        return nullptr;
+    }
+    return sink;
+}
+
 } // of namespace img_lib
\ No newline at end of file
@@ -1,12 +1,85 @@
 #pragma once
+#include "color_convert.h"
 #include "img_lib.h"
+#include "row_stream.h"
 
 #include <filesystem>
+#include <memory>
 
 namespace img_lib {
 using Path = std::filesystem::path;
 
-bool SaveJPEG(const Path& file, const Image& image);
-Image LoadJPEG(const Path& file);
+// параметры декодирования JPEG
+struct JPEGLoadOptions {
+    // изображение уменьшается при декодировании в 1, 2, 4 или 8 раз,
+    // что намного быстрее полного декодирования с последующим масштабированием
+    int scale_denom = 1;
+    // быстрое целочисленное обратное ДКП ценой небольшой потери точности
+    bool fast_dct = false;
+    // сглаживающая интерполяция цветоразностных каналов;
+    // без неё декодирование быстрее, но границы цветов грубее
+    bool fancy_upsampling = true;
+    // число строк, декодируемых за один вызов; 0 - рекомендованное LibJPEG
+    int strip_rows = 0;
+};
+
+// способ прореживания цветоразностных каналов при сжатии
+enum class JPEGSubsampling {
+    S444,  // без прореживания
+    S422,  // вдвое по горизонтали
+    S420   // вдвое по горизонтали и вертикали
+};
+
+// реализация прямого ДКП при сжатии
+enum class JPEGDCTMethod {
+    ISLOW,  // точное целочисленное
+    IFAST,  // быстрое целочисленное, чуть хуже качество
+    FLOAT   // с плавающей точкой
+};
+
+// параметры сжатия JPEG; значения по умолчанию совпадают с jpeg_set_defaults
+struct JPEGSaveOptions {
+    // качество от 1 до 100
+    int quality = 75;
+    JPEGSubsampling subsampling = JPEGSubsampling::S420;
+    // оптимальные таблицы Хаффмана: файл меньше, но нужен второй проход
+    bool optimize_coding = false;
+    // прогрессивная развёртка: обычно меньше по размеру, но медленнее
+    bool progressive = false;
+    JPEGDCTMethod dct_method = JPEGDCTMethod::ISLOW;
+};
+
+bool SaveJPEG(const Path& file, const Image& image, const JPEGSaveOptions& options = {});
+Image LoadJPEG(const Path& file, const JPEGLoadOptions& options = {});
+
+// декодирование из памяти и кодирование в память, без обращения к файлам
+Image LoadJPEG(ByteSpan data, const JPEGLoadOptions& options = {});
+bool SaveJPEG(Bytes& out, const Image& image, const JPEGSaveOptions& options = {});
+
+// распаковка без перехода к RGB. LoadJPEGYCbCr возвращает плоскости Y, Cb, Cr
+// в том разрешении, в котором они хранятся в файле (при 4:2:0 Cb и Cr вдвое
+// меньше по каждой оси): LibJPEG не интерполирует их и не преобразует цвет.
+// у серых файлов Cb и Cr полного размера и равны 128, файлы в других
+// пространствах переводятся через Color.
+// LoadJPEGGray возвращает только яркость, и у файлов YCbCr цветоразностные
+// каналы не распаковываются вовсе. при ошибке возвращают пустое изображение
+YCbCrImage LoadJPEGYCbCr(ByteSpan data, const JPEGLoadOptions& options = {});
+YCbCrImage LoadJPEGYCbCr(const Path& file, const JPEGLoadOptions& options = {});
+GrayImage LoadJPEGGray(ByteSpan data, const JPEGLoadOptions& options = {});
+GrayImage LoadJPEGGray(const Path& file, const JPEGLoadOptions& options = {});
+
+// распаковывает только область (x, y, w, h) в координатах изображения
+// после масштабирования: строки выше области пропускаются, столбцы
+// обрезаются до ближайших границ MCU, строки ниже не распаковываются
+Image LoadJPEGRegion(ByteSpan data, int x, int y, int w, int h, const JPEGLoadOptions& options = {});
+Image LoadJPEGRegion(const Path& file, int x, int y, int w, int h, const JPEGLoadOptions& options = {});
+
+// ищет маркер SOF, не загружая таблицы и не декодируя данные;
+// при ошибке возвращает пустые сведения
+ImageInfo ProbeJPEG(ByteSpan data);
+
+// потоковое чтение и запись строк; при ошибке открытия возвращают nullptr
+std::unique_ptr<RowSource> OpenJPEGSource(const Path& file, const JPEGLoadOptions& options = {});
+std::unique_ptr<RowSink> OpenJPEGSink(const Path& file, Size size, const JPEGSaveOptions& options = {});
 
 } // of namespace img_lib
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "mapped_file.h"
+#include "image_stats.h"
+
+#include <fstream>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define IMGLIB_HAS_MMAP 1
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace img_lib {
+
+MappedFile::MappedFile(const Path& file) {
+    IMGLIB_STATS_TIMER(FILE_MAP);
+#ifdef IMGLIB_HAS_MMAP
+    const int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return;
+    }
+
+    void* addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // дескриптор больше не нужен - отображение держит файл само
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return;
+    }
+
+    // строки читаются один раз и по порядку
+    madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    data_ = static_cast<const std::byte*>(addr);
+    size_ = static_cast<size_t>(st.st_size);
+    mapped_ = true;
+    IMGLIB_STATS_ADD(BYTES_READ, size_);
+#else
+    ifstream in(file, ios::binary | ios::ate);
+    if (!in) {
+        return;
+    }
+
+    const streamoff size = in.tellg();
+    if (size <= 0) {
+        return;
+    }
+
+    fallback_.resize(static_cast<size_t>(size));
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char*>(fallback_.data()), size)) {
+        fallback_.clear();
+        return;
+    }
+
+    data_ = fallback_.data();
+    size_ = fallback_.size();
+    IMGLIB_STATS_ADD(BYTES_READ, size_);
+#endif
+}
+
+MappedFile::~MappedFile() {
+    Reset();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data_(exchange(other.data_, nullptr))
+    , size_(exchange(other.size_, 0))
+    , mapped_(exchange(other.mapped_, false))
+    , fallback_(move(other.fallback_)) {
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        Reset();
+        data_ = exchange(other.data_, nullptr);
+        size_ = exchange(other.size_, 0);
+        mapped_ = exchange(other.mapped_, false);
+        fallback_ = move(other.fallback_);
+    }
+    return *this;
+}
+
+void MappedFile::Reset() {
+#ifdef IMGLIB_HAS_MMAP
+    if (mapped_) {
+        munmap(const_cast<std::byte*>(data_), size_);
+    }
+#endif
+    data_ = nullptr;
+    size_ = 0;
+    mapped_ = false;
+    fallback_.clear();
+}
+
+}  // namespace img_lib
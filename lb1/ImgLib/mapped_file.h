@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+namespace img_lib {
+using Path = std::filesystem::path;
+
+// файл, отображённый в память только для чтения.
+// под POSIX используется mmap, на остальных платформах
+// файл целиком читается во внутренний буфер
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const Path& file);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const std::byte* GetData() const {
+        return data_;
+    }
+
+    size_t GetSize() const {
+        return size_;
+    }
+
+    // пустой или неоткрывшийся файл считается некорректным
+    explicit operator bool() const {
+        return data_ != nullptr && size_ > 0;
+    }
+
+    bool operator!() const {
+        return !operator bool();
+    }
+
+private:
+    void Reset();
+
+    const std::byte* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+
+    std::vector<std::byte> fallback_;
+};
+
+}  // namespace img_lib
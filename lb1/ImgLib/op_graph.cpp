@@ -0,0 +1,379 @@
+#include "op_graph.h"
+#include "image_ops.h"
+#include "image_pool.h"
+#include "image_region.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+using namespace std;
+
+namespace img_lib {
+
+// веса 0.299, 0.587, 0.114 в масштабе 2^16, как в ImageToGray
+static const int R_WEIGHT = 19595;
+static const int G_WEIGHT = 38470;
+static const int B_WEIGHT = 7471;
+
+// веса интерполяции хранятся в масштабе 2^8
+static const int WEIGHT_ONE = 256;
+
+static std::byte Lerp(std::byte a, std::byte b, int weight) {
+    return std::byte((to_integer<int>(a) * (WEIGHT_ONE - weight) + to_integer<int>(b) * weight + WEIGHT_ONE / 2) >> 8);
+}
+
+static Color Lerp(Color a, Color b, int weight) {
+    return {Lerp(a.r, b.r, weight), Lerp(a.g, b.g, weight), Lerp(a.b, b.b, weight), Lerp(a.a, b.a, weight)};
+}
+
+OpGraph::OpGraph(Size source_size)
+    : source_size_(source_size)
+    , size_(source_size) {
+    valid_ = source_size.width > 0 && source_size.height > 0;
+}
+
+OpGraph& OpGraph::Crop(int x, int y, int w, int h) {
+    if (!IsValidRegion(size_, x, y, w, h)) {
+        valid_ = false;
+        return *this;
+    }
+    AddGeometry({1, static_cast<double>(x)}, {1, static_cast<double>(y)}, {w, h});
+    return *this;
+}
+
+OpGraph& OpGraph::Resize(int w, int h) {
+    if (w <= 0 || h <= 0) {
+        valid_ = false;
+        return *this;
+    }
+    AddGeometry({static_cast<double>(size_.width) / w, 0}, {static_cast<double>(size_.height) / h, 0}, {w, h});
+    return *this;
+}
+
+OpGraph& OpGraph::FlipHorizontal() {
+    AddGeometry({-1, static_cast<double>(size_.width)}, {1, 0}, size_);
+    return *this;
+}
+
+OpGraph& OpGraph::FlipVertical() {
+    AddGeometry({1, 0}, {-1, static_cast<double>(size_.height)}, size_);
+    return *this;
+}
+
+OpGraph& OpGraph::Grayscale() {
+    AddPixelOp({PixelOpType::GRAYSCALE});
+    return *this;
+}
+
+OpGraph& OpGraph::Invert() {
+    AddPixelOp({PixelOpType::INVERT});
+    return *this;
+}
+
+OpGraph& OpGraph::SwapRB() {
+    AddPixelOp({PixelOpType::SWAP_RB});
+    return *this;
+}
+
+OpGraph& OpGraph::SetAlpha(std::byte alpha) {
+    PixelOp op{PixelOpType::SET_ALPHA};
+    op.color.a = alpha;
+    AddPixelOp(op);
+    return *this;
+}
+
+OpGraph& OpGraph::FillRect(int x, int y, int w, int h, Color color) {
+    // прямоугольник целиком за границами ничего не меняет
+    const int x0 = max(x, 0);
+    const int y0 = max(y, 0);
+    const int x1 = static_cast<int>(min<long long>(static_cast<long long>(x) + max(w, 0), size_.width));
+    const int y1 = static_cast<int>(min<long long>(static_cast<long long>(y) + max(h, 0), size_.height));
+    if (x0 < x1 && y0 < y1) {
+        AddPixelOp({PixelOpType::FILL_RECT, color, x0, y0, x1, y1});
+    }
+    return *this;
+}
+
+void OpGraph::AddGeometry(AxisMap x_op, AxisMap y_op, Size new_size) {
+    empty_ = false;
+
+    // метки остаются на месте относительно содержимого изображения:
+    // их границы переводятся в новые координаты обратным отображением
+    const auto map_edges = [](int a, int b, AxisMap op, int limit, int& lo, int& hi) {
+        const double na = (a - op.offset) / op.scale;
+        const double nb = (b - op.offset) / op.scale;
+        lo = clamp(static_cast<int>(lround(min(na, nb))), 0, limit);
+        hi = clamp(static_cast<int>(lround(max(na, nb))), 0, limit);
+    };
+    for (PixelOp& op : pixel_ops_) {
+        if (op.type == PixelOpType::FILL_RECT) {
+            map_edges(op.x0, op.x1, x_op, new_size.width, op.x0, op.x1);
+            map_edges(op.y0, op.y1, y_op, new_size.height, op.y0, op.y1);
+        }
+    }
+    pixel_ops_.erase(remove_if(pixel_ops_.begin(), pixel_ops_.end(), [](const PixelOp& op) {
+        return op.type == PixelOpType::FILL_RECT && (op.x0 >= op.x1 || op.y0 >= op.y1);
+    }), pixel_ops_.end());
+
+    x_map_ = {x_map_.scale * x_op.scale, x_map_.scale * x_op.offset + x_map_.offset};
+    y_map_ = {y_map_.scale * y_op.scale, y_map_.scale * y_op.offset + y_map_.offset};
+    size_ = new_size;
+}
+
+void OpGraph::AddPixelOp(PixelOp op) {
+    empty_ = false;
+    pixel_ops_.push_back(op);
+}
+
+class OpGraph::Renderer {
+public:
+    // отсчёты источника для одной координаты результата: second
+    // берётся с весом weight из WEIGHT_ONE, first - с остальным
+    struct Taps {
+        int first = 0;
+        int second = 0;
+        int weight = 0;
+    };
+
+    explicit Renderer(const OpGraph& graph)
+        : width_(graph.size_.width)
+        , source_height_(graph.source_size_.height)
+        , y_map_(graph.y_map_)
+        , pixel_ops_(graph.pixel_ops_) {
+        const AxisMap x_map = graph.x_map_;
+        const bool whole_offset = x_map.offset == floor(x_map.offset);
+        if (x_map.scale == 1 && whole_offset) {
+            x_mode_ = XMode::COPY;
+            x_offset_ = static_cast<int>(x_map.offset);
+        } else if (x_map.scale == -1 && whole_offset) {
+            // p = -(x + 0.5) + offset - 0.5 = offset - 1 - x
+            x_mode_ = XMode::REVERSE;
+            x_offset_ = static_cast<int>(x_map.offset) - 1;
+        } else {
+            x_mode_ = XMode::RESAMPLE;
+            x_taps_.resize(width_);
+            for (int x = 0; x < width_; ++x) {
+                x_taps_[x] = GetTaps(x_map, x, graph.source_size_.width);
+            }
+        }
+    }
+
+    Taps GetRowTaps(int y) const {
+        return GetTaps(y_map_, y, source_height_);
+    }
+
+    void Render(int y, const Color* first, const Color* second, int weight, Color* dst) const {
+        switch (x_mode_) {
+            case XMode::COPY:
+                if (weight == 0) {
+                    memcpy(dst, first + x_offset_, static_cast<size_t>(width_) * sizeof(Color));
+                } else {
+                    for (int x = 0; x < width_; ++x) {
+                        dst[x] = Lerp(first[x_offset_ + x], second[x_offset_ + x], weight);
+                    }
+                }
+                break;
+            case XMode::REVERSE:
+                if (weight == 0) {
+                    reverse_copy(first + x_offset_ - width_ + 1, first + x_offset_ + 1, dst);
+                } else {
+                    for (int x = 0; x < width_; ++x) {
+                        dst[x] = Lerp(first[x_offset_ - x], second[x_offset_ - x], weight);
+                    }
+                }
+                break;
+            case XMode::RESAMPLE:
+                for (int x = 0; x < width_; ++x) {
+                    const Taps& tap = x_taps_[x];
+                    const Color top = Lerp(first[tap.first], first[tap.second], tap.weight);
+                    dst[x] = weight == 0 ? top : Lerp(top, Lerp(second[tap.first], second[tap.second], tap.weight), weight);
+                }
+                break;
+        }
+
+        for (const PixelOp& op : pixel_ops_) {
+            ApplyPixelOp(op, y, dst);
+        }
+    }
+
+private:
+    enum class XMode {
+        COPY,     // непрерывный участок строки источника
+        REVERSE,  // тот же участок в обратном порядке
+        RESAMPLE  // по таблице x_taps_
+    };
+
+    static Taps GetTaps(AxisMap map, int index, int length) {
+        const double p = clamp(map.scale * (index + 0.5) + map.offset - 0.5, 0.0, static_cast<double>(length - 1));
+        Taps taps;
+        taps.first = static_cast<int>(p);
+        taps.second = min(taps.first + 1, length - 1);
+        taps.weight = static_cast<int>(lround((p - taps.first) * WEIGHT_ONE));
+        if (taps.weight >= WEIGHT_ONE) {
+            taps.first = taps.second;
+            taps.weight = 0;
+        }
+        if (taps.weight == 0) {
+            taps.second = taps.first;
+        }
+        return taps;
+    }
+
+    void ApplyPixelOp(const PixelOp& op, int y, Color* dst) const {
+        switch (op.type) {
+            case PixelOpType::GRAYSCALE:
+                for (int x = 0; x < width_; ++x) {
+                    const int luma = R_WEIGHT * to_integer<int>(dst[x].r) + G_WEIGHT * to_integer<int>(dst[x].g)
+                        + B_WEIGHT * to_integer<int>(dst[x].b);
+                    const std::byte value{static_cast<uint8_t>((luma + (1 << 15)) >> 16)};
+                    dst[x] = {value, value, value, dst[x].a};
+                }
+                break;
+            case PixelOpType::INVERT:
+                for (int x = 0; x < width_; ++x) {
+                    dst[x] = {~dst[x].r, ~dst[x].g, ~dst[x].b, dst[x].a};
+                }
+                break;
+            case PixelOpType::SWAP_RB:
+                for (int x = 0; x < width_; ++x) {
+                    swap(dst[x].r, dst[x].b);
+                }
+                break;
+            case PixelOpType::SET_ALPHA:
+                for (int x = 0; x < width_; ++x) {
+                    dst[x].a = op.color.a;
+                }
+                break;
+            case PixelOpType::FILL_RECT:
+                if (y >= op.y0 && y < op.y1) {
+                    fill(dst + op.x0, dst + op.x1, op.color);
+                }
+                break;
+        }
+    }
+
+    const int width_;
+    const int source_height_;
+    const AxisMap y_map_;
+    const vector<PixelOp> pixel_ops_;
+    XMode x_mode_ = XMode::COPY;
+    int x_offset_ = 0;
+    vector<Taps> x_taps_;
+};
+
+namespace {
+
+class GraphRowSource : public RowSource {
+public:
+    GraphRowSource(const OpGraph& graph, unique_ptr<RowSource> source)
+        : renderer_(graph)
+        , source_(move(source))
+        , size_(graph.GetSize())
+        , sequential_(graph.IsSequential()) {
+        if (sequential_) {
+            const size_t width = static_cast<size_t>(graph.GetSourceSize().width);
+            window_[0].resize(width);
+            window_[1].resize(width);
+        }
+    }
+
+    Size GetSize() const override {
+        return size_;
+    }
+
+    bool ReadRow(Color* dst) override {
+        if (next_row_ >= size_.height) {
+            return false;
+        }
+        const OpGraph::Renderer::Taps taps = renderer_.GetRowTaps(next_row_);
+
+        const Color* first = nullptr;
+        const Color* second = nullptr;
+        if (sequential_) {
+            // строки источника нужны по возрастанию, а second не дальше
+            // first + 1: в окне всегда лежат строки last_read_ - 1 и last_read_
+            while (last_read_ < taps.second) {
+                ++last_read_;
+                if (!source_->ReadRow(window_[last_read_ % 2].data())) {
+                    return false;
+                }
+            }
+            first = window_[taps.first % 2].data();
+            second = window_[taps.second % 2].data();
+        } else {
+            if (!buffer_ && !ReadSource()) {
+                return false;
+            }
+            const Image& buffer = buffer_;
+            first = buffer.GetLine(taps.first);
+            second = buffer.GetLine(taps.second);
+        }
+
+        renderer_.Render(next_row_, first, second, taps.weight, dst);
+        ++next_row_;
+        return true;
+    }
+
+private:
+    bool ReadSource() {
+        const Size size = source_->GetSize();
+        buffer_ = AcquireImage(size.width, size.height);
+        for (int y = 0; y < size.height; ++y) {
+            if (!source_->ReadRow(buffer_.GetLine(y))) {
+                buffer_ = {};
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const OpGraph::Renderer renderer_;
+    unique_ptr<RowSource> source_;
+    const Size size_;
+    const bool sequential_;
+    int next_row_ = 0;
+
+    // последовательный граф: две последние прочитанные строки источника
+    vector<Color> window_[2];
+    int last_read_ = -1;
+    // граф с отражением по вертикали: источник целиком
+    Image buffer_;
+};
+
+bool IsSameSize(Size lhs, Size rhs) {
+    return lhs.width == rhs.width && lhs.height == rhs.height;
+}
+
+}  // namespace
+
+Image ApplyGraph(const OpGraph& graph, const Image& image) {
+    if (!graph || !IsSameSize(graph.GetSourceSize(), {image.GetWidth(), image.GetHeight()})) {
+        return {};
+    }
+    if (graph.IsEmpty()) {
+        return image;
+    }
+
+    const OpGraph::Renderer renderer(graph);
+    const Size size = graph.GetSize();
+    Image result = AcquireImage(size.width, size.height);
+    ForEachRow(result, [&renderer, &image](int y, Color* line) {
+        const OpGraph::Renderer::Taps taps = renderer.GetRowTaps(y);
+        renderer.Render(y, image.GetLine(taps.first), image.GetLine(taps.second), taps.weight, line);
+    });
+    return result;
+}
+
+unique_ptr<RowSource> OpenGraphSource(const OpGraph& graph, unique_ptr<RowSource> source) {
+    if (!graph || !source || !IsSameSize(graph.GetSourceSize(), source->GetSize())) {
+        return nullptr;
+    }
+    if (graph.IsEmpty()) {
+        return source;
+    }
+    return make_unique<GraphRowSource>(graph, move(source));
+}
+
+}  // namespace img_lib
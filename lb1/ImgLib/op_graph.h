@@ -0,0 +1,119 @@
+#pragma once
+#include "img_lib.h"
+#include "row_stream.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace img_lib {
+
+// цепочка правок изображения, выполняемая за один проход по строкам результата.
+// геометрические операции (обрезка, масштабирование, отражения) сводятся к одному
+// отображению координат результата в координаты источника, поэтому промежуточные
+// изображения не строятся. поканальные операции и метки применяются к готовой
+// строке в порядке добавления; их координаты пересчитываются последующими
+// геометрическими операциями. при масштабировании это приближение: метка
+// не размывается, а цвет смешивается до поканальных операций.
+// операция с неверными аргументами делает граф некорректным
+class OpGraph {
+public:
+    explicit OpGraph(Size source_size);
+
+    // координаты задаются в изображении, получившемся после предыдущих операций;
+    // область обрезки должна целиком лежать внутри него
+    OpGraph& Crop(int x, int y, int w, int h);
+    // билинейная интерполяция по двум соседним пикселям каждой оси
+    OpGraph& Resize(int w, int h);
+    OpGraph& FlipHorizontal();
+    OpGraph& FlipVertical();
+
+    // яркость по весам BT.601, как в ImageToGray; альфа-канал не меняется
+    OpGraph& Grayscale();
+    OpGraph& Invert();
+    OpGraph& SwapRB();
+    OpGraph& SetAlpha(std::byte alpha);
+
+    // метка: прямоугольник, залитый цветом; части за границами отбрасываются
+    OpGraph& FillRect(int x, int y, int w, int h, Color color);
+
+    Size GetSourceSize() const {
+        return source_size_;
+    }
+
+    // размер результата
+    Size GetSize() const {
+        return size_;
+    }
+
+    bool IsEmpty() const {
+        return empty_;
+    }
+
+    // true, если строки источника нужны по порядку сверху вниз и граф
+    // применим к потоку строк без буфера на всё изображение
+    bool IsSequential() const {
+        return y_map_.scale > 0;
+    }
+
+    explicit operator bool() const {
+        return valid_;
+    }
+
+    bool operator!() const {
+        return !operator bool();
+    }
+
+    // скомпилированный граф: таблицы выборки столбцов и строк; определён в op_graph.cpp
+    class Renderer;
+
+private:
+    // u_src = scale * u + offset для непрерывных координат, в которых
+    // пиксель i занимает отрезок [i, i + 1)
+    struct AxisMap {
+        double scale = 1;
+        double offset = 0;
+    };
+
+    enum class PixelOpType {
+        GRAYSCALE,
+        INVERT,
+        SWAP_RB,
+        SET_ALPHA,
+        FILL_RECT
+    };
+
+    struct PixelOp {
+        PixelOpType type;
+        Color color = {};
+        // прямоугольник FILL_RECT [x0, x1) x [y0, y1) в координатах результата
+        int x0 = 0;
+        int y0 = 0;
+        int x1 = 0;
+        int y1 = 0;
+    };
+
+    // добавляет к отображению операцию u_prev = s * u_new + t по каждой оси
+    void AddGeometry(AxisMap x_op, AxisMap y_op, Size new_size);
+    void AddPixelOp(PixelOp op);
+
+    Size source_size_;
+    Size size_;
+    AxisMap x_map_;
+    AxisMap y_map_;
+    std::vector<PixelOp> pixel_ops_;
+    bool valid_ = true;
+    bool empty_ = true;
+};
+
+// результат графа для изображения в памяти. пустой граф возвращает изображение
+// без копирования, иначе строки результата считаются параллельно в общем пуле.
+// для некорректного графа или неподходящего размера возвращается пустое изображение
+Image ApplyGraph(const OpGraph& graph, const Image& image);
+
+// источник строк результата графа поверх источника строк исходного изображения.
+// для последовательного графа в памяти держатся две строки источника, иначе
+// источник при первом чтении загружается целиком. при ошибке возвращает nullptr
+std::unique_ptr<RowSource> OpenGraphSource(const OpGraph& graph, std::unique_ptr<RowSource> source);
+
+}  // namespace img_lib
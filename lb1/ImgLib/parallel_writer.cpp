@@ -0,0 +1,121 @@
+#include "parallel_writer.h"
+#include "image_stats.h"
+
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define IMGLIB_HAS_PWRITE 1
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace img_lib {
+
+// объём одной полосы: достаточно крупный, чтобы запись шла большими
+// блоками, и достаточно мелкий, чтобы нагрузить все потоки
+static const size_t WRITER_CHUNK_BYTES = size_t{1} << 20;
+
+ThreadPool& GetWriterThreadPool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+#ifdef IMGLIB_HAS_PWRITE
+// дописывает буфер целиком: pwrite может записать меньше запрошенного
+static bool WriteAt(int fd, const std::byte* data, size_t size, off_t offset) {
+    IMGLIB_STATS_TIMER(FILE_WRITE);
+    IMGLIB_STATS_ADD(BYTES_WRITTEN, size);
+    while (size > 0) {
+        const ssize_t written = pwrite(fd, data, size, offset);
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+        offset += written;
+    }
+    return true;
+}
+#endif
+
+bool WriteRowsParallel(const Path& file, ByteSpan header, int row_count, size_t row_size,
+                       const RowEncoder& encode_rows, ThreadPool& pool) {
+    if (row_count <= 0 || row_size == 0) {
+        return false;
+    }
+
+    const int rows_per_chunk = static_cast<int>(max<size_t>(1, WRITER_CHUNK_BYTES / row_size));
+    const int chunk_count = (row_count + rows_per_chunk - 1) / rows_per_chunk;
+
+    // кодирует полосу с номером chunk в собственный буфер задачи
+    auto encode_chunk = [&](int chunk, vector<std::byte>& buffer) {
+        const int first = chunk * rows_per_chunk;
+        const int count = min(rows_per_chunk, row_count - first);
+        buffer.resize(row_size * count);
+        encode_rows(first, count, buffer.data());
+        return count;
+    };
+
+#ifdef IMGLIB_HAS_PWRITE
+    const int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    // файл сразу получает окончательный размер, и потоки пишут
+    // каждый в свой участок, не дожидаясь друг друга
+    const off_t total_size = static_cast<off_t>(header.size + row_size * row_count);
+    bool ok = ftruncate(fd, total_size) == 0 && WriteAt(fd, header.data, header.size, 0);
+
+    if (ok) {
+        vector<future<bool>> pending;
+        pending.reserve(chunk_count);
+        for (int chunk = 0; chunk < chunk_count; ++chunk) {
+            pending.push_back(pool.Submit([&, chunk] {
+                vector<std::byte> buffer;
+                encode_chunk(chunk, buffer);
+                const off_t offset = static_cast<off_t>(header.size + row_size * rows_per_chunk * chunk);
+                return WriteAt(fd, buffer.data(), buffer.size(), offset);
+            }));
+        }
+        // дожидается всех задач, даже если какая-то уже завершилась с ошибкой
+        for (future<bool>& task : pending) {
+            ok = task.get() && ok;
+        }
+    }
+
+    return close(fd) == 0 && ok;
+#else
+    ofstream out(file, ios::binary);
+    if (!out) {
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(header.data), header.size);
+    IMGLIB_STATS_ADD(BYTES_WRITTEN, header.size);
+
+    vector<future<vector<std::byte>>> pending;
+    pending.reserve(chunk_count);
+    for (int chunk = 0; chunk < chunk_count; ++chunk) {
+        pending.push_back(pool.Submit([&, chunk] {
+            vector<std::byte> buffer;
+            encode_chunk(chunk, buffer);
+            return buffer;
+        }));
+    }
+    for (auto& task : pending) {
+        const vector<std::byte> buffer = task.get();
+        IMGLIB_STATS_TIMER(FILE_WRITE);
+        IMGLIB_STATS_ADD(BYTES_WRITTEN, buffer.size());
+        out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    }
+    return out.good();
+#endif
+}
+
+}  // namespace img_lib
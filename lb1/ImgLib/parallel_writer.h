@@ -0,0 +1,28 @@
+#pragma once
+
+#include "img_lib.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+
+namespace img_lib {
+using Path = std::filesystem::path;
+
+// кодирует строки файла [first, first + count) подряд в dst,
+// по row_size байт на строку. номер строки - порядковый номер в файле
+using RowEncoder = std::function<void(int first, int count, std::byte* dst)>;
+
+// записывает файл из заголовка и row_count строк одинаковой длины.
+// смещение каждой строки известно заранее, поэтому файл сразу создаётся
+// нужного размера, а полосы строк кодируются в пуле потоков и записываются
+// на своё место позиционной записью (pwrite). на платформах без pwrite
+// полосы кодируются параллельно, но пишутся в файл по порядку
+bool WriteRowsParallel(const Path& file, ByteSpan header, int row_count, size_t row_size,
+                       const RowEncoder& encode_rows, ThreadPool& pool);
+
+// общий пул потоков для параллельной записи, по потоку на ядро
+ThreadPool& GetWriterThreadPool();
+
+}  // namespace img_lib
@@ -0,0 +1,312 @@
+#include "pixel_pack.h"
+#include "image_stats.h"
+
+#include <atomic>
+#include <cstdint>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define IMGLIB_PACK_X86 1
+    #include <immintrin.h>
+    #define IMGLIB_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+using namespace std;
+
+namespace img_lib {
+
+namespace {
+
+// скалярные версии: ими же дорабатываются хвосты строк в SIMD-ядрах
+template <bool BGR>
+void UnpackScalar(const std::byte* src, Color* dst, int count) {
+    for (int x = 0; x < count; ++x) {
+        const std::byte* p = src + x * 3;
+        dst[x] = BGR ? Color{p[2], p[1], p[0], std::byte{255}}
+                     : Color{p[0], p[1], p[2], std::byte{255}};
+    }
+}
+
+template <bool BGR>
+void PackScalar(const Color* src, std::byte* dst, int count) {
+    for (int x = 0; x < count; ++x) {
+        std::byte* p = dst + x * 3;
+        p[0] = BGR ? src[x].b : src[x].r;
+        p[1] = src[x].g;
+        p[2] = BGR ? src[x].r : src[x].b;
+    }
+}
+
+// перестановка R и B в 4-байтовых пикселях; OPAQUE заполняет альфа-канал
+template <bool OPAQUE>
+void SwapRBScalar(const std::byte* src, std::byte* dst, int count) {
+    for (int x = 0; x < count; ++x) {
+        const std::byte* p = src + x * 4;
+        std::byte* q = dst + x * 4;
+        const std::byte r = p[2];
+        const std::byte b = p[0];
+        q[0] = r;
+        q[1] = p[1];
+        q[2] = b;
+        q[3] = OPAQUE ? std::byte{255} : p[3];
+    }
+}
+
+#ifdef IMGLIB_PACK_X86
+
+// маски перестановки байт для pshufb; -128 обнуляет байт
+template <bool BGR>
+IMGLIB_TARGET("ssse3") __m128i GetUnpackMask() {
+    return BGR ? _mm_setr_epi8(2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128)
+               : _mm_setr_epi8(0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128);
+}
+
+template <bool BGR>
+IMGLIB_TARGET("ssse3") __m128i GetPackMask() {
+    return BGR ? _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -128, -128, -128, -128)
+               : _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -128, -128, -128, -128);
+}
+
+// за итерацию обрабатывается 4 пикселя, но читается и пишется 16 байт
+// упакованных данных, поэтому цикл останавливается за 6 пикселей до конца
+template <bool BGR>
+IMGLIB_TARGET("ssse3") void UnpackSSSE3(const std::byte* src, Color* dst, int count) {
+    const __m128i mask = GetUnpackMask<BGR>();
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+
+    int x = 0;
+    for (; x + 6 <= count; x += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 3));
+        v = _mm_or_si128(_mm_shuffle_epi8(v, mask), alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), v);
+    }
+    UnpackScalar<BGR>(src + x * 3, dst + x, count - x);
+}
+
+template <bool BGR>
+IMGLIB_TARGET("ssse3") void PackSSSE3(const Color* src, std::byte* dst, int count) {
+    const __m128i mask = GetPackMask<BGR>();
+
+    int x = 0;
+    for (; x + 6 <= count; x += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 3), _mm_shuffle_epi8(v, mask));
+    }
+    PackScalar<BGR>(src + x, dst + x * 3, count - x);
+}
+
+// vpshufb переставляет байты только внутри 128-битных половин,
+// поэтому каждая половина регистра обрабатывает свои 4 пикселя
+template <bool BGR>
+IMGLIB_TARGET("avx2") void UnpackAVX2(const std::byte* src, Color* dst, int count) {
+    const __m256i mask = _mm256_broadcastsi128_si256(GetUnpackMask<BGR>());
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+
+    int x = 0;
+    for (; x + 10 <= count; x += 8) {
+        const std::byte* p = src + x * 3;
+        const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        v = _mm256_or_si256(_mm256_shuffle_epi8(v, mask), alpha);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), v);
+    }
+    UnpackSSSE3<BGR>(src + x * 3, dst + x, count - x);
+}
+
+template <bool BGR>
+IMGLIB_TARGET("avx2") void PackAVX2(const Color* src, std::byte* dst, int count) {
+    const __m256i mask = _mm256_broadcastsi128_si256(GetPackMask<BGR>());
+
+    int x = 0;
+    for (; x + 10 <= count; x += 8) {
+        const __m256i v = _mm256_shuffle_epi8(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x)), mask);
+        std::byte* p = dst + x * 3;
+        // вторая запись перекрывает 4 нулевых байта первой
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_castsi256_si128(v));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 12), _mm256_extracti128_si256(v, 1));
+    }
+    PackSSSE3<BGR>(src + x, dst + x * 3, count - x);
+}
+
+IMGLIB_TARGET("ssse3") __m128i GetSwapRBMask() {
+    return _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+}
+
+// размер пикселя не меняется, поэтому цикл обходится без перекрытий
+template <bool OPAQUE>
+IMGLIB_TARGET("ssse3") void SwapRBSSSE3(const std::byte* src, std::byte* dst, int count) {
+    const __m128i mask = GetSwapRBMask();
+    const __m128i alpha = _mm_set1_epi32(OPAQUE ? static_cast<int>(0xFF000000u) : 0);
+
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        v = _mm_or_si128(_mm_shuffle_epi8(v, mask), alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), v);
+    }
+    SwapRBScalar<OPAQUE>(src + x * 4, dst + x * 4, count - x);
+}
+
+template <bool OPAQUE>
+IMGLIB_TARGET("avx2") void SwapRBAVX2(const std::byte* src, std::byte* dst, int count) {
+    const __m256i mask = _mm256_broadcastsi128_si256(GetSwapRBMask());
+    const __m256i alpha = _mm256_set1_epi32(OPAQUE ? static_cast<int>(0xFF000000u) : 0);
+
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4));
+        v = _mm256_or_si256(_mm256_shuffle_epi8(v, mask), alpha);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4), v);
+    }
+    SwapRBSSSE3<OPAQUE>(src + x * 4, dst + x * 4, count - x);
+}
+
+PackKernel DetectBestKernel() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return PackKernel::AVX2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return PackKernel::SSSE3;
+    }
+    return PackKernel::SCALAR;
+}
+
+#else
+
+PackKernel DetectBestKernel() {
+    return PackKernel::SCALAR;
+}
+
+#endif
+
+PackKernel GetBestKernel() {
+    static const PackKernel best = DetectBestKernel();
+    return best;
+}
+
+atomic<PackKernel>& ActiveKernel() {
+    static atomic<PackKernel> kernel{GetBestKernel()};
+    return kernel;
+}
+
+template <bool BGR>
+void Unpack(const std::byte* src, Color* dst, int count) {
+    IMGLIB_STATS_TIMER(PIXEL_PACK);
+    switch (ActiveKernel().load(memory_order_relaxed)) {
+#ifdef IMGLIB_PACK_X86
+        case PackKernel::AVX2:
+            return UnpackAVX2<BGR>(src, dst, count);
+        case PackKernel::SSSE3:
+            return UnpackSSSE3<BGR>(src, dst, count);
+#endif
+        default:
+            return UnpackScalar<BGR>(src, dst, count);
+    }
+}
+
+template <bool BGR>
+void Pack(const Color* src, std::byte* dst, int count) {
+    IMGLIB_STATS_TIMER(PIXEL_PACK);
+    switch (ActiveKernel().load(memory_order_relaxed)) {
+#ifdef IMGLIB_PACK_X86
+        case PackKernel::AVX2:
+            return PackAVX2<BGR>(src, dst, count);
+        case PackKernel::SSSE3:
+            return PackSSSE3<BGR>(src, dst, count);
+#endif
+        default:
+            return PackScalar<BGR>(src, dst, count);
+    }
+}
+
+template <bool OPAQUE>
+void SwapRB(const std::byte* src, std::byte* dst, int count) {
+    IMGLIB_STATS_TIMER(PIXEL_PACK);
+    switch (ActiveKernel().load(memory_order_relaxed)) {
+#ifdef IMGLIB_PACK_X86
+        case PackKernel::AVX2:
+            return SwapRBAVX2<OPAQUE>(src, dst, count);
+        case PackKernel::SSSE3:
+            return SwapRBSSSE3<OPAQUE>(src, dst, count);
+#endif
+        default:
+            return SwapRBScalar<OPAQUE>(src, dst, count);
+    }
+}
+
+}  // namespace
+
+PackKernel GetPackKernel() {
+    return ActiveKernel().load(memory_order_relaxed);
+}
+
+void SetPackKernel(PackKernel kernel) {
+    // ядра упорядочены по возрастанию требований к процессору
+    if (static_cast<int>(kernel) > static_cast<int>(GetBestKernel())) {
+        kernel = GetBestKernel();
+    }
+    ActiveKernel().store(kernel, memory_order_relaxed);
+}
+
+const char* GetPackKernelName(PackKernel kernel) {
+    switch (kernel) {
+        case PackKernel::AVX2:
+            return "avx2";
+        case PackKernel::SSSE3:
+            return "ssse3";
+        default:
+            return "scalar";
+    }
+}
+
+void PackRGB(const Color* src, std::byte* dst, int count) {
+    Pack<false>(src, dst, count);
+}
+
+void PackBGR(const Color* src, std::byte* dst, int count) {
+    Pack<true>(src, dst, count);
+}
+
+void UnpackRGB(const std::byte* src, Color* dst, int count) {
+    Unpack<false>(src, dst, count);
+}
+
+void UnpackBGR(const std::byte* src, Color* dst, int count) {
+    Unpack<true>(src, dst, count);
+}
+
+void PackBGRA(const Color* src, std::byte* dst, int count) {
+    SwapRB<false>(reinterpret_cast<const std::byte*>(src), dst, count);
+}
+
+void UnpackBGRA(const std::byte* src, Color* dst, int count) {
+    SwapRB<false>(src, reinterpret_cast<std::byte*>(dst), count);
+}
+
+void UnpackBGRX(const std::byte* src, Color* dst, int count) {
+    SwapRB<true>(src, reinterpret_cast<std::byte*>(dst), count);
+}
+
+// выборка из таблицы не векторизуется выгодно, поэтому цикл только развёрнут:
+// четыре независимых чтения идут параллельно
+void ExpandPalette(const uint8_t* indices, const Color* palette, Color* dst, int count) {
+    IMGLIB_STATS_TIMER(PIXEL_PACK);
+    int x = 0;
+    for (; x + 4 <= count; x += 4) {
+        const Color c0 = palette[indices[x]];
+        const Color c1 = palette[indices[x + 1]];
+        const Color c2 = palette[indices[x + 2]];
+        const Color c3 = palette[indices[x + 3]];
+        dst[x] = c0;
+        dst[x + 1] = c1;
+        dst[x + 2] = c2;
+        dst[x + 3] = c3;
+    }
+    for (; x < count; ++x) {
+        dst[x] = palette[indices[x]];
+    }
+}
+
+}  // namespace img_lib
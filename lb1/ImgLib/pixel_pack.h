@@ -0,0 +1,41 @@
+#pragma once
+#include "img_lib.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace img_lib {
+
+// набор ядер, которыми выполняется упаковка пикселей
+enum class PackKernel {
+    SCALAR,
+    SSSE3,
+    AVX2
+};
+
+// ядро выбирается при первом обращении по возможностям процессора;
+// SetPackKernel позволяет принудительно понизить его (например, для замеров).
+// запрос неподдерживаемого ядра заменяется лучшим доступным
+PackKernel GetPackKernel();
+void SetPackKernel(PackKernel kernel);
+const char* GetPackKernelName(PackKernel kernel);
+
+// упаковывает count пикселей Color в 3-байтовые тройки R, G, B или B, G, R.
+// альфа-канал отбрасывается
+void PackRGB(const Color* src, std::byte* dst, int count);
+void PackBGR(const Color* src, std::byte* dst, int count);
+
+// распаковывает 3-байтовые тройки в Color, альфа-канал заполняется значением 255
+void UnpackRGB(const std::byte* src, Color* dst, int count);
+void UnpackBGR(const std::byte* src, Color* dst, int count);
+
+// переставляет 4-байтовые пиксели B, G, R, A в Color и обратно.
+// UnpackBGRX игнорирует четвёртый байт и заполняет альфа-канал значением 255
+void PackBGRA(const Color* src, std::byte* dst, int count);
+void UnpackBGRA(const std::byte* src, Color* dst, int count);
+void UnpackBGRX(const std::byte* src, Color* dst, int count);
+
+// заменяет 8-битные индексы цветами из таблицы на 256 элементов
+void ExpandPalette(const std::uint8_t* indices, const Color* palette, Color* dst, int count);
+
+}  // namespace img_lib
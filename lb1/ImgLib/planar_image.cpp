@@ -0,0 +1,60 @@
+#include "planar_image.h"
+
+#include <algorithm>
+
+namespace img_lib {
+
+PlanarImage::PlanarImage(int w, int h, Color fill)
+    : width_(w)
+    , height_(h)
+    , step_(w)
+    , planes_(static_cast<size_t>(step_) * height_ * CHANNEL_COUNT) {
+    const size_t plane_size = static_cast<size_t>(step_) * height_;
+    const std::byte values[CHANNEL_COUNT] = {fill.r, fill.g, fill.b, fill.a};
+    for (int c = 0; c < CHANNEL_COUNT; ++c) {
+        std::fill_n(planes_.data() + plane_size * c, plane_size, values[c]);
+    }
+}
+
+PlanarImage PlanarImage::FromInterleaved(const Image& image) {
+    const int w = image.GetWidth();
+    const int h = image.GetHeight();
+    PlanarImage result(w, h, Color::Black());
+
+    for (int y = 0; y < h; ++y) {
+        const Color* line = image.GetLine(y);
+        std::byte* r = result.GetRow<Channel::R>(y);
+        std::byte* g = result.GetRow<Channel::G>(y);
+        std::byte* b = result.GetRow<Channel::B>(y);
+        std::byte* a = result.GetRow<Channel::A>(y);
+
+        for (int x = 0; x < w; ++x) {
+            r[x] = line[x].r;
+            g[x] = line[x].g;
+            b[x] = line[x].b;
+            a[x] = line[x].a;
+        }
+    }
+
+    return result;
+}
+
+Image PlanarImage::ToInterleaved() const {
+    Image result(width_, height_, Color::Black());
+
+    for (int y = 0; y < height_; ++y) {
+        Color* line = result.GetLine(y);
+        const std::byte* r = GetRow<Channel::R>(y);
+        const std::byte* g = GetRow<Channel::G>(y);
+        const std::byte* b = GetRow<Channel::B>(y);
+        const std::byte* a = GetRow<Channel::A>(y);
+
+        for (int x = 0; x < width_; ++x) {
+            line[x] = Color{r[x], g[x], b[x], a[x]};
+        }
+    }
+
+    return result;
+}
+
+}  // namespace img_lib
@@ -0,0 +1,87 @@
+#pragma once
+#include "img_lib.h"
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace img_lib {
+
+// номер канала в планарном изображении
+enum class Channel {
+    R = 0,
+    G = 1,
+    B = 2,
+    A = 3
+};
+
+constexpr int CHANNEL_COUNT = 4;
+
+// изображение с раздельным хранением каналов (SoA):
+// каждый канал лежит в своей непрерывной плоскости,
+// что позволяет покомпонентным фильтрам и кодекам
+// обрабатывать строки подряд идущей памятью
+class PlanarImage {
+public:
+    // создаёт пустое изображение
+    PlanarImage() = default;
+
+    // создаёт изображение заданного размера, заполняя его заданным цветом
+    PlanarImage(int w, int h, Color fill);
+
+    // преобразования из чередующегося (RGBA) представления и обратно
+    static PlanarImage FromInterleaved(const Image& image);
+    Image ToInterleaved() const;
+
+    // геттеры для строки заданного канала
+    std::byte* GetRow(Channel c, int y) {
+        assert(y >= 0 && y < height_);
+        return planes_.data() + GetPlaneOffset(c) + static_cast<size_t>(step_) * y;
+    }
+    const std::byte* GetRow(Channel c, int y) const {
+        return const_cast<PlanarImage*>(this)->GetRow(c, y);
+    }
+
+    template <Channel C>
+    std::byte* GetRow(int y) {
+        return GetRow(C, y);
+    }
+    template <Channel C>
+    const std::byte* GetRow(int y) const {
+        return GetRow(C, y);
+    }
+
+    int GetWidth() const {
+        return width_;
+    }
+
+    int GetHeight() const {
+        return height_;
+    }
+
+    // шаг задаёт смещение соседних строк внутри одной плоскости
+    int GetStep() const {
+        return step_;
+    }
+
+    explicit operator bool() const {
+        return GetWidth() > 0 && GetHeight() > 0;
+    }
+
+    bool operator!() const {
+        return !operator bool();
+    }
+
+private:
+    size_t GetPlaneOffset(Channel c) const {
+        return static_cast<size_t>(c) * static_cast<size_t>(step_) * height_;
+    }
+
+    int width_ = 0;
+    int height_ = 0;
+    int step_ = 0;
+
+    std::vector<std::byte> planes_;
+};
+
+}  // namespace img_lib
@@ -0,0 +1,895 @@
+#include "png_image.h"
+#include "image_pool.h"
+#include "image_stats.h"
+#include "mapped_file.h"
+#include "pixel_pack.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <vector>
+
+using namespace std;
+
+namespace img_lib {
+
+static const array<uint8_t, 8> PNG_SIGNATURE = {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A};
+
+// длина, тип и CRC блока
+static const size_t CHUNK_OVERHEAD = 12;
+static const size_t IHDR_SIZE = 13;
+
+// размер блока IDAT при записи; готовые блоки сразу уходят в файл
+static const size_t IDAT_SIZE = 256 * 1024;
+
+// предел числа пикселей декодируемого изображения (1 ГиБ под Color)
+static const uint64_t MAX_PNG_PIXELS = uint64_t{1} << 28;
+// deflate сжимает не сильнее, чем примерно в 1032 раза
+static const uint64_t MAX_DEFLATE_RATIO = 1032;
+
+// типы цвета из IHDR
+enum PNGColorType {
+    PNG_GRAY = 0,
+    PNG_RGB = 2,
+    PNG_PALETTE = 3,
+    PNG_GRAY_ALPHA = 4,
+    PNG_RGBA = 6
+};
+
+// сведения из блока IHDR
+struct PNGHeader {
+    int width = 0;
+    int height = 0;
+    int bit_depth = 0;
+    int color_type = 0;
+    bool interlaced = false;
+
+    int GetChannels() const {
+        switch (color_type) {
+            case PNG_RGB:
+                return 3;
+            case PNG_GRAY_ALPHA:
+                return 2;
+            case PNG_RGBA:
+                return 4;
+            default:
+                return 1;
+        }
+    }
+
+    // длина строки без байта фильтра
+    uint64_t GetRowSize() const {
+        return (static_cast<uint64_t>(width) * GetChannels() * bit_depth + 7) / 8;
+    }
+
+    // расстояние до соответствующего байта соседнего пикселя при фильтрации
+    int GetFilterStep() const {
+        return max(GetChannels() * bit_depth / 8, 1);
+    }
+};
+
+static uint32_t ReadBE32(const uint8_t* p) {
+    return (uint32_t{p[0]} << 24) | (uint32_t{p[1]} << 16) | (uint32_t{p[2]} << 8) | p[3];
+}
+
+static uint32_t ReadBE16(const uint8_t* p) {
+    return (uint32_t{p[0]} << 8) | p[1];
+}
+
+static void AppendBE32(Bytes& out, uint32_t value) {
+    out.push_back(std::byte(value >> 24));
+    out.push_back(std::byte(value >> 16));
+    out.push_back(std::byte(value >> 8));
+    out.push_back(std::byte(value));
+}
+
+static void WriteChunk(Bytes& out, const char* type, const uint8_t* data, size_t size) {
+    AppendBE32(out, static_cast<uint32_t>(size));
+    const auto* type_bytes = reinterpret_cast<const std::byte*>(type);
+    out.insert(out.end(), type_bytes, type_bytes + 4);
+    const auto* data_bytes = reinterpret_cast<const std::byte*>(data);
+    out.insert(out.end(), data_bytes, data_bytes + size);
+
+    uLong crc = crc32(0, reinterpret_cast<const Bytef*>(type), 4);
+    // crc32 с пустым указателем возвращает начальное значение, а не crc,
+    // поэтому пустой блок (IEND) в него не передаётся
+    if (size > 0) {
+        crc = crc32(crc, data, static_cast<uInt>(size));
+    }
+    AppendBE32(out, static_cast<uint32_t>(crc));
+}
+
+static bool IsValidDepth(int color_type, int bit_depth) {
+    switch (color_type) {
+        case PNG_GRAY:
+            return bit_depth == 1 || bit_depth == 2 || bit_depth == 4 || bit_depth == 8 || bit_depth == 16;
+        case PNG_PALETTE:
+            return bit_depth == 1 || bit_depth == 2 || bit_depth == 4 || bit_depth == 8;
+        case PNG_RGB:
+        case PNG_GRAY_ALPHA:
+        case PNG_RGBA:
+            return bit_depth == 8 || bit_depth == 16;
+        default:
+            return false;
+    }
+}
+
+static bool ReadPNGHeader(ByteSpan data, PNGHeader& header) {
+    if (data.data == nullptr || data.size < PNG_SIGNATURE.size() + CHUNK_OVERHEAD + IHDR_SIZE) {
+        return false;
+    }
+    const auto* bytes = reinterpret_cast<const uint8_t*>(data.data);
+    if (memcmp(bytes, PNG_SIGNATURE.data(), PNG_SIGNATURE.size()) != 0) {
+        return false;
+    }
+
+    const uint8_t* chunk = bytes + PNG_SIGNATURE.size();
+    if (ReadBE32(chunk) != IHDR_SIZE || memcmp(chunk + 4, "IHDR", 4) != 0) {
+        return false;
+    }
+    const uint8_t* ihdr = chunk + 8;
+    const uint32_t width = ReadBE32(ihdr);
+    const uint32_t height = ReadBE32(ihdr + 4);
+    const int bit_depth = ihdr[8];
+    const int color_type = ihdr[9];
+    // ihdr[10] и ihdr[11] - методы сжатия и фильтрации, определён только 0
+    if (width == 0 || height == 0 || width > static_cast<uint32_t>(numeric_limits<int>::max())
+        || height > static_cast<uint32_t>(numeric_limits<int>::max()) || ihdr[10] != 0 || ihdr[11] != 0
+        || ihdr[12] > 1 || !IsValidDepth(color_type, bit_depth)) {
+        return false;
+    }
+
+    header.width = static_cast<int>(width);
+    header.height = static_cast<int>(height);
+    header.bit_depth = bit_depth;
+    header.color_type = color_type;
+    header.interlaced = ihdr[12] == 1;
+    return true;
+}
+
+static uint8_t PaethPredictor(int a, int b, int c) {
+    const int p = a + b - c;
+    const int pa = abs(p - a);
+    const int pb = abs(p - b);
+    const int pc = abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return static_cast<uint8_t>(a);
+    }
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+// 16-битный отсчёт приводится к 0..255 с округлением, как в LoadPPM
+static uint8_t Scale16(uint32_t value) {
+    return static_cast<uint8_t>((value + 128) / 257);
+}
+
+namespace {
+
+// построчный декодер PNG поверх данных в памяти: блоки IDAT
+// распаковываются по мере чтения строк
+class PNGDecoder {
+public:
+    PNGDecoder() = default;
+
+    PNGDecoder(const PNGDecoder&) = delete;
+    PNGDecoder& operator=(const PNGDecoder&) = delete;
+
+    ~PNGDecoder() {
+        if (initialized_) {
+            inflateEnd(&stream_);
+        }
+    }
+
+    bool Open(ByteSpan data) {
+        if (!ReadPNGHeader(data, header_) || header_.interlaced) {
+            return false;
+        }
+        const uint64_t row_size = header_.GetRowSize();
+        if (row_size + 1 > numeric_limits<uInt>::max()) {
+            return false;
+        }
+
+        data_ = reinterpret_cast<const uint8_t*>(data.data);
+        size_ = data.size;
+        // палитра и tRNS обязаны предшествовать первому блоку IDAT
+        pos_ = PNG_SIGNATURE.size() + CHUNK_OVERHEAD + IHDR_SIZE;
+        bool has_palette = false;
+        for (;;) {
+            const uint8_t* chunk = nullptr;
+            uint32_t length = 0;
+            if (!PeekChunk(chunk, length)) {
+                return false;
+            }
+            if (memcmp(chunk + 4, "IDAT", 4) == 0) {
+                break;
+            }
+            if (memcmp(chunk + 4, "IEND", 4) == 0) {
+                return false;
+            }
+            if (memcmp(chunk + 4, "PLTE", 4) == 0) {
+                has_palette = ReadPalette(chunk + 8, length);
+            } else if (memcmp(chunk + 4, "tRNS", 4) == 0) {
+                ReadTransparency(chunk + 8, length);
+            }
+            pos_ += CHUNK_OVERHEAD + length;
+        }
+        if (header_.color_type == PNG_PALETTE && !has_palette) {
+            return false;
+        }
+        if (!FitsCompressedData(row_size)) {
+            return false;
+        }
+
+        if (inflateInit(&stream_) != Z_OK) {
+            return false;
+        }
+        initialized_ = true;
+
+        row_size_ = static_cast<size_t>(row_size);
+        cur_.assign(row_size_ + 1, 0);
+        prev_.assign(row_size_ + 1, 0);
+        if (header_.bit_depth < 8) {
+            samples_.resize(header_.width);
+        }
+        return true;
+    }
+
+    Size GetSize() const {
+        return {header_.width, header_.height};
+    }
+
+    bool ReadRow(Color* dst) {
+        if (rows_read_ >= header_.height || !Inflate(cur_.data(), row_size_ + 1)) {
+            return false;
+        }
+        if (!Unfilter()) {
+            return false;
+        }
+        Convert(cur_.data() + 1, dst);
+        swap(cur_, prev_);
+        ++rows_read_;
+        return true;
+    }
+
+private:
+    // Размеры из IHDR ничем не ограничены, поэтому файл в сотню байт может
+    // заявить изображение на терабайты. Отвергаются изображения больше
+    // MAX_PNG_PIXELS и такие, чьи строки не могли бы уместиться в оставшиеся
+    // после заголовков байты даже при предельном сжатии
+    bool FitsCompressedData(uint64_t row_size) const {
+        const uint64_t width = static_cast<uint64_t>(header_.width);
+        const uint64_t height = static_cast<uint64_t>(header_.height);
+        if (width * height > MAX_PNG_PIXELS) {
+            return false;
+        }
+        return (row_size + 1) * height / MAX_DEFLATE_RATIO <= size_ - pos_;
+    }
+
+    // проверяет, что блок в позиции pos_ целиком лежит в данных и его CRC верна
+    bool PeekChunk(const uint8_t*& chunk, uint32_t& length) const {
+        if (size_ - pos_ < CHUNK_OVERHEAD) {
+            return false;
+        }
+        chunk = data_ + pos_;
+        length = ReadBE32(chunk);
+        if (length > size_ - pos_ - CHUNK_OVERHEAD) {
+            return false;
+        }
+        const uLong crc = crc32(0, chunk + 4, length + 4);
+        return ReadBE32(chunk + 8 + length) == static_cast<uint32_t>(crc);
+    }
+
+    // подаёт распаковщику следующий блок IDAT
+    bool NextIDAT() {
+        const uint8_t* chunk = nullptr;
+        uint32_t length = 0;
+        if (!PeekChunk(chunk, length) || memcmp(chunk + 4, "IDAT", 4) != 0) {
+            return false;
+        }
+        stream_.next_in = const_cast<Bytef*>(chunk + 8);
+        stream_.avail_in = length;
+        pos_ += CHUNK_OVERHEAD + length;
+        return true;
+    }
+
+    bool Inflate(uint8_t* dst, size_t size) {
+        stream_.next_out = dst;
+        stream_.avail_out = static_cast<uInt>(size);
+        while (stream_.avail_out > 0) {
+            if (stream_.avail_in == 0 && !NextIDAT()) {
+                return false;
+            }
+            const int ret = inflate(&stream_, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                return stream_.avail_out == 0;
+            }
+            if (ret != Z_OK && !(ret == Z_BUF_ERROR && stream_.avail_in == 0)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Unfilter() {
+        uint8_t* row = cur_.data() + 1;
+        const uint8_t* up = prev_.data() + 1;
+        const size_t n = row_size_;
+        const size_t step = min<size_t>(header_.GetFilterStep(), n);
+        switch (cur_[0]) {
+            case 0:
+                break;
+            case 1:
+                for (size_t i = step; i < n; ++i) {
+                    row[i] = static_cast<uint8_t>(row[i] + row[i - step]);
+                }
+                break;
+            case 2:
+                for (size_t i = 0; i < n; ++i) {
+                    row[i] = static_cast<uint8_t>(row[i] + up[i]);
+                }
+                break;
+            case 3:
+                for (size_t i = 0; i < step; ++i) {
+                    row[i] = static_cast<uint8_t>(row[i] + (up[i] >> 1));
+                }
+                for (size_t i = step; i < n; ++i) {
+                    row[i] = static_cast<uint8_t>(row[i] + ((row[i - step] + up[i]) >> 1));
+                }
+                break;
+            case 4:
+                for (size_t i = 0; i < step; ++i) {
+                    row[i] = static_cast<uint8_t>(row[i] + up[i]);
+                }
+                for (size_t i = step; i < n; ++i) {
+                    row[i] = static_cast<uint8_t>(row[i] + PaethPredictor(row[i - step], up[i], up[i - step]));
+                }
+                break;
+            default:
+                return false;
+        }
+        return true;
+    }
+
+    bool ReadPalette(const uint8_t* data, uint32_t length) {
+        if (length % 3 != 0 || length / 3 > palette_.size() || length == 0) {
+            return false;
+        }
+        for (uint32_t i = 0; i < length / 3; ++i) {
+            palette_[i] = Color{std::byte{data[i * 3]}, std::byte{data[i * 3 + 1]}, std::byte{data[i * 3 + 2]},
+                                palette_[i].a};
+        }
+        return true;
+    }
+
+    void ReadTransparency(const uint8_t* data, uint32_t length) {
+        if (header_.color_type == PNG_PALETTE) {
+            for (uint32_t i = 0; i < min<uint32_t>(length, palette_.size()); ++i) {
+                palette_[i].a = std::byte{data[i]};
+            }
+        } else if (header_.color_type == PNG_GRAY && length >= 2) {
+            key_[0] = ReadBE16(data);
+            has_key_ = true;
+        } else if (header_.color_type == PNG_RGB && length >= 6) {
+            key_ = {ReadBE16(data), ReadBE16(data + 2), ReadBE16(data + 4)};
+            has_key_ = true;
+        }
+    }
+
+    // раскладывает отсчёты глубиной 1, 2 или 4 бита по байтам
+    void UnpackSamples(const uint8_t* row) {
+        const int depth = header_.bit_depth;
+        const int per_byte = 8 / depth;
+        const uint8_t mask = static_cast<uint8_t>((1 << depth) - 1);
+        for (int x = 0; x < header_.width; ++x) {
+            const int shift = 8 - depth * (x % per_byte + 1);
+            samples_[x] = static_cast<uint8_t>((row[x / per_byte] >> shift) & mask);
+        }
+    }
+
+    void Convert(const uint8_t* row, Color* dst) {
+        const int w = header_.width;
+        const bool wide = header_.bit_depth == 16;
+        switch (header_.color_type) {
+            case PNG_RGBA:
+                if (!wide) {
+                    // порядок байт R, G, B, A совпадает с Color
+                    memcpy(dst, row, static_cast<size_t>(w) * sizeof(Color));
+                    return;
+                }
+                for (int x = 0; x < w; ++x) {
+                    const uint8_t* p = row + x * 8;
+                    dst[x] = {std::byte{Scale16(ReadBE16(p))}, std::byte{Scale16(ReadBE16(p + 2))},
+                              std::byte{Scale16(ReadBE16(p + 4))}, std::byte{Scale16(ReadBE16(p + 6))}};
+                }
+                return;
+            case PNG_RGB:
+                if (!wide) {
+                    UnpackRGB(reinterpret_cast<const std::byte*>(row), dst, w);
+                    if (has_key_) {
+                        for (int x = 0; x < w; ++x) {
+                            const uint8_t* p = row + x * 3;
+                            if (p[0] == key_[0] && p[1] == key_[1] && p[2] == key_[2]) {
+                                dst[x].a = std::byte{0};
+                            }
+                        }
+                    }
+                    return;
+                }
+                for (int x = 0; x < w; ++x) {
+                    const uint8_t* p = row + x * 6;
+                    const uint32_t r = ReadBE16(p), g = ReadBE16(p + 2), b = ReadBE16(p + 4);
+                    const bool transparent = has_key_ && r == key_[0] && g == key_[1] && b == key_[2];
+                    dst[x] = {std::byte{Scale16(r)}, std::byte{Scale16(g)}, std::byte{Scale16(b)},
+                              std::byte{transparent ? uint8_t{0} : uint8_t{255}}};
+                }
+                return;
+            case PNG_GRAY_ALPHA:
+                for (int x = 0; x < w; ++x) {
+                    const std::byte v{wide ? Scale16(ReadBE16(row + x * 4)) : row[x * 2]};
+                    const std::byte a{wide ? Scale16(ReadBE16(row + x * 4 + 2)) : row[x * 2 + 1]};
+                    dst[x] = {v, v, v, a};
+                }
+                return;
+            case PNG_PALETTE:
+                if (header_.bit_depth < 8) {
+                    UnpackSamples(row);
+                    row = samples_.data();
+                }
+                ExpandPalette(row, palette_.data(), dst, w);
+                return;
+            default:
+                ConvertGray(row, dst);
+                return;
+        }
+    }
+
+    void ConvertGray(const uint8_t* row, Color* dst) {
+        const int w = header_.width;
+        const int depth = header_.bit_depth;
+        if (depth == 16) {
+            for (int x = 0; x < w; ++x) {
+                const uint32_t value = ReadBE16(row + x * 2);
+                const std::byte v{Scale16(value)};
+                dst[x] = {v, v, v, std::byte{has_key_ && value == key_[0] ? uint8_t{0} : uint8_t{255}}};
+            }
+            return;
+        }
+        if (depth < 8) {
+            UnpackSamples(row);
+            row = samples_.data();
+        }
+        // 1, 2 и 4 бита растягиваются на 0..255 умножением на 255, 85 и 17
+        const int scale = 255 / ((1 << depth) - 1);
+        for (int x = 0; x < w; ++x) {
+            const std::byte v{static_cast<uint8_t>(row[x] * scale)};
+            dst[x] = {v, v, v, std::byte{has_key_ && row[x] == key_[0] ? uint8_t{0} : uint8_t{255}}};
+        }
+    }
+
+    PNGHeader header_;
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    size_t pos_ = 0;
+
+    z_stream stream_ = {};
+    bool initialized_ = false;
+
+    size_t row_size_ = 0;
+    int rows_read_ = 0;
+    // текущая и предыдущая строки вместе с байтом фильтра
+    vector<uint8_t> cur_;
+    vector<uint8_t> prev_;
+    vector<uint8_t> samples_;
+
+    array<Color, 256> palette_ = [] {
+        array<Color, 256> palette;
+        palette.fill(Color::Black());
+        return palette;
+    }();
+    // цвет из tRNS, который считается прозрачным
+    array<uint32_t, 3> key_ = {};
+    bool has_key_ = false;
+};
+
+// построчный кодер PNG: каждая строка фильтруется и подаётся deflate,
+// заполненные блоки IDAT дописываются в выходной буфер
+class PNGEncoder {
+public:
+    PNGEncoder(Size size, const PNGSaveOptions& options)
+        : size_(size)
+        , channels_(options.format == PNGPixelFormat::RGBA8 ? 4 : 3)
+        , row_size_(static_cast<size_t>(size.width) * channels_)
+        , filter_(options.fast ? PNGFilter::SUB : options.filter)
+        , level_(options.fast ? 1 : clamp(options.level, 0, 9))
+        , strategy_(options.fast ? PNGStrategy::RLE : options.strategy) {
+    }
+
+    PNGEncoder(const PNGEncoder&) = delete;
+    PNGEncoder& operator=(const PNGEncoder&) = delete;
+
+    ~PNGEncoder() {
+        if (initialized_) {
+            deflateEnd(&stream_);
+        }
+    }
+
+    // пишет сигнатуру и IHDR
+    bool Start(Bytes& out) {
+        if (row_size_ + 1 > numeric_limits<uInt>::max()
+            || deflateInit2(&stream_, level_, Z_DEFLATED, 15, 8, GetZlibStrategy()) != Z_OK) {
+            return false;
+        }
+        initialized_ = true;
+
+        cur_.assign(row_size_, 0);
+        prev_.assign(row_size_, 0);
+        filtered_.resize(row_size_ + 1);
+        if (filter_ == PNGFilter::ADAPTIVE) {
+            trial_.resize(row_size_ + 1);
+        }
+        idat_.resize(IDAT_SIZE);
+
+        const auto* signature = reinterpret_cast<const std::byte*>(PNG_SIGNATURE.data());
+        out.insert(out.end(), signature, signature + PNG_SIGNATURE.size());
+
+        array<uint8_t, IHDR_SIZE> ihdr = {};
+        const uint32_t w = static_cast<uint32_t>(size_.width);
+        const uint32_t h = static_cast<uint32_t>(size_.height);
+        for (int i = 0; i < 4; ++i) {
+            ihdr[i] = static_cast<uint8_t>(w >> (24 - 8 * i));
+            ihdr[4 + i] = static_cast<uint8_t>(h >> (24 - 8 * i));
+        }
+        ihdr[8] = 8;
+        ihdr[9] = channels_ == 4 ? PNG_RGBA : PNG_RGB;
+        WriteChunk(out, "IHDR", ihdr.data(), ihdr.size());
+        return true;
+    }
+
+    bool WriteRow(const Color* row, Bytes& out) {
+        if (rows_written_ >= size_.height) {
+            return false;
+        }
+        if (channels_ == 4) {
+            memcpy(cur_.data(), row, row_size_);
+        } else {
+            PackRGB(row, reinterpret_cast<std::byte*>(cur_.data()), size_.width);
+        }
+
+        if (filter_ == PNGFilter::ADAPTIVE) {
+            FilterAdaptive();
+        } else {
+            FilterRow(filter_, filtered_.data());
+        }
+        if (!Deflate(filtered_.data(), filtered_.size(), Z_NO_FLUSH, out)) {
+            return false;
+        }
+        swap(cur_, prev_);
+        ++rows_written_;
+        return true;
+    }
+
+    // дожимает поток, пишет последний IDAT и IEND
+    bool Finish(Bytes& out) {
+        if (rows_written_ != size_.height || !Deflate(nullptr, 0, Z_FINISH, out)) {
+            return false;
+        }
+        FlushIDAT(out);
+        WriteChunk(out, "IEND", nullptr, 0);
+        return true;
+    }
+
+private:
+    int GetZlibStrategy() const {
+        switch (strategy_) {
+            case PNGStrategy::FILTERED:
+                return Z_FILTERED;
+            case PNGStrategy::HUFFMAN_ONLY:
+                return Z_HUFFMAN_ONLY;
+            case PNGStrategy::RLE:
+                return Z_RLE;
+            case PNGStrategy::FIXED:
+                return Z_FIXED;
+            default:
+                return Z_DEFAULT_STRATEGY;
+        }
+    }
+
+    // пишет в dst байт типа фильтра и отфильтрованную строку cur_
+    void FilterRow(PNGFilter filter, uint8_t* dst) const {
+        const uint8_t* row = cur_.data();
+        const uint8_t* up = prev_.data();
+        const size_t n = row_size_;
+        const size_t step = min<size_t>(channels_, n);
+        uint8_t* out = dst + 1;
+        switch (filter) {
+            case PNGFilter::SUB:
+                dst[0] = 1;
+                memcpy(out, row, step);
+                for (size_t i = step; i < n; ++i) {
+                    out[i] = static_cast<uint8_t>(row[i] - row[i - step]);
+                }
+                return;
+            case PNGFilter::UP:
+                dst[0] = 2;
+                for (size_t i = 0; i < n; ++i) {
+                    out[i] = static_cast<uint8_t>(row[i] - up[i]);
+                }
+                return;
+            case PNGFilter::AVERAGE:
+                dst[0] = 3;
+                for (size_t i = 0; i < step; ++i) {
+                    out[i] = static_cast<uint8_t>(row[i] - (up[i] >> 1));
+                }
+                for (size_t i = step; i < n; ++i) {
+                    out[i] = static_cast<uint8_t>(row[i] - ((row[i - step] + up[i]) >> 1));
+                }
+                return;
+            case PNGFilter::PAETH:
+                dst[0] = 4;
+                for (size_t i = 0; i < step; ++i) {
+                    out[i] = static_cast<uint8_t>(row[i] - up[i]);
+                }
+                for (size_t i = step; i < n; ++i) {
+                    out[i] = static_cast<uint8_t>(row[i] - PaethPredictor(row[i - step], up[i], up[i - step]));
+                }
+                return;
+            default:
+                dst[0] = 0;
+                memcpy(out, row, n);
+                return;
+        }
+    }
+
+    // сумма модулей байтов как знаковых - эвристика выбора фильтра из libpng
+    uint64_t GetFilterCost(const uint8_t* filtered) const {
+        uint64_t cost = 0;
+        for (size_t i = 1; i <= row_size_; ++i) {
+            cost += static_cast<uint64_t>(abs(static_cast<int8_t>(filtered[i])));
+        }
+        return cost;
+    }
+
+    void FilterAdaptive() {
+        static constexpr array<PNGFilter, 5> filters = {PNGFilter::NONE, PNGFilter::SUB, PNGFilter::UP,
+                                                         PNGFilter::AVERAGE, PNGFilter::PAETH};
+        uint64_t best_cost = numeric_limits<uint64_t>::max();
+        for (const PNGFilter filter : filters) {
+            FilterRow(filter, trial_.data());
+            const uint64_t cost = GetFilterCost(trial_.data());
+            if (cost < best_cost) {
+                best_cost = cost;
+                swap(trial_, filtered_);
+            }
+        }
+    }
+
+    bool Deflate(const uint8_t* data, size_t size, int flush, Bytes& out) {
+        stream_.next_in = const_cast<Bytef*>(data);
+        stream_.avail_in = static_cast<uInt>(size);
+        for (;;) {
+            stream_.next_out = idat_.data() + idat_used_;
+            stream_.avail_out = static_cast<uInt>(IDAT_SIZE - idat_used_);
+            const int ret = deflate(&stream_, flush);
+            if (ret == Z_STREAM_ERROR) {
+                return false;
+            }
+            idat_used_ = IDAT_SIZE - stream_.avail_out;
+            if (idat_used_ == IDAT_SIZE) {
+                FlushIDAT(out);
+                continue;
+            }
+            if (flush == Z_FINISH ? ret == Z_STREAM_END : stream_.avail_in == 0) {
+                return true;
+            }
+        }
+    }
+
+    void FlushIDAT(Bytes& out) {
+        if (idat_used_ > 0) {
+            WriteChunk(out, "IDAT", idat_.data(), idat_used_);
+            idat_used_ = 0;
+        }
+    }
+
+    const Size size_;
+    const int channels_;
+    const size_t row_size_;
+    const PNGFilter filter_;
+    const int level_;
+    const PNGStrategy strategy_;
+
+    z_stream stream_ = {};
+    bool initialized_ = false;
+    int rows_written_ = 0;
+
+    // текущая и предыдущая строки без байта фильтра
+    vector<uint8_t> cur_;
+    vector<uint8_t> prev_;
+    // отфильтрованная строка с байтом фильтра и кандидат при адаптивном выборе
+    vector<uint8_t> filtered_;
+    vector<uint8_t> trial_;
+    vector<uint8_t> idat_;
+    size_t idat_used_ = 0;
+};
+
+class PNGRowSource : public RowSource {
+public:
+    explicit PNGRowSource(const Path& file)
+        : file_(file) {
+        is_open_ = file_ && decoder_.Open(ByteSpan{file_.GetData(), file_.GetSize()});
+    }
+
+    Size GetSize() const override {
+        return decoder_.GetSize();
+    }
+
+    bool ReadRow(Color* dst) override {
+        IMGLIB_STATS_TIMER(PNG_DECODE);
+        if (!is_open_ || !decoder_.ReadRow(dst)) {
+            return false;
+        }
+        IMGLIB_STATS_ADD(ROWS_DECODED, 1);
+        return true;
+    }
+
+    bool IsOpen() const {
+        return is_open_;
+    }
+
+private:
+    MappedFile file_;
+    PNGDecoder decoder_;
+    bool is_open_ = false;
+};
+
+class PNGRowSink : public RowSink {
+public:
+    PNGRowSink(const Path& file, Size size, const PNGSaveOptions& options)
+        : out_(file, ios::binary)
+        , encoder_(size, options) {
+        is_open_ = out_.good() && encoder_.Start(buff_) && Flush();
+    }
+
+    bool WriteRow(const Color* row) override {
+        IMGLIB_STATS_TIMER(PNG_ENCODE);
+        if (!is_open_ || !encoder_.WriteRow(row, buff_)) {
+            return false;
+        }
+        IMGLIB_STATS_ADD(ROWS_ENCODED, 1);
+        return Flush();
+    }
+
+    bool Finish() override {
+        IMGLIB_STATS_TIMER(PNG_ENCODE);
+        if (!is_open_ || !encoder_.Finish(buff_) || !Flush()) {
+            return false;
+        }
+        out_.flush();
+        return out_.good();
+    }
+
+    bool IsOpen() const {
+        return is_open_;
+    }
+
+private:
+    // отправляет в файл готовые блоки
+    bool Flush() {
+        if (buff_.empty()) {
+            return true;
+        }
+        IMGLIB_STATS_TIMER(FILE_WRITE);
+        out_.write(reinterpret_cast<const char*>(buff_.data()), buff_.size());
+        IMGLIB_STATS_ADD(BYTES_WRITTEN, buff_.size());
+        buff_.clear();
+        return out_.good();
+    }
+
+    ofstream out_;
+    PNGEncoder encoder_;
+    Bytes buff_;
+    bool is_open_ = false;
+};
+
+}  // namespace
+
+Image LoadPNG(ByteSpan data) {
+    IMGLIB_STATS_TIMER(PNG_DECODE);
+    PNGDecoder decoder;
+    if (!decoder.Open(data)) {
+        return {};
+    }
+
+    const Size size = decoder.GetSize();
+    Image result = AcquireImage(size.width, size.height);
+    for (int y = 0; y < size.height; ++y) {
+        if (!decoder.ReadRow(result.GetLine(y))) {
+            return {};
+        }
+    }
+    IMGLIB_STATS_ADD(ROWS_DECODED, size.height);
+    return result;
+}
+
+Image LoadPNG(const Path& file) {
+    const MappedFile mapped(file);
+    if (!mapped) {
+        return {};
+    }
+    return LoadPNG(ByteSpan{mapped.GetData(), mapped.GetSize()});
+}
+
+bool SavePNG(Bytes& out, const Image& image, const PNGSaveOptions& options) {
+    if (!image) {
+        return false;
+    }
+
+    IMGLIB_STATS_TIMER(PNG_ENCODE);
+    out.clear();
+    PNGEncoder encoder({image.GetWidth(), image.GetHeight()}, options);
+    if (!encoder.Start(out)) {
+        return false;
+    }
+    for (int y = 0; y < image.GetHeight(); ++y) {
+        if (!encoder.WriteRow(image.GetLine(y), out)) {
+            return false;
+        }
+    }
+    if (!encoder.Finish(out)) {
+        return false;
+    }
+
+    IMGLIB_STATS_ADD(ROWS_ENCODED, image.GetHeight());
+    IMGLIB_STATS_ADD(BYTES_WRITTEN, out.size());
+    return true;
+}
+
+bool SavePNG(const Path& file, const Image& image, const PNGSaveOptions& options) {
+    const auto sink = OpenPNGSink(file, {image.GetWidth(), image.GetHeight()}, options);
+    if (!sink) {
+        return false;
+    }
+    for (int y = 0; y < image.GetHeight(); ++y) {
+        if (!sink->WriteRow(image.GetLine(y))) {
+            return false;
+        }
+    }
+    return sink->Finish();
+}
+
+ImageInfo ProbePNG(ByteSpan data) {
+    PNGHeader header;
+    if (!ReadPNGHeader(data, header)) {
+        return {};
+    }
+    // палитра раскрывается в RGB
+    const int channels = header.color_type == PNG_PALETTE ? 3 : header.GetChannels();
+    return {ImageFormat::PNG, {header.width, header.height}, channels};
+}
+
+unique_ptr<RowSource> OpenPNGSource(const Path& file) {
+    auto source = make_unique<PNGRowSource>(file);
+    if (!source->IsOpen()) {
+        return nullptr;
+    }
+    return source;
+}
+
+unique_ptr<RowSink> OpenPNGSink(const Path& file, Size size, const PNGSaveOptions& options) {
+    if (size.width <= 0 || size.height <= 0) {
+        return nullptr;
+    }
+    auto sink = make_unique<PNGRowSink>(file, size, options);
+    if (!sink->IsOpen()) {
+        return nullptr;
+    }
+    return sink;
+}
+
+}  // namespace img_lib
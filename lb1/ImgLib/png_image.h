@@ -0,0 +1,66 @@
+#pragma once
+#include "img_lib.h"
+#include "row_stream.h"
+
+#include <filesystem>
+#include <memory>
+
+namespace img_lib {
+using Path = std::filesystem::path;
+
+// фильтр строк PNG перед сжатием
+enum class PNGFilter {
+    NONE,
+    SUB,      // разность с левым пикселем
+    UP,       // разность с пикселем строки выше
+    AVERAGE,  // разность со средним левого и верхнего
+    PAETH,    // разность с предсказателем Паэта
+    ADAPTIVE  // для каждой строки выбирается фильтр с наименьшей суммой модулей
+};
+
+// стратегия zlib; FILTERED и RLE обычно лучше подходят для отфильтрованных строк
+enum class PNGStrategy {
+    DEFAULT,
+    FILTERED,
+    HUFFMAN_ONLY,
+    RLE,
+    FIXED
+};
+
+// формат пикселей при записи PNG
+enum class PNGPixelFormat {
+    RGB8,  // 3 байта R, G, B; альфа-канал отбрасывается
+    RGBA8  // 4 байта R, G, B, A
+};
+
+// параметры сжатия PNG; значения по умолчанию совпадают с libpng
+struct PNGSaveOptions {
+    // уровень сжатия zlib от 0 (без сжатия) до 9
+    int level = 6;
+    PNGFilter filter = PNGFilter::ADAPTIVE;
+    PNGStrategy strategy = PNGStrategy::DEFAULT;
+    PNGPixelFormat format = PNGPixelFormat::RGB8;
+    // быстрый режим: уровень 1, фильтр SUB и стратегия RLE вместо level,
+    // filter и strategy. файл заметно больше, но сжатие в разы быстрее
+    bool fast = false;
+};
+
+// читает PNG без чересстрочной развёртки любого типа цвета и глубины.
+// 16-битные отсчёты приводятся к 0..255, палитра и tRNS раскрываются в Color.
+// при ошибке, в том числе для файлов Adam7, возвращается пустое изображение
+Image LoadPNG(const Path& file);
+bool SavePNG(const Path& file, const Image& image, const PNGSaveOptions& options = {});
+
+// декодирование из памяти и кодирование в память, без обращения к файлам
+Image LoadPNG(ByteSpan data);
+bool SavePNG(Bytes& out, const Image& image, const PNGSaveOptions& options = {});
+
+// читает только сигнатуру и блок IHDR; при ошибке возвращает пустые сведения
+ImageInfo ProbePNG(ByteSpan data);
+
+// потоковое чтение и запись строк: строки фильтруются и сжимаются по одной,
+// блоки IDAT пишутся по мере заполнения. при ошибке открытия возвращают nullptr
+std::unique_ptr<RowSource> OpenPNGSource(const Path& file);
+std::unique_ptr<RowSink> OpenPNGSink(const Path& file, Size size, const PNGSaveOptions& options = {});
+
+}  // namespace img_lib
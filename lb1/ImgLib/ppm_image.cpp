@@ -1,7 +1,18 @@
 #include "ppm_image.h"
+#include "image_pool.h"
+#include "image_region.h"
+#include "image_stats.h"
+#include "mapped_file.h"
+#include "pixel_pack.h"
 
 #include <array>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
 #include <string_view>
 
 using namespace std;
@@ -9,12 +20,207 @@ using namespace std;
 namespace img_lib {
 
 static const string_view PPM_SIG = "P6"sv;
+static const string_view PGM_SIG = "P5"sv;
 static const int PPM_MAX = 255;
+static const int PNM_WIDE_MAX = 65535;
+
+// сведения из заголовка двоичных форматов P5 и P6
+struct PNMHeader {
+    int channels = 0;  // 1 для P5, 3 для P6
+    int width = 0;
+    int height = 0;
+    int maxval = 0;
+
+    // отсчёты с maxval больше 255 занимают 2 байта, старший первым
+    int GetSampleSize() const {
+        return maxval > PPM_MAX ? 2 : 1;
+    }
+
+    uint64_t GetRowSize() const {
+        return static_cast<uint64_t>(width) * channels * GetSampleSize();
+    }
+};
+
+static bool IsPNMSpace(int c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// разбирает заголовок посимвольно; get() возвращает очередной байт или EOF.
+// перед каждым числом допускаются пробелы и комментарии от # до конца строки,
+// за maxval следует ровно один пробельный символ перед пиксельными данными
+template <typename GetChar>
+static bool ParsePNMHeader(GetChar get, PNMHeader& header) {
+    if (get() != 'P') {
+        return false;
+    }
+    switch (get()) {
+        case '5':
+            header.channels = 1;
+            break;
+        case '6':
+            header.channels = 3;
+            break;
+        default:
+            return false;
+    }
+
+    int c = get();
+    for (int* field : {&header.width, &header.height, &header.maxval}) {
+        if (!IsPNMSpace(c) && c != '#') {
+            return false;
+        }
+        while (IsPNMSpace(c) || c == '#') {
+            if (c == '#') {
+                while (c != '\n' && c != '\r' && c != EOF) {
+                    c = get();
+                }
+            } else {
+                c = get();
+            }
+        }
+
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        int value = 0;
+        for (; c >= '0' && c <= '9'; c = get()) {
+            if (value >= numeric_limits<int>::max() / 10) {
+                return false;
+            }
+            value = value * 10 + (c - '0');
+        }
+        *field = value;
+    }
+
+    return IsPNMSpace(c) && header.width > 0 && header.height > 0
+        && header.maxval > 0 && header.maxval <= PNM_WIDE_MAX;
+}
+
+static bool ReadPNMHeader(istream& in, PNMHeader& header) {
+    return ParsePNMHeader([&in] {
+        return in.get();
+    }, header);
+}
+
+// header_size получает длину заголовка - смещение пиксельных данных
+static bool ReadPNMHeader(ByteSpan data, PNMHeader& header, size_t& header_size) {
+    if (data.data == nullptr) {
+        return false;
+    }
+    size_t pos = 0;
+    const bool ok = ParsePNMHeader([&data, &pos] {
+        return pos < data.size ? to_integer<int>(data.data[pos++]) : EOF;
+    }, header);
+    header_size = pos;
+    return ok;
+}
+
+// проверяет, что все строки помещаются в available байт, без переполнения
+static bool FitsPixelData(const PNMHeader& header, uint64_t available) {
+    return header.GetRowSize() <= available / static_cast<uint64_t>(header.height);
+}
+
+static void WritePNMHeader(ostream& out, string_view signature, int w, int h, int maxval) {
+    out << signature << '\n' << w << ' ' << h << '\n' << maxval << '\n';
+}
+
+static void WritePPMHeader(ostream& out, int w, int h) {
+    WritePNMHeader(out, PPM_SIG, w, h, PPM_MAX);
+}
+
+// приводит отсчёт 0..maxval к 0..255 с округлением;
+// значения больше maxval ограничиваются им
+static uint8_t ScaleSample(uint32_t value, uint32_t maxval) {
+    value = min(value, maxval);
+    if (maxval == PNM_WIDE_MAX) {
+        // то же округление, но деление на константу
+        return static_cast<uint8_t>((value + 128) / 257);
+    }
+    return static_cast<uint8_t>((value * 255 + maxval / 2) / maxval);
+}
+
+namespace {
+
+// преобразует строки файла в Color или в отсчёты серого. при maxval 255
+// байты копируются без масштабирования, для прочих 8-битных файлов
+// масштаб берётся из таблицы
+class PNMRowDecoder {
+public:
+    PNMRowDecoder() = default;
+
+    explicit PNMRowDecoder(const PNMHeader& header)
+        : header_(header) {
+        if (!IsWide()) {
+            for (int i = 0; i < 256; ++i) {
+                table_[i] = ScaleSample(i, header_.maxval);
+            }
+        }
+    }
+
+    void ToColor(const std::byte* src, Color* dst, int count) const {
+        if (header_.channels == 3 && header_.maxval == PPM_MAX) {
+            UnpackRGB(src, dst, count);
+        } else if (header_.channels == 3) {
+            for (int x = 0; x < count; ++x) {
+                dst[x] = {std::byte{GetSample(src, 3 * x)}, std::byte{GetSample(src, 3 * x + 1)},
+                          std::byte{GetSample(src, 3 * x + 2)}, std::byte{255}};
+            }
+        } else {
+            for (int x = 0; x < count; ++x) {
+                const std::byte value{GetSample(src, x)};
+                dst[x] = {value, value, value, std::byte{255}};
+            }
+        }
+    }
+
+    // только для P5
+    void ToGray(const std::byte* src, uint8_t* dst, int count) const {
+        if (header_.maxval == PPM_MAX) {
+            memcpy(dst, src, count);
+            return;
+        }
+        for (int x = 0; x < count; ++x) {
+            dst[x] = GetSample(src, x);
+        }
+    }
+
+    // только для P5; значения не масштабируются
+    void ToGray16(const std::byte* src, uint16_t* dst, int count) const {
+        if (IsWide()) {
+            for (int x = 0; x < count; ++x) {
+                dst[x] = ReadWide(src, x);
+            }
+        } else {
+            for (int x = 0; x < count; ++x) {
+                dst[x] = to_integer<uint16_t>(src[x]);
+            }
+        }
+    }
+
+private:
+    bool IsWide() const {
+        return header_.maxval > PPM_MAX;
+    }
+
+    static uint16_t ReadWide(const std::byte* src, int i) {
+        return static_cast<uint16_t>(to_integer<unsigned>(src[2 * i]) << 8 | to_integer<unsigned>(src[2 * i + 1]));
+    }
+
+    uint8_t GetSample(const std::byte* src, int i) const {
+        return IsWide() ? ScaleSample(ReadWide(src, i), header_.maxval) : table_[to_integer<uint8_t>(src[i])];
+    }
+
+    PNMHeader header_;
+    array<uint8_t, 256> table_ = {};
+};
+
+}  // namespace
 
 bool SavePPM(const Path& file, const Image& image) {
+    IMGLIB_STATS_TIMER(PPM_ENCODE);
     ofstream out(file, ios::binary);
 
-    out << PPM_SIG << '\n' << image.GetWidth() << ' ' << image.GetHeight() << '\n' << PPM_MAX << '\n';
+    WritePPMHeader(out, image.GetWidth(), image.GetHeight());
 
     const int w = image.GetWidth();
     const int h = image.GetHeight();
@@ -22,50 +228,369 @@ bool SavePPM(const Path& file, const Image& image) {
 
     for (int y = 0; y < h; ++y) {
         const Color* line = image.GetLine(y);
-        for (int x = 0; x < w; ++x) {
-            buff[x * 3 + 0] = static_cast<char>(line[x].r);
-            buff[x * 3 + 1] = static_cast<char>(line[x].g);
-            buff[x * 3 + 2] = static_cast<char>(line[x].b);
-        }
+        PackRGB(line, reinterpret_cast<std::byte*>(buff.data()), w);
+        IMGLIB_STATS_TIMER(FILE_WRITE);
         out.write(buff.data(), w * 3);
     }
 
+    IMGLIB_STATS_ADD(ROWS_ENCODED, h);
+    IMGLIB_STATS_ADD(BYTES_WRITTEN, max<streamoff>(out.tellp(), 0));
     return out.good();
 }
 
+bool SavePPMParallel(const Path& file, const Image& image, ThreadPool& pool) {
+    if (!image) {
+        return false;
+    }
+    IMGLIB_STATS_TIMER(PPM_ENCODE);
+    IMGLIB_STATS_ADD(ROWS_ENCODED, image.GetHeight());
+
+    const int w = image.GetWidth();
+    const int h = image.GetHeight();
+
+    ostringstream header;
+    WritePPMHeader(header, w, h);
+    const string header_str = header.str();
+
+    const size_t row_size = static_cast<size_t>(w) * 3;
+    const auto encode_rows = [&image, w, row_size](int first, int count, std::byte* dst) {
+        for (int i = 0; i < count; ++i) {
+            PackRGB(image.GetLine(first + i), dst + row_size * i, w);
+        }
+    };
+
+    return WriteRowsParallel(file, ByteSpan{reinterpret_cast<const std::byte*>(header_str.data()), header_str.size()},
+                             h, row_size, encode_rows, pool);
+}
+
+Image LoadPPM(ByteSpan data) {
+    IMGLIB_STATS_TIMER(PPM_DECODE);
+    PNMHeader header;
+    size_t offset = 0;
+
+    if (!ReadPNMHeader(data, header, offset) || !FitsPixelData(header, data.size - offset)) {
+        return {};
+    }
+
+    Image result = AcquireImage(header.width, header.height);
+    const PNMRowDecoder decoder(header);
+    const uint64_t row_size = header.GetRowSize();
+    const std::byte* pixels = data.data + offset;
+
+    for (int y = 0; y < header.height; ++y) {
+        decoder.ToColor(pixels + row_size * y, result.GetLine(y), header.width);
+    }
+
+    IMGLIB_STATS_ADD(ROWS_DECODED, header.height);
+    return result;
+}
+
+Image LoadPPMRegion(const Path& file, int x, int y, int w, int h) {
+    IMGLIB_STATS_TIMER(PPM_DECODE);
+    // Без буфера потока каждое чтение забирает с диска ровно
+    // нужные байты, а не целый блок вокруг них
+    ifstream in;
+    in.rdbuf()->pubsetbuf(nullptr, 0);
+    in.open(file, ios::binary);
+    PNMHeader header;
+
+    if (!in || !ReadPNMHeader(in, header) || !IsValidRegion({header.width, header.height}, x, y, w, h)) {
+        return {};
+    }
+
+    // проверяет, что все строки помещаются в файл
+    const uint64_t offset = static_cast<uint64_t>(in.tellg());
+    in.seekg(0, ios::end);
+    const uint64_t file_size = static_cast<uint64_t>(in.tellg());
+    if (file_size < offset || !FitsPixelData(header, file_size - offset)) {
+        return {};
+    }
+
+    Image result = AcquireImage(w, h);
+    const PNMRowDecoder decoder(header);
+    const uint64_t row_size = header.GetRowSize();
+    const uint64_t pixel_size = static_cast<uint64_t>(header.channels) * header.GetSampleSize();
+    std::vector<char> buff(pixel_size * w);
+
+    for (int row = 0; row < h; ++row) {
+        in.seekg(offset + row_size * (y + row) + pixel_size * x);
+        if (!in.read(buff.data(), buff.size())) {
+            return {};
+        }
+        decoder.ToColor(reinterpret_cast<const std::byte*>(buff.data()), result.GetLine(row), w);
+    }
+
+    IMGLIB_STATS_ADD(BYTES_READ, buff.size() * h);
+    IMGLIB_STATS_ADD(ROWS_DECODED, h);
+    return result;
+}
+
+ImageInfo ProbePPM(ByteSpan data) {
+    PNMHeader header;
+    size_t offset = 0;
+
+    // как и LoadPPM, отвергает файлы с обрезанными пиксельными данными
+    if (!ReadPNMHeader(data, header, offset) || !FitsPixelData(header, data.size - offset)) {
+        return {};
+    }
+
+    ImageInfo info;
+    info.format = ImageFormat::PPM;
+    info.size = {header.width, header.height};
+    info.channels = header.channels;
+    return info;
+}
+
 Image LoadPPM(const Path& file) {
-    // открывает поток с флагом ios::binary
-    ifstream ifs(file, ios::binary);
-    std::string sign;
-    int w, h, color_max;
+    // строки декодируются прямо из отображённых в память страниц
+    const MappedFile mapped(file);
+    if (!mapped) {
+        return {};
+    }
+    return LoadPPM(ByteSpan{mapped.GetData(), mapped.GetSize()});
+}
 
-    ifs >> sign >> w >> h >> color_max;
+GrayImage LoadPGM(ByteSpan data) {
+    IMGLIB_STATS_TIMER(PPM_DECODE);
+    PNMHeader header;
+    size_t offset = 0;
 
-    if (sign != PPM_SIG || color_max != PPM_MAX) {
+    if (!ReadPNMHeader(data, header, offset) || header.channels != 1
+        || !FitsPixelData(header, data.size - offset)) {
         return {};
     }
 
-    // пропускает 1 байт - конец строки
-    const char next = ifs.get();
-    if (next != '\n') {
+    GrayImage result(header.width, header.height);
+    const PNMRowDecoder decoder(header);
+    const uint64_t row_size = header.GetRowSize();
+    const std::byte* pixels = data.data + offset;
+
+    for (int y = 0; y < header.height; ++y) {
+        decoder.ToGray(pixels + row_size * y, result.GetLine(y), header.width);
+    }
+    IMGLIB_STATS_ADD(ROWS_DECODED, header.height);
+
+    return result;
+}
+
+GrayImage16 LoadPGM16(ByteSpan data, int* maxval) {
+    IMGLIB_STATS_TIMER(PPM_DECODE);
+    PNMHeader header;
+    size_t offset = 0;
+
+    if (!ReadPNMHeader(data, header, offset) || header.channels != 1
+        || !FitsPixelData(header, data.size - offset)) {
         return {};
     }
 
-    Image result(w, h, Color::Black());
-    std::vector<char> buff(w * 3);
+    GrayImage16 result(header.width, header.height);
+    const PNMRowDecoder decoder(header);
+    const uint64_t row_size = header.GetRowSize();
+    const std::byte* pixels = data.data + offset;
 
-    for (int y = 0; y < h; ++y) {
-        Color* line = result.GetLine(y);
-        ifs.read(buff.data(), w * 3);
+    for (int y = 0; y < header.height; ++y) {
+        decoder.ToGray16(pixels + row_size * y, result.GetLine(y), header.width);
+    }
+    IMGLIB_STATS_ADD(ROWS_DECODED, header.height);
+
+    if (maxval != nullptr) {
+        *maxval = header.maxval;
+    }
+    return result;
+}
+
+GrayImage LoadPGM(const Path& file) {
+    const MappedFile mapped(file);
+    if (!mapped) {
+        return {};
+    }
+    return LoadPGM(ByteSpan{mapped.GetData(), mapped.GetSize()});
+}
+
+GrayImage16 LoadPGM16(const Path& file, int* maxval) {
+    const MappedFile mapped(file);
+    if (!mapped) {
+        return {};
+    }
+    return LoadPGM16(ByteSpan{mapped.GetData(), mapped.GetSize()}, maxval);
+}
+
+bool SavePGM(const Path& file, const GrayImage& image) {
+    if (!image) {
+        return false;
+    }
+
+    IMGLIB_STATS_TIMER(PPM_ENCODE);
+    ofstream out(file, ios::binary);
+    WritePNMHeader(out, PGM_SIG, image.GetWidth(), image.GetHeight(), PPM_MAX);
+
+    // строки однобайтовых отсчётов пишутся без преобразования
+    for (int y = 0; y < image.GetHeight(); ++y) {
+        IMGLIB_STATS_TIMER(FILE_WRITE);
+        out.write(reinterpret_cast<const char*>(image.GetLine(y)), image.GetWidth());
+    }
+
+    IMGLIB_STATS_ADD(ROWS_ENCODED, image.GetHeight());
+    IMGLIB_STATS_ADD(BYTES_WRITTEN, max<streamoff>(out.tellp(), 0));
+    return out.good();
+}
+
+bool SavePGM(const Path& file, const GrayImage16& image, int maxval) {
+    if (!image || maxval <= 0 || maxval > PNM_WIDE_MAX) {
+        return false;
+    }
+
+    IMGLIB_STATS_TIMER(PPM_ENCODE);
+    ofstream out(file, ios::binary);
+    WritePNMHeader(out, PGM_SIG, image.GetWidth(), image.GetHeight(), maxval);
+
+    const int w = image.GetWidth();
+    const bool wide = maxval > PPM_MAX;
+    std::vector<char> buff(static_cast<size_t>(w) * (wide ? 2 : 1));
 
+    for (int y = 0; y < image.GetHeight(); ++y) {
+        const uint16_t* line = image.GetLine(y);
         for (int x = 0; x < w; ++x) {
-            line[x].r = static_cast<byte>(buff[x * 3 + 0]);
-            line[x].g = static_cast<byte>(buff[x * 3 + 1]);
-            line[x].b = static_cast<byte>(buff[x * 3 + 2]);
+            const int value = min<int>(line[x], maxval);
+            if (wide) {
+                buff[2 * x] = static_cast<char>(value >> 8);
+                buff[2 * x + 1] = static_cast<char>(value & 0xFF);
+            } else {
+                buff[x] = static_cast<char>(value);
+            }
         }
+        IMGLIB_STATS_TIMER(FILE_WRITE);
+        out.write(buff.data(), buff.size());
     }
 
-    return result;
+    IMGLIB_STATS_ADD(ROWS_ENCODED, image.GetHeight());
+    IMGLIB_STATS_ADD(BYTES_WRITTEN, max<streamoff>(out.tellp(), 0));
+    return out.good();
+}
+
+bool SavePPM(Bytes& out, const Image& image) {
+    if (!image) {
+        return false;
+    }
+
+    IMGLIB_STATS_TIMER(PPM_ENCODE);
+    const int w = image.GetWidth();
+    const int h = image.GetHeight();
+
+    ostringstream header;
+    WritePPMHeader(header, w, h);
+    const string header_str = header.str();
+
+    const size_t row_size = static_cast<size_t>(w) * 3;
+    out.resize(header_str.size() + row_size * h);
+    memcpy(out.data(), header_str.data(), header_str.size());
+
+    // упаковывает строки сразу на их место в буфере
+    std::byte* pixels = out.data() + header_str.size();
+    for (int y = 0; y < h; ++y) {
+        PackRGB(image.GetLine(y), pixels + row_size * y, w);
+    }
+
+    IMGLIB_STATS_ADD(ROWS_ENCODED, h);
+    IMGLIB_STATS_ADD(BYTES_WRITTEN, out.size());
+    return true;
+}
+
+namespace {
+
+class PPMRowSource : public RowSource {
+public:
+    explicit PPMRowSource(const Path& file)
+        : in_(file, ios::binary) {
+        if (!ReadPNMHeader(in_, header_)) {
+            header_ = {};
+            return;
+        }
+        decoder_ = PNMRowDecoder(header_);
+        buff_.resize(header_.GetRowSize());
+    }
+
+    Size GetSize() const override {
+        return {header_.width, header_.height};
+    }
+
+    bool ReadRow(Color* dst) override {
+        IMGLIB_STATS_TIMER(PPM_DECODE);
+        if (rows_read_ >= header_.height || !in_.read(buff_.data(), buff_.size())) {
+            return false;
+        }
+        IMGLIB_STATS_ADD(BYTES_READ, buff_.size());
+        IMGLIB_STATS_ADD(ROWS_DECODED, 1);
+        decoder_.ToColor(reinterpret_cast<const std::byte*>(buff_.data()), dst, header_.width);
+        ++rows_read_;
+        return true;
+    }
+
+private:
+    ifstream in_;
+    PNMHeader header_;
+    PNMRowDecoder decoder_;
+    int rows_read_ = 0;
+    std::vector<char> buff_;
+};
+
+class PPMRowSink : public RowSink {
+public:
+    PPMRowSink(const Path& file, Size size)
+        : out_(file, ios::binary)
+        , size_(size)
+        , buff_(size.width * 3) {
+        WritePPMHeader(out_, size_.width, size_.height);
+    }
+
+    bool WriteRow(const Color* row) override {
+        if (rows_written_ >= size_.height) {
+            return false;
+        }
+        IMGLIB_STATS_TIMER(PPM_ENCODE);
+        PackRGB(row, reinterpret_cast<std::byte*>(buff_.data()), size_.width);
+        out_.write(buff_.data(), buff_.size());
+        IMGLIB_STATS_ADD(BYTES_WRITTEN, buff_.size());
+        IMGLIB_STATS_ADD(ROWS_ENCODED, 1);
+        ++rows_written_;
+        return out_.good();
+    }
+
+    bool Finish() override {
+        out_.flush();
+        return rows_written_ == size_.height && out_.good();
+    }
+
+    bool IsOpen() const {
+        return out_.good();
+    }
+
+private:
+    ofstream out_;
+    Size size_;
+    int rows_written_ = 0;
+    std::vector<char> buff_;
+};
+
+}  // namespace
+
+unique_ptr<RowSource> OpenPPMSource(const Path& file) {
+    auto source = make_unique<PPMRowSource>(file);
+    if (source->GetSize().width <= 0) {
+        return nullptr;
+    }
+    return source;
+}
+
+unique_ptr<RowSink> OpenPPMSink(const Path& file, Size size) {
+    if (size.width <= 0 || size.height <= 0) {
+        return nullptr;
+    }
+    auto sink = make_unique<PPMRowSink>(file, size);
+    if (!sink->IsOpen()) {
+        return nullptr;
+    }
+    return sink;
 }
 
 }  // namespace img_lib
\ No newline at end of file
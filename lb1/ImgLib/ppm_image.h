@@ -1,12 +1,53 @@
 #pragma once
+#include "gray_image.h"
 #include "img_lib.h"
+#include "parallel_writer.h"
+#include "row_stream.h"
+#include "thread_pool.h"
 
 #include <filesystem>
+#include <memory>
 
 namespace img_lib {
 using Path = std::filesystem::path;
 
 bool SavePPM(const Path& file, const Image& image);
+
+// читает P6 и P5 (оттенки серого размножаются на R, G, B) с maxval
+// от 1 до 65535; 16-битные отсчёты хранятся старшим байтом вперёд.
+// отсчёты приводятся к диапазону 0..255, комментарии # в заголовке пропускаются
 Image LoadPPM(const Path& file);
 
+// кодирует полосы строк в пуле потоков и пишет их на свои места в файле;
+// на больших изображениях быстрее последовательной SavePPM
+bool SavePPMParallel(const Path& file, const Image& image, ThreadPool& pool = GetWriterThreadPool());
+
+// декодирование из памяти и кодирование в память, без обращения к файлам
+Image LoadPPM(ByteSpan data);
+bool SavePPM(Bytes& out, const Image& image);
+
+// читает с диска только байты строк и столбцов области (x, y, w, h);
+// при ошибке или выходе области за границы возвращает пустое изображение
+Image LoadPPMRegion(const Path& file, int x, int y, int w, int h);
+
+// читает только заголовок P5 или P6; при ошибке возвращает пустые сведения
+ImageInfo ProbePPM(ByteSpan data);
+
+// читает P5 в одноканальное изображение без расширения до Color.
+// LoadPGM приводит отсчёты к 0..255, LoadPGM16 сохраняет их как есть
+// в диапазоне 0..maxval файла и при необходимости сообщает maxval
+GrayImage LoadPGM(const Path& file);
+GrayImage LoadPGM(ByteSpan data);
+GrayImage16 LoadPGM16(const Path& file, int* maxval = nullptr);
+GrayImage16 LoadPGM16(ByteSpan data, int* maxval = nullptr);
+
+// записывают P5; при maxval больше 255 отсчёты занимают по 2 байта,
+// значения больше maxval ограничиваются им
+bool SavePGM(const Path& file, const GrayImage& image);
+bool SavePGM(const Path& file, const GrayImage16& image, int maxval = 65535);
+
+// потоковое чтение и запись строк; при ошибке открытия возвращают nullptr
+std::unique_ptr<RowSource> OpenPPMSource(const Path& file);
+std::unique_ptr<RowSink> OpenPPMSink(const Path& file, Size size);
+
 }  // namespace img_lib
\ No newline at end of file
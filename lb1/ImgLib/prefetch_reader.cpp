@@ -0,0 +1,107 @@
+#include "prefetch_reader.h"
+#include "image_stats.h"
+
+#include <fstream>
+#include <system_error>
+#include <utility>
+
+using namespace std;
+
+namespace img_lib {
+
+bool ReadFile(const Path& file, Bytes& data) {
+    ifstream in(file, ios::binary | ios::ate);
+    if (!in) {
+        return false;
+    }
+
+    const streamoff size = in.tellg();
+    if (size <= 0) {
+        return false;
+    }
+
+    data.resize(static_cast<size_t>(size));
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char*>(data.data()), size)) {
+        data.clear();
+        return false;
+    }
+    IMGLIB_STATS_ADD(BYTES_READ, data.size());
+    return true;
+}
+
+PrefetchReader::PrefetchReader(vector<Path> files, const PrefetchOptions& options)
+    : files_(move(files))
+    , options_(options)
+    , entries_(files_.size())
+    , io_pool_(options.io_threads) {
+    lock_guard lock(mutex_);
+    Schedule();
+}
+
+bool PrefetchReader::Take(size_t index, Bytes& data) {
+    unique_lock lock(mutex_);
+    if (index >= entries_.size() || entries_[index].state == State::TAKEN) {
+        return false;
+    }
+
+    Entry& entry = entries_[index];
+    if (entry.state == State::WAITING) {
+        // чтение до этого файла не дошло: Schedule его пропустит
+        entry.state = State::TAKEN;
+        lock.unlock();
+        return ReadFile(files_[index], data);
+    }
+
+    has_data_.wait(lock, [&entry] {
+        return entry.state == State::READY || entry.state == State::FAILED;
+    });
+    const bool ok = entry.state == State::READY;
+    data = move(entry.data);
+    entry.data = {};
+    entry.state = State::TAKEN;
+
+    bytes_in_flight_ -= entry.reserved;
+    --files_ahead_;
+    Schedule();
+    return ok;
+}
+
+void PrefetchReader::Schedule() {
+    while (next_to_read_ < entries_.size() && files_ahead_ < options_.max_files_ahead) {
+        Entry& entry = entries_[next_to_read_];
+        if (entry.state != State::WAITING) {
+            ++next_to_read_;
+            continue;
+        }
+
+        error_code ec;
+        const uintmax_t size = filesystem::file_size(files_[next_to_read_], ec);
+        const size_t reserved = ec ? 0 : static_cast<size_t>(size);
+        if (bytes_in_flight_ > 0 && bytes_in_flight_ + reserved > options_.max_bytes_in_flight) {
+            break;
+        }
+
+        entry.state = State::READING;
+        entry.reserved = reserved;
+        bytes_in_flight_ += reserved;
+        ++files_ahead_;
+        const size_t index = next_to_read_++;
+        io_pool_.Submit([this, index] {
+            Read(index);
+        });
+    }
+}
+
+void PrefetchReader::Read(size_t index) {
+    Bytes data;
+    const bool ok = ReadFile(files_[index], data);
+
+    lock_guard lock(mutex_);
+    Entry& entry = entries_[index];
+    entry.data = move(data);
+    entry.state = ok ? State::READY : State::FAILED;
+    has_data_.notify_all();
+}
+
+}  // namespace img_lib
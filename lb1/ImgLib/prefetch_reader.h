@@ -0,0 +1,84 @@
+#pragma once
+#include "img_lib.h"
+#include "thread_pool.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+namespace img_lib {
+using Path = std::filesystem::path;
+
+// параметры упреждающего чтения
+struct PrefetchOptions {
+    // сколько файлов, прочитанных или читаемых, может ждать своей очереди
+    size_t max_files_ahead = 4;
+    // сколько байт они могут занимать вместе. файл больше предела
+    // читается, только когда других непрочитанных и невзятых файлов нет
+    size_t max_bytes_in_flight = size_t{256} << 20;
+    // число потоков чтения
+    size_t io_threads = 2;
+};
+
+// читает файлы списка в память заранее, в фоновых потоках, пока вызывающие
+// декодируют предыдущие. файлы читаются по порядку списка, каждый берётся
+// через Take один раз. Take безопасен для вызова из нескольких потоков.
+// деструктор дожидается завершения начатых чтений
+class PrefetchReader {
+public:
+    explicit PrefetchReader(std::vector<Path> files, const PrefetchOptions& options = {});
+
+    PrefetchReader(const PrefetchReader&) = delete;
+    PrefetchReader& operator=(const PrefetchReader&) = delete;
+
+    size_t GetFileCount() const {
+        return files_.size();
+    }
+
+    // ждёт, пока файл index будет прочитан, и отдаёт его содержимое.
+    // файл, до которого чтение ещё не дошло, читается в вызывающем потоке.
+    // возвращает false, если файл не читается или уже был взят
+    bool Take(size_t index, Bytes& data);
+
+private:
+    enum class State {
+        WAITING,  // чтение ещё не начато
+        READING,
+        READY,
+        FAILED,
+        TAKEN
+    };
+
+    struct Entry {
+        State state = State::WAITING;
+        // размер, учтённый в bytes_in_flight_
+        size_t reserved = 0;
+        Bytes data;
+    };
+
+    // начинает чтение следующих файлов в пределах ограничений;
+    // вызывается под mutex_
+    void Schedule();
+    void Read(size_t index);
+
+    const std::vector<Path> files_;
+    const PrefetchOptions options_;
+
+    std::mutex mutex_;
+    std::condition_variable has_data_;
+    std::vector<Entry> entries_;
+    size_t next_to_read_ = 0;
+    size_t files_ahead_ = 0;
+    size_t bytes_in_flight_ = 0;
+
+    // объявлен последним, чтобы разрушиться первым: его потоки
+    // обращаются к остальным полям
+    ThreadPool io_pool_;
+};
+
+// читает файл целиком; при ошибке или для пустого файла возвращает false
+bool ReadFile(const Path& file, Bytes& data);
+
+}  // namespace img_lib
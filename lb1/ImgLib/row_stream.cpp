@@ -0,0 +1,20 @@
+#include "row_stream.h"
+
+#include <vector>
+
+namespace img_lib {
+
+bool StreamRows(RowSource& source, RowSink& sink) {
+    const Size size = source.GetSize();
+    std::vector<Color> row(size.width);
+
+    for (int y = 0; y < size.height; ++y) {
+        if (!source.ReadRow(row.data()) || !sink.WriteRow(row.data())) {
+            return false;
+        }
+    }
+
+    return sink.Finish();
+}
+
+}  // namespace img_lib
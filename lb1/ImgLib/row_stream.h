@@ -0,0 +1,35 @@
+#pragma once
+#include "img_lib.h"
+
+namespace img_lib {
+
+// источник строк изображения: декодер, отдающий строки по одной
+// сверху вниз без построения изображения целиком
+class RowSource {
+public:
+    virtual ~RowSource() = default;
+
+    virtual Size GetSize() const = 0;
+
+    // декодирует следующую строку в dst (GetSize().width пикселей);
+    // возвращает false при ошибке или если строки закончились
+    virtual bool ReadRow(Color* dst) = 0;
+};
+
+// приёмник строк изображения: кодер, принимающий строки по одной сверху вниз
+class RowSink {
+public:
+    virtual ~RowSink() = default;
+
+    virtual bool WriteRow(const Color* row) = 0;
+
+    // завершает запись; возвращает false, если получены не все строки
+    // или произошла ошибка вывода
+    virtual bool Finish() = 0;
+};
+
+// перекачивает строки из источника в приёмник;
+// в памяти одновременно находится только одна строка
+bool StreamRows(RowSource& source, RowSink& sink);
+
+}  // namespace img_lib
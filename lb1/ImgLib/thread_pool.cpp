@@ -0,0 +1,63 @@
+#include "thread_pool.h"
+
+using namespace std;
+
+namespace img_lib {
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+    workers_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.emplace_back([this] {
+            WorkerLoop();
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    has_task_.notify_all();
+
+    // оставшиеся в очереди задачи выполняются до конца
+    for (thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::GetDefaultThreadCount() {
+    const unsigned cores = thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
+}
+
+void ThreadPool::Enqueue(function<void()> task) {
+    {
+        lock_guard lock(mutex_);
+        tasks_.push_back(move(task));
+    }
+    has_task_.notify_one();
+}
+
+void ThreadPool::WorkerLoop() {
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock lock(mutex_);
+            has_task_.wait(lock, [this] {
+                return stopping_ || !tasks_.empty();
+            });
+            if (tasks_.empty()) {
+                return;
+            }
+            task = move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+}  // namespace img_lib
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace img_lib {
+
+// пул потоков фиксированного размера с общей очередью задач
+class ThreadPool {
+public:
+    // по умолчанию создаёт по потоку на каждое ядро процессора
+    explicit ThreadPool(size_t thread_count = GetDefaultThreadCount());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    static size_t GetDefaultThreadCount();
+
+    size_t GetThreadCount() const {
+        return workers_.size();
+    }
+
+    // ставит задачу в очередь; результат (или исключение) доступен через future
+    template <typename Func>
+    auto Submit(Func func) -> std::future<std::invoke_result_t<Func>> {
+        using Result = std::invoke_result_t<Func>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(func));
+        std::future<Result> result = task->get_future();
+        Enqueue([task] {
+            (*task)();
+        });
+        return result;
+    }
+
+private:
+    void Enqueue(std::function<void()> task);
+    void WorkerLoop();
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+    bool stopping_ = false;
+};
+
+}  // namespace img_lib
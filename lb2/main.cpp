@@ -1,5 +1,12 @@
 #include "CImg.h"
+#include <algorithm>
 #include <iostream>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 using namespace cimg_library;
 
@@ -9,31 +16,222 @@ const double ANGLE = 30.0;
 const unsigned char BLACK[] = {0, 0, 0};
 const unsigned char BLUE[] = {0, 0, 255};
 
-CImg<unsigned char> GetFragment(const CImg<unsigned char>& inputed_image, int inputed_width, int inputed_height) {
+// Квадрат в центре исходного изображения; границы включительно, как у get_crop
+struct FragmentRect {
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+};
+
+FragmentRect GetFragmentRect(int inputed_width, int inputed_height) {
 	int fragment_size = inputed_width / 8;
 	int x_center = inputed_width / 2;
 	int y_center = inputed_height / 2;
 
-	return inputed_image.get_crop(
+	return {
 		x_center - fragment_size / 2,
 		y_center - fragment_size / 2,
 		x_center + fragment_size / 2,
 		y_center + fragment_size / 2
-	).rotate(ANGLE);
+	};
 }
 
-void InsertFragmentIntoImg(const CImg<unsigned char>& fragment, CImg<unsigned char>& tmp_image, int height_new_photo){
-	int frag_width = fragment.width();
-	int frag_height = fragment.height();
-	int x_pos = 10;
-	int y_pos = height_new_photo - frag_height - 10;
-	cimg_forXY(fragment, x, y) {
-		if (fragment(x,y,0) != 0 || fragment(x,y,1) != 0 || fragment(x,y,2) != 0) {
-			tmp_image.draw_point(x + x_pos, y + y_pos, fragment.data(x, y));
+// Геометрия фрагмента после поворота, посчитанная так же, как в CImg::get_rotate:
+// пиксель (x, y) повёрнутого фрагмента берётся из точки
+// (w2 + xc * ca + yc * sa, h2 - xc * sa + yc * ca) квадрата, где xc = x - rw2, yc = y - rh2
+struct RotatedFragment {
+	int width;
+	int height;
+	float ca, sa;
+	float w2, h2;
+	float rw2, rh2;
+};
+
+RotatedFragment GetRotatedFragment(const FragmentRect& rect, double angle) {
+	const unsigned int crop_width = rect.x1 - rect.x0 + 1;
+	const unsigned int crop_height = rect.y1 - rect.y0 + 1;
+	const float nangle = cimg::mod((float)angle, 360.f);
+	const float rad = (float)(nangle * cimg::PI / 180.);
+	const float ca = (float)std::cos(rad);
+	const float sa = (float)std::sin(rad);
+	const float ux = cimg::abs((crop_width - 1) * ca);
+	const float uy = cimg::abs((crop_width - 1) * sa);
+	const float vx = cimg::abs((crop_height - 1) * sa);
+	const float vy = cimg::abs((crop_height - 1) * ca);
+
+	RotatedFragment rotated;
+	rotated.width = (int)cimg::round(1 + ux + vx);
+	rotated.height = (int)cimg::round(1 + uy + vy);
+	rotated.ca = ca;
+	rotated.sa = sa;
+	rotated.w2 = 0.5f * (crop_width - 1);
+	rotated.h2 = 0.5f * (crop_height - 1);
+	rotated.rw2 = 0.5f * (rotated.width - 1);
+	rotated.rh2 = 0.5f * (rotated.height - 1);
+	return rotated;
+}
+
+// Источник выборки: плоскости каналов исходного изображения и окно квадрата
+// в его координатах. Точки вне квадрата и вне изображения чёрные,
+// как после get_crop и rotate с нулевыми граничными условиями
+struct FragmentSource {
+	const unsigned char* planes[COLOR_CHANNELS_COUNT];
+	int stride;
+	int x0, y0;
+	// окно допустимых отсчётов в координатах квадрата, правые границы не включаются
+	int valid_x0, valid_y0, valid_x1, valid_y1;
+};
+
+FragmentSource GetFragmentSource(const CImg<unsigned char>& inputed_image, const FragmentRect& rect) {
+	FragmentSource source;
+	for (int c = 0; c < COLOR_CHANNELS_COUNT; ++c) {
+		// у серого изображения один канал идёт во все три
+		source.planes[c] = inputed_image.data(0, 0, 0, inputed_image.spectrum() >= COLOR_CHANNELS_COUNT ? c : 0);
+	}
+	source.stride = inputed_image.width();
+	source.x0 = rect.x0;
+	source.y0 = rect.y0;
+	source.valid_x0 = std::max(0, -rect.x0);
+	source.valid_y0 = std::max(0, -rect.y0);
+	source.valid_x1 = std::min(rect.x1 + 1, inputed_image.width()) - rect.x0;
+	source.valid_y1 = std::min(rect.y1 + 1, inputed_image.height()) - rect.y0;
+	return source;
+}
+
+// Билинейная выборка трёх каналов в точке (fx, fy) квадрата по формуле CImg::linear_atXY
+void SampleFragment(const FragmentSource& source, float fx, float fy, unsigned char* rgb) {
+	const int x = (int)fx - (fx >= 0 ? 0 : 1);
+	const int y = (int)fy - (fy >= 0 ? 0 : 1);
+	const float dx = fx - x;
+	const float dy = fy - y;
+	const bool inside = x >= source.valid_x0 && x + 1 < source.valid_x1
+		&& y >= source.valid_y0 && y + 1 < source.valid_y1;
+	const int offset = (source.y0 + y) * source.stride + source.x0 + x;
+
+	for (int c = 0; c < COLOR_CHANNELS_COUNT; ++c) {
+		float Icc, Inc, Icn, Inn;
+		if (inside) {
+			const unsigned char* p = source.planes[c] + offset;
+			Icc = p[0];
+			Inc = p[1];
+			Icn = p[source.stride];
+			Inn = p[source.stride + 1];
+		} else {
+			auto at = [&](int px, int py) -> float {
+				if (px < source.valid_x0 || px >= source.valid_x1 || py < source.valid_y0 || py >= source.valid_y1) {
+					return 0;
+				}
+				return source.planes[c][(source.y0 + py) * source.stride + source.x0 + px];
+			};
+			Icc = at(x, y);
+			Inc = at(x + 1, y);
+			Icn = at(x, y + 1);
+			Inn = at(x + 1, y + 1);
+		}
+		rgb[c] = (unsigned char)(Icc + (Inc - Icc + (Icc + Inn - Icn - Inc) * dy) * dx + (Icn - Icc) * dy);
+	}
+}
+
+// Переносит в строку результата нечёрные пиксели строки фрагмента.
+// Маска считается по 16 пикселей сразу: пиксель фона остаётся там,
+// где все три канала фрагмента равны нулю
+void MaskedCopyRow(const unsigned char* const* fragment, unsigned char* const* target, int count) {
+	int x = 0;
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	for (; x + 16 <= count; x += 16) {
+		const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fragment[0] + x));
+		const __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fragment[1] + x));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fragment[2] + x));
+		const __m128i keep = _mm_cmpeq_epi8(_mm_or_si128(_mm_or_si128(r, g), b), zero);
+		const __m128i values[COLOR_CHANNELS_COUNT] = {r, g, b};
+		for (int c = 0; c < COLOR_CHANNELS_COUNT; ++c) {
+			__m128i* dst = reinterpret_cast<__m128i*>(target[c] + x);
+			const __m128i old_value = _mm_loadu_si128(dst);
+			_mm_storeu_si128(dst, _mm_or_si128(_mm_and_si128(keep, old_value), _mm_andnot_si128(keep, values[c])));
+		}
+	}
+#endif
+	for (; x < count; ++x) {
+		if (fragment[0][x] != 0 || fragment[1][x] != 0 || fragment[2][x] != 0) {
+			for (int c = 0; c < COLOR_CHANNELS_COUNT; ++c) {
+				target[c][x] = fragment[c][x];
+			}
 		}
 	}
 }
 
+// Строки [row_begin, row_end) повёрнутого фрагмента и столбцы [col_begin, col_end)
+// выбираются в буфер строки и сразу вставляются в изображение с позиции (x_pos, y_pos)
+void InsertFragmentRows(const FragmentSource& source, const RotatedFragment& rotated, CImg<unsigned char>& tmp_image,
+		int x_pos, int y_pos, int col_begin, int col_end, int row_begin, int row_end) {
+	const int count = col_end - col_begin;
+	std::vector<unsigned char> buffer(COLOR_CHANNELS_COUNT * count);
+	unsigned char* fragment[COLOR_CHANNELS_COUNT];
+	for (int c = 0; c < COLOR_CHANNELS_COUNT; ++c) {
+		fragment[c] = buffer.data() + c * count;
+	}
+
+	for (int y = row_begin; y < row_end; ++y) {
+		const float yc = y - rotated.rh2;
+		const float yc_sa = yc * rotated.sa;
+		const float yc_ca = yc * rotated.ca;
+		for (int x = col_begin; x < col_end; ++x) {
+			const float xc = x - rotated.rw2;
+			unsigned char rgb[COLOR_CHANNELS_COUNT];
+			SampleFragment(source, rotated.w2 + xc * rotated.ca + yc_sa, rotated.h2 - xc * rotated.sa + yc_ca, rgb);
+			for (int c = 0; c < COLOR_CHANNELS_COUNT; ++c) {
+				fragment[c][x - col_begin] = rgb[c];
+			}
+		}
+
+		unsigned char* target[COLOR_CHANNELS_COUNT];
+		for (int c = 0; c < COLOR_CHANNELS_COUNT; ++c) {
+			target[c] = tmp_image.data(x_pos + col_begin, y_pos + y, 0, c);
+		}
+		MaskedCopyRow(fragment, target, count);
+	}
+}
+
+// Вырезает квадрат, поворачивает его и вставляет без чёрных пикселей в левый
+// нижний угол за один проход: каждый пиксель результата сразу выбирается
+// из исходного изображения, промежуточные изображения не создаются.
+// Видимые строки делятся между потоками
+void InsertFragmentIntoImg(const CImg<unsigned char>& inputed_image, const FragmentRect& rect,
+		CImg<unsigned char>& tmp_image, int height_new_photo) {
+	const int MIN_ROWS_PER_THREAD = 64;
+
+	const RotatedFragment rotated = GetRotatedFragment(rect, ANGLE);
+	const FragmentSource source = GetFragmentSource(inputed_image, rect);
+	int x_pos = 10;
+	int y_pos = height_new_photo - rotated.height - 10;
+
+	const int col_begin = std::max(0, -x_pos);
+	const int col_end = std::min(rotated.width, tmp_image.width() - x_pos);
+	const int row_begin = std::max(0, -y_pos);
+	const int row_end = std::min(rotated.height, tmp_image.height() - y_pos);
+	if (col_begin >= col_end || row_begin >= row_end) {
+		return;
+	}
+
+	const int rows = row_end - row_begin;
+	const int threads_count = std::max(1, std::min<int>(std::thread::hardware_concurrency(), rows / MIN_ROWS_PER_THREAD));
+	std::vector<std::thread> threads;
+	for (int i = 1; i < threads_count; ++i) {
+		const int first = row_begin + rows * i / threads_count;
+		const int last = row_begin + rows * (i + 1) / threads_count;
+		threads.emplace_back([&, first, last] {
+			InsertFragmentRows(source, rotated, tmp_image, x_pos, y_pos, col_begin, col_end, first, last);
+		});
+	}
+	InsertFragmentRows(source, rotated, tmp_image, x_pos, y_pos, col_begin, col_end,
+		row_begin, row_begin + rows / threads_count);
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
 void InsertAxes(CImg<unsigned char>& tmp_image, int graph_x, int graph_y){
 	const int DELTA = 10;
 	const float OPACITY = 1;
@@ -86,8 +284,8 @@ int main(int argc, const char** argv) {
 	int inputed_height = inputed_image.height();
 
 
-	CImg<unsigned char> fragment = GetFragment(inputed_image, inputed_width, inputed_height);
-	InsertFragmentIntoImg(fragment, tmp_image, height_new_photo);
+	FragmentRect fragment_rect = GetFragmentRect(inputed_width, inputed_height);
+	InsertFragmentIntoImg(inputed_image, fragment_rect, tmp_image, height_new_photo);
 
     int graph_x = tmp_image.width() / 4;
 	int graph_y = tmp_image.height() * 0.75;